@@ -24,7 +24,6 @@ set compiler_args=^
 -wd4146 ^
 -wd4127 ^
 -wd4312 ^
--Fe:opengl_engine ^
 -IE:\Tools\glfw\include\GLFW ^
 -IE:\Tools\glad\include ^
 -IE:\Tools\VulkanSDK\Third-Party\Include\glm ^
@@ -36,16 +35,32 @@ E:\Tools\glfw\build\src\Debug\glfw3.lib ^
 E:\Tools\assimp\lib\Release\assimp-vc143-mt.lib ^
 user32.lib gdi32.lib shell32.lib opengl32.lib
 
+rem common.glsl is no stage of its own, every shader is checked with it inserted after the #version line, as
+rem SetShaderSource does at run time
 pushd src\shaders
-for %%i in (./*) do glslangValidator %%i
+for %%i in (*.vert *.frag *.comp) do call :validate_shader %%i
 popd
 
 pushd build
 
-cl %compiler_args% ..\src\*.cpp ..\src\*.c /link /NODEFAULTLIB:library %linker_args% && echo [32mBuild successfull[0m || echo [31mBuild failed[0m
+cl %compiler_args% -Fe:opengl_engine ..\src\*.cpp ..\src\*.c /link /NODEFAULTLIB:library %linker_args% && echo [32mBuild successfull[0m || echo [31mBuild failed[0m
+cl %compiler_args% -Fe:texture_cooker ..\src\tools\texture_cooker.cpp /link /NODEFAULTLIB:library user32.lib && echo [32mTexture cooker build successfull[0m || echo [31mTexture cooker build failed[0m
+cl %compiler_args% -Fe:asset_packer ..\src\tools\asset_packer.cpp /link /NODEFAULTLIB:library user32.lib && echo [32mAsset packer build successfull[0m || echo [31mAsset packer build failed[0m
 
 popd
 
 
 :concat
 set shaders=%shaders% %1
+goto :eof
+
+:validate_shader
+set /p shader_version=<%1
+(
+    echo %shader_version%
+    type common.glsl
+    echo #line 2
+    more +1 %1
+) > ..\..\engine\shaders\%1
+glslangValidator ..\..\engine\shaders\%1
+goto :eof
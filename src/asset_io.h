@@ -0,0 +1,150 @@
+#pragma once
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "utils/utils.h"
+#include "platform.h"
+#include "package.h"
+
+// Assimp file access through OpenAssetFile, so models and their material files are read from the
+// package (or the mapped loose file) instead of going through fopen/fread. Reads copy straight out of
+// the mapping, page faults included, and every file opened by an import is recorded with its byte count
+// and time spent mapping and reading it. The native importers record theirs with OpenRecordedAssetFile.
+
+struct Asset_IO_File_Stats
+{
+    char path[ 128 ];
+    u64 size;
+    u64 bytesRead;
+    u32 readsCount;
+    float64 openSeconds;
+    float64 readSeconds;
+};
+
+// Opens the file with OpenAssetFile and appends its stats, nothing read yet
+internal bool OpenRecordedAssetFile( char *path, Asset_File *file, std::vector< Asset_IO_File_Stats > *stats )
+{
+    u64 start = GetPerformanceCounter();
+    if ( !OpenAssetFile( path, file ) ) { return false; }
+
+    Asset_IO_File_Stats fileStats = {};
+    strncpy_s( fileStats.path, path, sizeof( fileStats.path ) - 1 );
+    fileStats.size = file->size;
+    fileStats.openSeconds = GetSecondsElapsed( start, GetPerformanceCounter() );
+    stats->push_back( fileStats );
+    return true;
+}
+
+struct Asset_IO_System;
+
+struct Asset_IO_Stream : Assimp::IOStream
+{
+    Asset_File file;
+    u64 position;
+
+    Asset_IO_System *system;
+    int statsIndex;
+
+    Asset_IO_Stream( Asset_File assetFile, Asset_IO_System *ioSystem, int index )
+        : file( assetFile ), position( 0 ), system( ioSystem ), statsIndex( index ) {}
+    ~Asset_IO_Stream() { CloseAssetFile( &file ); }
+
+    size_t Read( void *buffer, size_t size, size_t count ) override;
+
+    size_t Write( const void *buffer, size_t size, size_t count ) override { return 0; }
+
+    aiReturn Seek( size_t offset, aiOrigin origin ) override
+    {
+        u64 target;
+        switch ( origin )
+        {
+            case aiOrigin_SET: target = offset; break;
+            case aiOrigin_CUR: target = position + offset; break;
+            case aiOrigin_END: target = file.size - offset; break;
+            default: return aiReturn_FAILURE;
+        }
+
+        if ( target > file.size ) { return aiReturn_FAILURE; }
+        position = target;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override { return ( size_t ) position; }
+    size_t FileSize() const override { return ( size_t ) file.size; }
+    void Flush() override {}
+};
+
+//@NOTE: Read only, the importers never write. One per importer, so the stats need no locking.
+struct Asset_IO_System : Assimp::IOSystem
+{
+    std::vector< Asset_IO_File_Stats > stats;
+
+    bool Exists( const char *path ) const override
+    {
+        File_Stamp stamp;
+        return GetAssetStamp( ( char * ) path, &stamp );
+    }
+
+    char getOsSeparator() const override { return '/'; }
+
+    Assimp::IOStream *Open( const char *path, const char *mode ) override
+    {
+        if ( strchr( mode, 'w' ) || strchr( mode, 'a' ) ) { return 0; }
+
+        Asset_File file;
+        if ( !OpenRecordedAssetFile( ( char * ) path, &file, &stats ) ) { return 0; }
+        return new Asset_IO_Stream( file, this, ( int ) stats.size() - 1 );
+    }
+
+    void Close( Assimp::IOStream *stream ) override { delete stream; }
+};
+
+inline size_t Asset_IO_Stream::Read( void *buffer, size_t size, size_t count )
+{
+    if ( size == 0 ) { return 0; }
+
+    u64 available = ( file.size - position ) / size;
+    if ( count > available ) { count = ( size_t ) available; }
+
+    u64 start = GetPerformanceCounter();
+    memcpy( buffer, file.memory + position, size * count );
+    position += size * count;
+
+    Asset_IO_File_Stats *fileStats = &system->stats[ statsIndex ];
+    fileStats->readSeconds += GetSecondsElapsed( start, GetPerformanceCounter() );
+    fileStats->bytesRead += size * count;
+    ++fileStats->readsCount;
+    return count;
+}
+
+// Prints the files touched since the last report as one block, imports on other threads don't interleave
+internal void ReportAssetIO( std::vector< Asset_IO_File_Stats > *stats, char *modelPath )
+{
+    char report[ 2048 ];
+    int length = snprintf( report, sizeof( report ), "I/O for %s:\n", modelPath );
+
+    u64 totalBytes = 0;
+    float64 totalSeconds = 0.0;
+    for ( Asset_IO_File_Stats &fileStats : *stats )
+    {
+        if ( length < ( int ) sizeof( report ) )
+        {
+            length += snprintf( report + length, sizeof( report ) - length,
+                                "    %s: %llu of %llu bytes in %u reads, open %.3f ms, read %.3f ms\n", fileStats.path,
+                                ( unsigned long long ) fileStats.bytesRead, ( unsigned long long ) fileStats.size,
+                                fileStats.readsCount, fileStats.openSeconds * 1000.0, fileStats.readSeconds * 1000.0 );
+        }
+        totalBytes += fileStats.bytesRead;
+        totalSeconds += fileStats.openSeconds + fileStats.readSeconds;
+    }
+
+    if ( length < ( int ) sizeof( report ) )
+    {
+        snprintf( report + length, sizeof( report ) - length, "    total: %llu bytes, %.3f ms\n",
+                  ( unsigned long long ) totalBytes, totalSeconds * 1000.0 );
+    }
+    printf( "%s", report );
+    stats->clear();
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <glm.hpp>
+#include <math.h>
+#include "utils/utils.h"
+#include "jobs.h"
+#include "random.h"
+#include "instance_transform.h"
+#include "orbit.h"
+
+// Asteroid belt generation, spread over the job queue. Every asteroid draws from its own random stream, so a seed
+// gives the same belt for any thread count and batch split.
+
+#define ASTEROID_FIELD_BATCH_SIZE 4096
+
+struct Asteroid_Field_Settings
+{
+    u64 seed;
+
+    //@NOTE: Asteroids are spread evenly around a ring of radius, then displaced by up to offset on every axis,
+    // less along y to keep the belt flat
+    float32 radius;
+    float32 offset;
+    float32 minScale;
+    float32 maxScale;
+
+    //@NOTE: For the orbits, radians per second at radius 1, falling off with radius^1.5 like a real belt
+    float32 orbitSpeed;
+    float32 maxInclination;
+};
+
+struct Generate_Asteroid_Field_Job
+{
+    Asteroid_Field_Settings settings;
+    Instance_Transform *instances;
+    Orbit_Instance *orbits;
+    int count;
+};
+
+internal void GenerateAsteroidFieldJob( void *data, int start, int end )
+{
+    Generate_Asteroid_Field_Job *job = ( Generate_Asteroid_Field_Job * ) data;
+    Asteroid_Field_Settings *settings = &job->settings;
+    glm::vec3 spinAxis = glm::normalize( glm::vec3( 0.4f, 0.6f, 0.8f ) );
+
+    for ( int i = start; i < end; ++i )
+    {
+        Random_Stream random = GetRandomStream( settings->seed, ( u64 ) i );
+        float32 angle = glm::radians( 360.0f * ( float32 ) i / ( float32 ) job->count );
+        float32 scale = NextRandomRange( &random, settings->minScale, settings->maxScale );
+        float32 spin = NextRandomRange( &random, 0.0f, glm::radians( 360.0f ) );
+
+        //@NOTE: Drawn whether or not the instances are wanted, so the orbits don't depend on it
+        glm::vec3 displacement( NextRandomRange( &random, -settings->offset, settings->offset ),
+                                NextRandomRange( &random, -settings->offset, settings->offset ) * 0.4f,
+                                NextRandomRange( &random, -settings->offset, settings->offset ) );
+        glm::vec3 position = glm::vec3( sinf( angle ), 0.0f, cosf( angle ) ) * settings->radius + displacement;
+
+        if ( job->instances )
+        {
+            Instance_Transform *instance = &job->instances[ i ];
+            instance->position = position;
+            instance->scale = scale;
+            instance->rotation = glm::vec4( spinAxis * sinf( spin * 0.5f ), cosf( spin * 0.5f ) );
+        }
+
+        if ( job->orbits )
+        {
+            //@NOTE: Every orbit starts at its ascending node, with the radius, height and node solved so that
+            // GetOrbitInstanceTransform at time 0 lands on the static position. The height tilts with the orbit plane,
+            // its sideways part is taken out of the radius.
+            Orbit_Instance *orbit = &job->orbits[ i ];
+            orbit->inclination = NextRandomRange( &random, -settings->maxInclination, settings->maxInclination );
+            orbit->height = position.y / cosf( orbit->inclination );
+            float32 side = orbit->height * sinf( orbit->inclination );
+            orbit->radius = sqrtf( glm::max( position.x * position.x + position.z * position.z - side * side, 0.0f ) );
+            orbit->phase = 0.0f;
+            orbit->ascendingNode = atan2f( side, orbit->radius ) - atan2f( position.z, position.x );
+            orbit->angularVelocity = settings->orbitSpeed / ( orbit->radius * sqrtf( orbit->radius ) );
+            orbit->scale = scale;
+            orbit->spinVelocity = NextRandomRange( &random, -1.0f, 1.0f );
+            orbit->spinAxis = spinAxis;
+            orbit->spinPhase = spin;
+        }
+    }
+}
+
+// Fills either array when it isn't 0, both have to hold count asteroids. Orbit i at time 0 is instance i, so
+// switching between them doesn't move the belt.
+internal void GenerateAsteroidField( Asteroid_Field_Settings settings, Instance_Transform *instances, Orbit_Instance *orbits, int count, Job_Queue *queue )
+{
+    Generate_Asteroid_Field_Job job = { settings, instances, orbits, count };
+    ParallelFor( queue, count, ASTEROID_FIELD_BATCH_SIZE, GenerateAsteroidFieldJob, &job );
+}
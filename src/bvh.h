@@ -0,0 +1,598 @@
+#pragma once
+#include <glm.hpp>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils/utils.h"
+#include "jobs.h"
+#include "frustum.h"
+
+// Bounding volume hierarchy over world space boxes, instances and meshes alike, for culling and picking queries.
+// Nodes are split with a binned surface area heuristic. The top of the tree is split on the calling thread until
+// there are enough subtrees to go around, those are built on the job queue and appended in order, so the result
+// doesn't depend on the thread count. Children always come after their parent and siblings are next to each
+// other, so refitting after items moved is a single backwards pass over the node array.
+
+#define BVH_BINS          16
+#define BVH_MAX_LEAF_SIZE 4
+#define BVH_MAX_DEPTH     48
+#define BVH_STACK_SIZE    ( BVH_MAX_DEPTH + 2 )
+
+//@NOTE: Subtrees smaller than this are never split further on the calling thread
+#define BVH_PARALLEL_MIN_ITEMS 1024
+
+struct Bvh_Node
+{
+    glm::vec3 min;
+    u32 first; // leaf: first entry in Bvh::items, inner: index of the left child, the right one follows it
+    glm::vec3 max;
+    u32 count; // items in the leaf, 0 for inner nodes
+};
+
+struct Bvh
+{
+    Bvh_Node *nodes;
+    int nodesCount;
+
+    //@NOTE: Bounds of every item, write the new ones and call RefitBvh after items moved
+    glm::vec3 *itemsMin;
+    glm::vec3 *itemsMax;
+    int itemsCount;
+
+    //@NOTE: Item indices in leaf order, every node covers a contiguous range of them
+    u32 *items;
+};
+
+struct Bvh_Node_Array
+{
+    Bvh_Node *nodes;
+    int count;
+    int capacity;
+};
+
+inline float32 GetBoxArea( glm::vec3 boxMin, glm::vec3 boxMax )
+{
+    glm::vec3 size = boxMax - boxMin;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+//@NOTE: Distance from the point to the box, 0 inside
+inline float32 GetBoxDistance( glm::vec3 point, glm::vec3 boxMin, glm::vec3 boxMax )
+{
+    glm::vec3 outside = glm::max( glm::max( boxMin - point, point - boxMax ), glm::vec3( 0.0f ) );
+    return glm::length( outside );
+}
+
+inline bool DoBoxesOverlap( glm::vec3 aMin, glm::vec3 aMax, glm::vec3 bMin, glm::vec3 bMax )
+{
+    return aMin.x <= bMax.x && aMin.y <= bMax.y && aMin.z <= bMax.z && bMin.x <= aMax.x && bMin.y <= aMax.y && bMin.z <= aMax.z;
+}
+
+// Slab test, false when the box is missed or further than maxDistance
+inline bool IntersectRayBox( glm::vec3 origin, glm::vec3 inverseDirection, glm::vec3 boxMin, glm::vec3 boxMax, float32 maxDistance, float32 *distance )
+{
+    glm::vec3 t0 = ( boxMin - origin ) * inverseDirection;
+    glm::vec3 t1 = ( boxMax - origin ) * inverseDirection;
+    glm::vec3 nearT = glm::min( t0, t1 );
+    glm::vec3 farT = glm::max( t0, t1 );
+    float32 enter = glm::max( glm::max( nearT.x, nearT.y ), glm::max( nearT.z, 0.0f ) );
+    float32 exit = glm::min( glm::min( farT.x, farT.y ), glm::min( farT.z, maxDistance ) );
+    *distance = enter;
+    return enter <= exit;
+}
+
+internal void SetBvhNodeBounds( Bvh *bvh, Bvh_Node *node )
+{
+    node->min = glm::vec3( FLT_MAX );
+    node->max = glm::vec3( -FLT_MAX );
+    for ( u32 i = node->first; i < node->first + node->count; ++i )
+    {
+        node->min = glm::min( node->min, bvh->itemsMin[ bvh->items[ i ] ] );
+        node->max = glm::max( node->max, bvh->itemsMax[ bvh->items[ i ] ] );
+    }
+}
+
+internal u32 AddBvhNodes( Bvh_Node_Array *array, int count )
+{
+    if ( array->count + count > array->capacity )
+    {
+        array->capacity = array->capacity ? array->capacity * 2 : 64;
+        if ( array->capacity < array->count + count ) { array->capacity = array->count + count; }
+        array->nodes = ( Bvh_Node * ) realloc( array->nodes, array->capacity * sizeof( Bvh_Node ) );
+    }
+    u32 result = ( u32 ) array->count;
+    array->count += count;
+    return result;
+}
+
+inline int GetBvhBin( float32 center, float32 binsMin, float32 binScale )
+{
+    int result = ( int ) ( ( center - binsMin ) * binScale );
+    return result < BVH_BINS - 1 ? result : BVH_BINS - 1;
+}
+
+// Splits the leaf at index into two new leaves at the end of the array. False when it's cheaper or only possible
+// to keep it as it is.
+internal bool SplitBvhNode( Bvh *bvh, glm::vec3 *centers, Bvh_Node_Array *array, u32 index, int depth )
+{
+    Bvh_Node node = array->nodes[ index ];
+    if ( node.count <= 1 || depth >= BVH_MAX_DEPTH ) { return false; }
+
+    glm::vec3 centersMin( FLT_MAX );
+    glm::vec3 centersMax( -FLT_MAX );
+    for ( u32 i = node.first; i < node.first + node.count; ++i )
+    {
+        centersMin = glm::min( centersMin, centers[ bvh->items[ i ] ] );
+        centersMax = glm::max( centersMax, centers[ bvh->items[ i ] ] );
+    }
+
+    float32 bestCost = FLT_MAX;
+    int bestAxis = -1;
+    int bestBin = 0;
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        float32 extent = centersMax[ axis ] - centersMin[ axis ];
+        if ( extent <= 0.0f ) { continue; }
+        float32 binScale = BVH_BINS / extent;
+
+        int counts[ BVH_BINS ] = {};
+        glm::vec3 binsMin[ BVH_BINS ];
+        glm::vec3 binsMax[ BVH_BINS ];
+        for ( int i = 0; i < BVH_BINS; ++i )
+        {
+            binsMin[ i ] = glm::vec3( FLT_MAX );
+            binsMax[ i ] = glm::vec3( -FLT_MAX );
+        }
+        for ( u32 i = node.first; i < node.first + node.count; ++i )
+        {
+            u32 item = bvh->items[ i ];
+            int bin = GetBvhBin( centers[ item ][ axis ], centersMin[ axis ], binScale );
+            ++counts[ bin ];
+            binsMin[ bin ] = glm::min( binsMin[ bin ], bvh->itemsMin[ item ] );
+            binsMax[ bin ] = glm::max( binsMax[ bin ], bvh->itemsMax[ item ] );
+        }
+
+        //@NOTE: Cost of splitting after bin i, the right side swept first
+        float32 rightCosts[ BVH_BINS ];
+        glm::vec3 sideMin( FLT_MAX );
+        glm::vec3 sideMax( -FLT_MAX );
+        int sideCount = 0;
+        for ( int i = BVH_BINS - 1; i > 0; --i )
+        {
+            sideMin = glm::min( sideMin, binsMin[ i ] );
+            sideMax = glm::max( sideMax, binsMax[ i ] );
+            sideCount += counts[ i ];
+            rightCosts[ i - 1 ] = sideCount ? sideCount * GetBoxArea( sideMin, sideMax ) : -1.0f;
+        }
+
+        sideMin = glm::vec3( FLT_MAX );
+        sideMax = glm::vec3( -FLT_MAX );
+        sideCount = 0;
+        for ( int i = 0; i < BVH_BINS - 1; ++i )
+        {
+            sideMin = glm::min( sideMin, binsMin[ i ] );
+            sideMax = glm::max( sideMax, binsMax[ i ] );
+            sideCount += counts[ i ];
+            if ( !sideCount || rightCosts[ i ] < 0.0f ) { continue; }
+
+            float32 cost = sideCount * GetBoxArea( sideMin, sideMax ) + rightCosts[ i ];
+            if ( cost < bestCost )
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = i;
+            }
+        }
+    }
+
+    //@NOTE: Every center in the same spot, no plane separates them
+    if ( bestAxis < 0 ) { return false; }
+
+    //@NOTE: Traversing a node costs about as much as testing one item
+    float32 area = GetBoxArea( node.min, node.max );
+    float32 leafCost = ( float32 ) node.count * area;
+    if ( area + bestCost >= leafCost && node.count <= BVH_MAX_LEAF_SIZE ) { return false; }
+
+    float32 binScale = BVH_BINS / ( centersMax[ bestAxis ] - centersMin[ bestAxis ] );
+    u32 left = node.first;
+    u32 right = node.first + node.count;
+    while ( left < right )
+    {
+        if ( GetBvhBin( centers[ bvh->items[ left ] ][ bestAxis ], centersMin[ bestAxis ], binScale ) <= bestBin ) { ++left; }
+        else
+        {
+            u32 swap = bvh->items[ left ];
+            bvh->items[ left ] = bvh->items[ --right ];
+            bvh->items[ right ] = swap;
+        }
+    }
+
+    u32 children = AddBvhNodes( array, 2 );
+    Bvh_Node *leftChild = &array->nodes[ children ];
+    Bvh_Node *rightChild = &array->nodes[ children + 1 ];
+    leftChild->first = node.first;
+    leftChild->count = left - node.first;
+    rightChild->first = left;
+    rightChild->count = node.first + node.count - left;
+    SetBvhNodeBounds( bvh, leftChild );
+    SetBvhNodeBounds( bvh, rightChild );
+
+    array->nodes[ index ].first = children;
+    array->nodes[ index ].count = 0;
+    return true;
+}
+
+struct Bvh_Subtree
+{
+    u32 root;
+    int depth;
+
+    //@NOTE: nodes[ 0 ] is the root, its descendants follow in depth first order
+    Bvh_Node_Array array;
+};
+
+struct Build_Bvh_Job
+{
+    Bvh *bvh;
+    glm::vec3 *centers;
+    Bvh_Subtree *subtrees;
+};
+
+internal void BuildBvhSubtreesJob( void *data, int start, int end )
+{
+    Build_Bvh_Job *job = ( Build_Bvh_Job * ) data;
+    for ( int i = start; i < end; ++i )
+    {
+        Bvh_Subtree *subtree = &job->subtrees[ i ];
+        subtree->array.nodes[ 0 ] = job->bvh->nodes[ subtree->root ];
+
+        u32 stack[ BVH_STACK_SIZE ];
+        int depths[ BVH_STACK_SIZE ];
+        int stackCount = 0;
+        stack[ stackCount ] = 0;
+        depths[ stackCount++ ] = subtree->depth;
+        while ( stackCount )
+        {
+            u32 index = stack[ --stackCount ];
+            int depth = depths[ stackCount ];
+            if ( !SplitBvhNode( job->bvh, job->centers, &subtree->array, index, depth ) ) { continue; }
+
+            //@NOTE: Left on top, so its whole subtree is laid out before the right one
+            u32 left = subtree->array.nodes[ index ].first;
+            stack[ stackCount ] = left + 1;
+            depths[ stackCount++ ] = depth + 1;
+            stack[ stackCount ] = left;
+            depths[ stackCount++ ] = depth + 1;
+        }
+    }
+}
+
+// The bounds are copied, item i of the queries is the box itemsMin[ i ] to itemsMax[ i ]
+internal Bvh BuildBvh( glm::vec3 *itemsMin, glm::vec3 *itemsMax, int itemsCount, Job_Queue *queue = 0 )
+{
+    Bvh result = {};
+    if ( itemsCount <= 0 ) { return result; }
+
+    result.itemsCount = itemsCount;
+    result.itemsMin = ( glm::vec3 * ) malloc( itemsCount * sizeof( glm::vec3 ) );
+    result.itemsMax = ( glm::vec3 * ) malloc( itemsCount * sizeof( glm::vec3 ) );
+    result.items = ( u32 * ) malloc( itemsCount * sizeof( u32 ) );
+    memcpy( result.itemsMin, itemsMin, itemsCount * sizeof( glm::vec3 ) );
+    memcpy( result.itemsMax, itemsMax, itemsCount * sizeof( glm::vec3 ) );
+
+    glm::vec3 *centers = ( glm::vec3 * ) malloc( itemsCount * sizeof( glm::vec3 ) );
+    defer { free( centers ); };
+    for ( int i = 0; i < itemsCount; ++i )
+    {
+        centers[ i ] = ( itemsMin[ i ] + itemsMax[ i ] ) * 0.5f;
+        result.items[ i ] = ( u32 ) i;
+    }
+
+    //@NOTE: A binary tree with at least one item per leaf never needs more
+    Bvh_Node_Array top = {};
+    top.capacity = 2 * itemsCount - 1;
+    top.nodes = ( Bvh_Node * ) malloc( top.capacity * sizeof( Bvh_Node ) );
+    u32 root = AddBvhNodes( &top, 1 );
+    top.nodes[ root ].first = 0;
+    top.nodes[ root ].count = ( u32 ) itemsCount;
+    SetBvhNodeBounds( &result, &top.nodes[ root ] );
+
+    //@NOTE: Breadth first, so the subtrees handed to the workers are about the same size
+    int targetSubtrees = queue ? GetJobQueueThreadCount( queue ) * 4 : 1;
+    Bvh_Subtree *subtrees = ( Bvh_Subtree * ) malloc( itemsCount * sizeof( Bvh_Subtree ) );
+    defer { free( subtrees ); };
+    int subtreesCount = 0;
+
+    u32 *pending = ( u32 * ) malloc( itemsCount * sizeof( u32 ) );
+    int *pendingDepths = ( int * ) malloc( itemsCount * sizeof( int ) );
+    defer { free( pending ); };
+    defer { free( pendingDepths ); };
+    int pendingFirst = 0;
+    int pendingCount = 0;
+    pending[ pendingCount ] = root;
+    pendingDepths[ pendingCount++ ] = 0;
+
+    while ( pendingFirst < pendingCount )
+    {
+        u32 index = pending[ pendingFirst ];
+        int depth = pendingDepths[ pendingFirst++ ];
+        bool enough = subtreesCount + ( pendingCount - pendingFirst ) + 1 >= targetSubtrees;
+        if ( enough || top.nodes[ index ].count < BVH_PARALLEL_MIN_ITEMS )
+        {
+            subtrees[ subtreesCount ].root = index;
+            subtrees[ subtreesCount++ ].depth = depth;
+            continue;
+        }
+
+        if ( SplitBvhNode( &result, centers, &top, index, depth ) )
+        {
+            for ( int i = 0; i < 2; ++i )
+            {
+                pending[ pendingCount ] = top.nodes[ index ].first + i;
+                pendingDepths[ pendingCount++ ] = depth + 1;
+            }
+        }
+    }
+
+    result.nodes = top.nodes;
+    for ( int i = 0; i < subtreesCount; ++i )
+    {
+        subtrees[ i ].array = {};
+        AddBvhNodes( &subtrees[ i ].array, 1 );
+    }
+
+    Build_Bvh_Job job = { &result, centers, subtrees };
+    ParallelFor( queue, subtreesCount, 1, BuildBvhSubtreesJob, &job );
+
+    //@NOTE: Local child indices start after the local root, which goes back to its slot in the top nodes
+    for ( int i = 0; i < subtreesCount; ++i )
+    {
+        Bvh_Subtree *subtree = &subtrees[ i ];
+        u32 offset = ( u32 ) top.count - 1;
+        for ( int j = 0; j < subtree->array.count; ++j )
+        {
+            Bvh_Node node = subtree->array.nodes[ j ];
+            if ( !node.count ) { node.first += offset; }
+            if ( j ) { top.nodes[ AddBvhNodes( &top, 1 ) ] = node; }
+            else { top.nodes[ subtree->root ] = node; }
+        }
+        free( subtree->array.nodes );
+    }
+
+    result.nodes = top.nodes;
+    result.nodesCount = top.count;
+    return result;
+}
+
+internal void FreeBvh( Bvh *bvh )
+{
+    free( bvh->nodes );
+    free( bvh->itemsMin );
+    free( bvh->itemsMax );
+    free( bvh->items );
+    *bvh = {};
+}
+
+// Recomputes every node from the current item bounds. The tree keeps its shape, so it loses quality as items
+// move away from where they were built and should be rebuilt once queries slow down.
+internal void RefitBvh( Bvh *bvh )
+{
+    for ( int i = bvh->nodesCount - 1; i >= 0; --i )
+    {
+        Bvh_Node *node = &bvh->nodes[ i ];
+        if ( node->count )
+        {
+            SetBvhNodeBounds( bvh, node );
+        }
+        else
+        {
+            node->min = glm::min( bvh->nodes[ node->first ].min, bvh->nodes[ node->first + 1 ].min );
+            node->max = glm::max( bvh->nodes[ node->first ].max, bvh->nodes[ node->first + 1 ].max );
+        }
+    }
+}
+
+//@NOTE: Every item of the subtree, without testing them
+internal int AddBvhSubtreeItems( Bvh *bvh, u32 index, u32 *results, int resultsCount, int capacity )
+{
+    u32 stack[ BVH_STACK_SIZE ];
+    int stackCount = 0;
+    stack[ stackCount++ ] = index;
+    while ( stackCount && resultsCount < capacity )
+    {
+        Bvh_Node *node = &bvh->nodes[ stack[ --stackCount ] ];
+        if ( node->count )
+        {
+            for ( u32 i = node->first; i < node->first + node->count && resultsCount < capacity; ++i ) { results[ resultsCount++ ] = bvh->items[ i ]; }
+        }
+        else
+        {
+            stack[ stackCount++ ] = node->first + 1;
+            stack[ stackCount++ ] = node->first;
+        }
+    }
+    return resultsCount;
+}
+
+// Items whose bounds touch the frustum. Returns how many were written, at most capacity.
+internal int QueryBvhFrustum( Bvh *bvh, Frustum *frustum, u32 *results, int capacity )
+{
+    if ( !bvh->nodesCount ) { return 0; }
+
+    int resultsCount = 0;
+    u32 stack[ BVH_STACK_SIZE ];
+    int stackCount = 0;
+    stack[ stackCount++ ] = 0;
+    while ( stackCount && resultsCount < capacity )
+    {
+        u32 index = stack[ --stackCount ];
+        Bvh_Node *node = &bvh->nodes[ index ];
+
+        //@NOTE: Nearest corner of every plane inside means the whole box is, its items need no more tests
+        bool inside = true;
+        bool outside = false;
+        for ( int i = 0; i < 6 && !outside; ++i )
+        {
+            glm::vec4 plane = frustum->planes[ i ];
+            glm::vec3 furthest( plane.x >= 0.0f ? node->max.x : node->min.x, plane.y >= 0.0f ? node->max.y : node->min.y, plane.z >= 0.0f ? node->max.z : node->min.z );
+            glm::vec3 nearest( plane.x >= 0.0f ? node->min.x : node->max.x, plane.y >= 0.0f ? node->min.y : node->max.y, plane.z >= 0.0f ? node->min.z : node->max.z );
+            outside = glm::dot( glm::vec3( plane ), furthest ) + plane.w < 0.0f;
+            inside = inside && glm::dot( glm::vec3( plane ), nearest ) + plane.w >= 0.0f;
+        }
+        if ( outside ) { continue; }
+
+        if ( inside )
+        {
+            resultsCount = AddBvhSubtreeItems( bvh, index, results, resultsCount, capacity );
+        }
+        else if ( node->count )
+        {
+            for ( u32 i = node->first; i < node->first + node->count && resultsCount < capacity; ++i )
+            {
+                u32 item = bvh->items[ i ];
+                if ( IsBoxInFrustum( frustum, bvh->itemsMin[ item ], bvh->itemsMax[ item ] ) ) { results[ resultsCount++ ] = item; }
+            }
+        }
+        else
+        {
+            stack[ stackCount++ ] = node->first + 1;
+            stack[ stackCount++ ] = node->first;
+        }
+    }
+    return resultsCount;
+}
+
+// Items whose bounds overlap the box. Returns how many were written, at most capacity.
+internal int QueryBvhBox( Bvh *bvh, glm::vec3 boxMin, glm::vec3 boxMax, u32 *results, int capacity )
+{
+    if ( !bvh->nodesCount ) { return 0; }
+
+    int resultsCount = 0;
+    u32 stack[ BVH_STACK_SIZE ];
+    int stackCount = 0;
+    stack[ stackCount++ ] = 0;
+    while ( stackCount && resultsCount < capacity )
+    {
+        Bvh_Node *node = &bvh->nodes[ stack[ --stackCount ] ];
+        if ( !DoBoxesOverlap( node->min, node->max, boxMin, boxMax ) ) { continue; }
+
+        if ( node->count )
+        {
+            for ( u32 i = node->first; i < node->first + node->count && resultsCount < capacity; ++i )
+            {
+                u32 item = bvh->items[ i ];
+                if ( DoBoxesOverlap( bvh->itemsMin[ item ], bvh->itemsMax[ item ], boxMin, boxMax ) ) { results[ resultsCount++ ] = item; }
+            }
+        }
+        else
+        {
+            stack[ stackCount++ ] = node->first + 1;
+            stack[ stackCount++ ] = node->first;
+        }
+    }
+    return resultsCount;
+}
+
+// Closest item whose bounds the ray enters within maxDistance, -1 when there is none. The direction doesn't have
+// to be normalized, distances are in multiples of it.
+internal int RaycastBvh( Bvh *bvh, glm::vec3 origin, glm::vec3 direction, float32 maxDistance, float32 *hitDistance )
+{
+    if ( !bvh->nodesCount ) { return -1; }
+
+    //@NOTE: Zero components become infinities, the slab test handles those
+    glm::vec3 inverseDirection = 1.0f / direction;
+    int result = -1;
+    float32 closest = maxDistance;
+
+    u32 stack[ BVH_STACK_SIZE ];
+    int stackCount = 0;
+    float32 distance;
+    if ( !IntersectRayBox( origin, inverseDirection, bvh->nodes[ 0 ].min, bvh->nodes[ 0 ].max, closest, &distance ) ) { return -1; }
+    stack[ stackCount++ ] = 0;
+
+    while ( stackCount )
+    {
+        Bvh_Node *node = &bvh->nodes[ stack[ --stackCount ] ];
+        if ( !IntersectRayBox( origin, inverseDirection, node->min, node->max, closest, &distance ) ) { continue; }
+
+        if ( node->count )
+        {
+            for ( u32 i = node->first; i < node->first + node->count; ++i )
+            {
+                u32 item = bvh->items[ i ];
+                if ( IntersectRayBox( origin, inverseDirection, bvh->itemsMin[ item ], bvh->itemsMax[ item ], closest, &distance ) && distance < closest )
+                {
+                    closest = distance;
+                    result = ( int ) item;
+                }
+            }
+            continue;
+        }
+
+        //@NOTE: Nearer child on top, so closest shrinks early and prunes the other one
+        float32 leftDistance, rightDistance;
+        Bvh_Node *left = &bvh->nodes[ node->first ];
+        Bvh_Node *right = &bvh->nodes[ node->first + 1 ];
+        bool hitLeft = IntersectRayBox( origin, inverseDirection, left->min, left->max, closest, &leftDistance );
+        bool hitRight = IntersectRayBox( origin, inverseDirection, right->min, right->max, closest, &rightDistance );
+        if ( hitLeft && hitRight )
+        {
+            bool leftFirst = leftDistance <= rightDistance;
+            stack[ stackCount++ ] = leftFirst ? node->first + 1 : node->first;
+            stack[ stackCount++ ] = leftFirst ? node->first : node->first + 1;
+        }
+        else if ( hitLeft ) { stack[ stackCount++ ] = node->first; }
+        else if ( hitRight ) { stack[ stackCount++ ] = node->first + 1; }
+    }
+
+    if ( hitDistance ) { *hitDistance = closest; }
+    return result;
+}
+
+// Up to k items with the bounds closest to the point, nearest first, distances measured to the bounds.
+// Returns how many were found.
+internal int FindBvhNearest( Bvh *bvh, glm::vec3 point, int k, u32 *results, float32 *distances )
+{
+    if ( !bvh->nodesCount || k <= 0 ) { return 0; }
+
+    int resultsCount = 0;
+    u32 stack[ BVH_STACK_SIZE ];
+    int stackCount = 0;
+    stack[ stackCount++ ] = 0;
+    while ( stackCount )
+    {
+        Bvh_Node *node = &bvh->nodes[ stack[ --stackCount ] ];
+        float32 worst = resultsCount == k ? distances[ k - 1 ] : FLT_MAX;
+        if ( GetBoxDistance( point, node->min, node->max ) >= worst ) { continue; }
+
+        if ( node->count )
+        {
+            for ( u32 i = node->first; i < node->first + node->count; ++i )
+            {
+                u32 item = bvh->items[ i ];
+                float32 distance = GetBoxDistance( point, bvh->itemsMin[ item ], bvh->itemsMax[ item ] );
+                if ( resultsCount == k && distance >= distances[ k - 1 ] ) { continue; }
+
+                //@NOTE: Insertion into the sorted results, the furthest drops off when they are full
+                int slot = resultsCount < k ? resultsCount++ : k - 1;
+                while ( slot > 0 && distances[ slot - 1 ] > distance )
+                {
+                    results[ slot ] = results[ slot - 1 ];
+                    distances[ slot ] = distances[ slot - 1 ];
+                    --slot;
+                }
+                results[ slot ] = item;
+                distances[ slot ] = distance;
+            }
+            continue;
+        }
+
+        Bvh_Node *left = &bvh->nodes[ node->first ];
+        Bvh_Node *right = &bvh->nodes[ node->first + 1 ];
+        bool leftFirst = GetBoxDistance( point, left->min, left->max ) <= GetBoxDistance( point, right->min, right->max );
+        stack[ stackCount++ ] = leftFirst ? node->first + 1 : node->first;
+        stack[ stackCount++ ] = leftFirst ? node->first : node->first + 1;
+    }
+    return resultsCount;
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <string.h>
+#include "utils/utils.h"
+
+// Container written by tools/texture_cooker.cpp next to the source image (diffuse.jpg -> diffuse.jpg.ctex).
+// Layout: header | mip table | block compressed mips, largest first. Rows are stored top to bottom like stb
+// decodes them, a vertical flip is done on the blocks at load time when it is requested.
+
+#define COOKED_TEXTURE_MAGIC   0x58455443 // "CTEX"
+#define COOKED_TEXTURE_VERSION 3
+#define COOKED_TEXTURE_MAX_MIPS 16
+
+enum Cooked_Texture_Format
+{
+    COOKED_TEXTURE_BC1, // RGB
+    COOKED_TEXTURE_BC3, // RGBA
+    COOKED_TEXTURE_BC4, // R
+    COOKED_TEXTURE_BC5  // RG
+};
+
+struct Cooked_Texture_Header
+{
+    u32 magic;
+    u32 version;
+
+    //@NOTE: FNV-1a of the source file contents, the cooker skips sources whose hash didn't change
+    u64 sourceHash;
+
+    //@NOTE: Stamp of the source file, see GetAssetStamp. The loader decodes the source instead when it doesn't match,
+    // hashing it would cost as much as decoding it.
+    u64 sourceSize;
+    u64 sourceWriteTime;
+
+    u32 format;
+    u32 componentsCount;
+    u32 width;
+    u32 height;
+    u32 mipsCount;
+    u32 padding;
+};
+
+struct Cooked_Texture_Mip
+{
+    u32 width;
+    u32 height;
+    u64 offset;
+    u64 size;
+};
+
+inline u64 HashBytes( u8 *data, u64 size )
+{
+    u64 hash = 0xcbf29ce484222325ull;
+    for ( u64 i = 0; i < size; ++i )
+    {
+        hash ^= data[ i ];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+inline int GetCookedBlockSize( u32 format )
+{
+    return format == COOKED_TEXTURE_BC1 || format == COOKED_TEXTURE_BC4 ? 8 : 16;
+}
+
+inline u64 GetCookedMipSize( u32 format, u32 width, u32 height )
+{
+    return ( u64 ) ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * GetCookedBlockSize( format );
+}
+
+// Validates the header and mip table against the file size, returns the mip table or 0
+inline Cooked_Texture_Mip *GetCookedTextureMips( u8 *file, u64 fileSize )
+{
+    Cooked_Texture_Header *header = ( Cooked_Texture_Header * ) file;
+    if ( fileSize < sizeof( Cooked_Texture_Header ) ||
+         header->magic != COOKED_TEXTURE_MAGIC ||
+         header->version != COOKED_TEXTURE_VERSION ||
+         header->format > COOKED_TEXTURE_BC5 ||
+         header->mipsCount == 0 || header->mipsCount > COOKED_TEXTURE_MAX_MIPS ||
+         fileSize < sizeof( Cooked_Texture_Header ) + header->mipsCount * sizeof( Cooked_Texture_Mip ) )
+    {
+        return 0;
+    }
+
+    Cooked_Texture_Mip *mips = ( Cooked_Texture_Mip * ) ( file + sizeof( Cooked_Texture_Header ) );
+    for ( u32 i = 0; i < header->mipsCount; ++i )
+    {
+        if ( mips[ i ].offset + mips[ i ].size > fileSize ) { return 0; }
+    }
+    return mips;
+}
+
+// Mirrors the pixel rows of a BC4 block (a BC3 alpha block, half of a BC5 block), 3 bit indices, 12 bits per row
+inline void FlipBC4Block( u8 *block, u32 rows )
+{
+    u64 bits = 0;
+    for ( int i = 0; i < 6; ++i ) { bits |= ( u64 ) block[ 2 + i ] << ( 8 * i ); }
+
+    u64 flipped = 0;
+    for ( u32 row = 0; row < rows; ++row )
+    {
+        u64 rowBits = ( bits >> ( 12 * row ) ) & 0xfff;
+        flipped |= rowBits << ( 12 * ( rows - 1 - row ) );
+    }
+    flipped |= bits & ~( ( 1ull << ( 12 * rows ) ) - 1 );
+
+    for ( int i = 0; i < 6; ++i ) { block[ 2 + i ] = ( u8 ) ( flipped >> ( 8 * i ) ); }
+}
+
+// Mirrors the pixel rows of a BC1 block, 2 bit indices, one byte per row
+inline void FlipBC1Block( u8 *block, u32 rows )
+{
+    u8 *indices = block + 4;
+    for ( u32 row = 0; row < rows / 2; ++row )
+    {
+        u8 temp = indices[ row ];
+        indices[ row ] = indices[ rows - 1 - row ];
+        indices[ rows - 1 - row ] = temp;
+    }
+}
+
+//@NOTE: Block flips are exact only when no block row is partially used
+inline bool CanFlipCookedTexture( Cooked_Texture_Header *header, Cooked_Texture_Mip *mips )
+{
+    for ( u32 i = 0; i < header->mipsCount; ++i )
+    {
+        if ( mips[ i ].height >= 4 && mips[ i ].height % 4 != 0 ) { return false; }
+    }
+    return true;
+}
+
+// Copies one mip level into destination flipped vertically: block rows are reversed and the pixel rows
+// inside every block are mirrored. Levels shorter than 4 pixels only use the first rows of a block.
+inline void FlipCookedMip( u32 format, u32 width, u32 height, u8 *source, u8 *destination )
+{
+    int blockSize = GetCookedBlockSize( format );
+    u32 blocksX = ( width + 3 ) / 4;
+    u32 blocksY = ( height + 3 ) / 4;
+    u32 rows = height < 4 ? height : 4;
+    u64 blockRowSize = ( u64 ) blocksX * blockSize;
+
+    for ( u32 y = 0; y < blocksY; ++y )
+    {
+        u8 *sourceRow = source + y * blockRowSize;
+        u8 *destinationRow = destination + ( blocksY - 1 - y ) * blockRowSize;
+        memcpy( destinationRow, sourceRow, ( size_t ) blockRowSize );
+
+        for ( u32 x = 0; x < blocksX; ++x )
+        {
+            u8 *block = destinationRow + x * blockSize;
+            switch ( format )
+            {
+                case COOKED_TEXTURE_BC1: FlipBC1Block( block, rows ); break;
+                case COOKED_TEXTURE_BC3:
+                    FlipBC4Block( block, rows );
+                    FlipBC1Block( block + 8, rows );
+                    break;
+                case COOKED_TEXTURE_BC4: FlipBC4Block( block, rows ); break;
+                case COOKED_TEXTURE_BC5:
+                    FlipBC4Block( block, rows );
+                    FlipBC4Block( block + 8, rows );
+                    break;
+            }
+        }
+    }
+}
@@ -0,0 +1,196 @@
+#pragma once
+#include <glad/glad.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils/utils.h"
+#include "instance_transform.h"
+
+// Instance buffer rewritten every frame without stalling. It holds DYNAMIC_INSTANCE_REGIONS regions of capacity
+// instances and every frame writes the next one, while the GPU may still read the two before it. A fence after the
+// draws of a region guards it until the ring comes back around. With glBufferStorage the whole buffer stays mapped,
+// persistent and coherent, so the job queue can write straight into it with streaming stores. Without it every
+// region is mapped unsynchronized for the frame instead, the fences keep that safe the same way. When mapping fails
+// altogether the region is written to a CPU copy and uploaded with glBufferSubData.
+//
+// The instance attributes always point at the start of the buffer, draws add GetDynamicInstancesBase to their
+// first instance to read the current region.
+
+#define DYNAMIC_INSTANCE_REGIONS 3
+
+//@NOTE: GL 4.4 and ARB_buffer_storage, glad was generated for 4.3 and knows neither
+#ifndef GL_MAP_PERSISTENT_BIT
+    #define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+    #define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+    #define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+typedef void ( APIENTRYP Buffer_Storage_Proc )( GLenum target, GLsizeiptr size, const void *data, GLbitfield flags );
+global_variable Buffer_Storage_Proc glBufferStorageProc;
+
+// Loads glBufferStorage when the context has it, has to run after gladLoadGLLoader
+internal bool LoadBufferStorage( GLADloadproc load )
+{
+    int major, minor;
+    glGetIntegerv( GL_MAJOR_VERSION, &major );
+    glGetIntegerv( GL_MINOR_VERSION, &minor );
+    bool supported = major > 4 || ( major == 4 && minor >= 4 );
+
+    int extensionsCount;
+    glGetIntegerv( GL_NUM_EXTENSIONS, &extensionsCount );
+    for ( int i = 0; i < extensionsCount && !supported; ++i )
+    {
+        supported = strcmp( ( char * ) glGetStringi( GL_EXTENSIONS, i ), "GL_ARB_buffer_storage" ) == 0;
+    }
+
+    glBufferStorageProc = supported ? ( Buffer_Storage_Proc ) load( "glBufferStorage" ) : 0;
+    if ( !glBufferStorageProc )
+    {
+        printf( "glBufferStorage is not supported, dynamic instances are mapped every frame\n" );
+        return false;
+    }
+    return true;
+}
+
+struct Dynamic_Instance_Buffer
+{
+    u32 buffer;
+
+    //@NOTE: Instances per region
+    int capacity;
+
+    //@NOTE: All regions, mapped for the lifetime of the buffer when persistent, else only the written region
+    // between BeginDynamicInstances and EndDynamicInstances
+    Instance_Transform *mapped;
+    bool persistent;
+
+    //@NOTE: One region, written instead when mapping it failed and uploaded by EndDynamicInstances
+    Instance_Transform *staging;
+
+    //@NOTE: Signaled once the GPU is done with the draws that read the region, 0 when it never got any
+    GLsync fences[ DYNAMIC_INSTANCE_REGIONS ];
+    int region;
+
+    //@NOTE: Frames that had to wait for their region, more than a few means the GPU is frames behind
+    int stalls;
+};
+
+internal Dynamic_Instance_Buffer CreateDynamicInstanceBuffer( int capacity )
+{
+    Dynamic_Instance_Buffer result = {};
+    result.capacity = capacity;
+    result.region = DYNAMIC_INSTANCE_REGIONS - 1;
+    GLsizeiptr size = ( GLsizeiptr ) DYNAMIC_INSTANCE_REGIONS * capacity * sizeof( Instance_Transform );
+
+    glGenBuffers( 1, &result.buffer );
+    glBindBuffer( GL_ARRAY_BUFFER, result.buffer );
+    if ( glBufferStorageProc )
+    {
+        //@NOTE: Dynamic storage only for the glBufferSubData fallback
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorageProc( GL_ARRAY_BUFFER, size, 0, flags | GL_DYNAMIC_STORAGE_BIT );
+        result.mapped = ( Instance_Transform * ) glMapBufferRange( GL_ARRAY_BUFFER, 0, size, flags );
+        result.persistent = result.mapped != 0;
+        if ( !result.persistent ) { printf( "Mapping the dynamic instance buffer failed, mapping every frame instead\n" ); }
+    }
+    else
+    {
+        glBufferData( GL_ARRAY_BUFFER, size, 0, GL_STREAM_DRAW );
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    return result;
+}
+
+internal void FreeDynamicInstanceBuffer( Dynamic_Instance_Buffer *buffer )
+{
+    for ( int i = 0; i < DYNAMIC_INSTANCE_REGIONS; ++i )
+    {
+        if ( buffer->fences[ i ] ) { glDeleteSync( buffer->fences[ i ] ); }
+    }
+    if ( buffer->persistent )
+    {
+        glBindBuffer( GL_ARRAY_BUFFER, buffer->buffer );
+        glUnmapBuffer( GL_ARRAY_BUFFER );
+        glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    }
+    glDeleteBuffers( 1, &buffer->buffer );
+    free( buffer->staging );
+    *buffer = {};
+}
+
+// Moves on to the next region, waits until the GPU is done with it and returns it for writing. Any thread may write
+// into it until EndDynamicInstances.
+internal Instance_Transform *BeginDynamicInstances( Dynamic_Instance_Buffer *buffer )
+{
+    buffer->region = ( buffer->region + 1 ) % DYNAMIC_INSTANCE_REGIONS;
+
+    GLsync fence = buffer->fences[ buffer->region ];
+    if ( fence )
+    {
+        //@NOTE: Polled first, triple buffering should almost always find the region free. The waits flush, so the
+        // fence is sure to reach the GPU.
+        GLenum status = glClientWaitSync( fence, 0, 0 );
+        if ( status == GL_TIMEOUT_EXPIRED )
+        {
+            ++buffer->stalls;
+            do
+            {
+                status = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000 );
+            } while ( status == GL_TIMEOUT_EXPIRED );
+        }
+        glDeleteSync( fence );
+        buffer->fences[ buffer->region ] = 0;
+    }
+
+    if ( buffer->persistent ) { return buffer->mapped + buffer->region * buffer->capacity; }
+
+    GLsizeiptr regionSize = ( GLsizeiptr ) buffer->capacity * sizeof( Instance_Transform );
+    glBindBuffer( GL_ARRAY_BUFFER, buffer->buffer );
+    buffer->mapped = ( Instance_Transform * ) glMapBufferRange( GL_ARRAY_BUFFER, buffer->region * regionSize, regionSize,
+                                                                GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    if ( buffer->mapped ) { return buffer->mapped; }
+
+    if ( !buffer->staging )
+    {
+        printf( "Mapping a dynamic instance region failed, uploading with glBufferSubData instead\n" );
+        buffer->staging = ( Instance_Transform * ) malloc( ( size_t ) regionSize );
+    }
+    return buffer->staging;
+}
+
+// Every write has to be done, the region can be drawn from afterwards
+internal void EndDynamicInstances( Dynamic_Instance_Buffer *buffer )
+{
+    if ( buffer->persistent ) { return; }
+
+    glBindBuffer( GL_ARRAY_BUFFER, buffer->buffer );
+    if ( buffer->mapped )
+    {
+        glUnmapBuffer( GL_ARRAY_BUFFER );
+    }
+    else
+    {
+        //@NOTE: The whole region, the buffer doesn't know how many instances were written
+        GLsizeiptr regionSize = ( GLsizeiptr ) buffer->capacity * sizeof( Instance_Transform );
+        glBufferSubData( GL_ARRAY_BUFFER, buffer->region * regionSize, regionSize, buffer->staging );
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    buffer->mapped = 0;
+}
+
+//@NOTE: First instance of the current region, for the baseInstance of its draws
+inline int GetDynamicInstancesBase( Dynamic_Instance_Buffer *buffer )
+{
+    return buffer->region * buffer->capacity;
+}
+
+// After the last draw that reads the current region
+internal void FenceDynamicInstances( Dynamic_Instance_Buffer *buffer )
+{
+    buffer->fences[ buffer->region ] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
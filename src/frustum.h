@@ -0,0 +1,76 @@
+#pragma once
+#include <glm.hpp>
+#include "utils/utils.h"
+
+// World space view frustum, planes point inwards: a point p is inside when dot( plane.xyz, p ) + plane.w >= 0 for all six
+struct Frustum
+{
+    glm::vec4 planes[ 6 ];
+};
+
+// Gribb/Hartmann plane extraction from the rows of projection * view, planes are normalized so distances are in world units
+internal Frustum GetFrustum( glm::mat4 viewProjection )
+{
+    glm::vec4 row0( viewProjection[ 0 ][ 0 ], viewProjection[ 1 ][ 0 ], viewProjection[ 2 ][ 0 ], viewProjection[ 3 ][ 0 ] );
+    glm::vec4 row1( viewProjection[ 0 ][ 1 ], viewProjection[ 1 ][ 1 ], viewProjection[ 2 ][ 1 ], viewProjection[ 3 ][ 1 ] );
+    glm::vec4 row2( viewProjection[ 0 ][ 2 ], viewProjection[ 1 ][ 2 ], viewProjection[ 2 ][ 2 ], viewProjection[ 3 ][ 2 ] );
+    glm::vec4 row3( viewProjection[ 0 ][ 3 ], viewProjection[ 1 ][ 3 ], viewProjection[ 2 ][ 3 ], viewProjection[ 3 ][ 3 ] );
+
+    Frustum result;
+    result.planes[ 0 ] = row3 + row0; // left
+    result.planes[ 1 ] = row3 - row0; // right
+    result.planes[ 2 ] = row3 + row1; // bottom
+    result.planes[ 3 ] = row3 - row1; // top
+    result.planes[ 4 ] = row3 + row2; // near
+    result.planes[ 5 ] = row3 - row2; // far
+
+    for ( int i = 0; i < 6; ++i )
+    {
+        result.planes[ i ] /= glm::length( glm::vec3( result.planes[ i ] ) );
+    }
+    return result;
+}
+
+inline bool IsSphereInFrustum( Frustum *frustum, glm::vec3 center, float32 radius )
+{
+    for ( int i = 0; i < 6; ++i )
+    {
+        if ( glm::dot( glm::vec3( frustum->planes[ i ] ), center ) + frustum->planes[ i ].w < -radius ) { return false; }
+    }
+    return true;
+}
+
+// Largest axis scale of the transform, to bring object space radii to world space
+inline float32 GetMaxScale( glm::mat4 transform )
+{
+    float32 x = glm::length( glm::vec3( transform[ 0 ] ) );
+    float32 y = glm::length( glm::vec3( transform[ 1 ] ) );
+    float32 z = glm::length( glm::vec3( transform[ 2 ] ) );
+    return glm::max( x, glm::max( y, z ) );
+}
+
+// Only the corner furthest along each plane normal has to be inside
+inline bool IsBoxInFrustum( Frustum *frustum, glm::vec3 boxMin, glm::vec3 boxMax )
+{
+    for ( int i = 0; i < 6; ++i )
+    {
+        glm::vec4 plane = frustum->planes[ i ];
+        glm::vec3 corner( plane.x >= 0.0f ? boxMax.x : boxMin.x, plane.y >= 0.0f ? boxMax.y : boxMin.y, plane.z >= 0.0f ? boxMax.z : boxMin.z );
+        if ( glm::dot( glm::vec3( plane ), corner ) + plane.w < 0.0f ) { return false; }
+    }
+    return true;
+}
+
+// Box around the transformed box, the extents go through the absolute of the upper 3x3 (Arvo)
+inline void TransformBox( glm::mat4 transform, glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3 *resultMin, glm::vec3 *resultMax )
+{
+    glm::vec3 center = glm::vec3( transform * glm::vec4( ( boxMin + boxMax ) * 0.5f, 1.0f ) );
+    glm::vec3 extent = ( boxMax - boxMin ) * 0.5f;
+    glm::vec3 resultExtent( 0.0f );
+    for ( int i = 0; i < 3; ++i )
+    {
+        resultExtent += glm::abs( glm::vec3( transform[ i ] ) ) * extent[ i ];
+    }
+    *resultMin = center - resultExtent;
+    *resultMax = center + resultExtent;
+}
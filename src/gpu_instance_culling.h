@@ -0,0 +1,183 @@
+#pragma once
+#include <glm.hpp>
+#include <gtc/type_ptr.hpp>
+#include <glad/glad.h>
+#include <stdlib.h>
+#include "utils/utils.h"
+#include "shader.h"
+#include "frustum.h"
+#include "meshlet.h"
+#include "model.h"
+#include "hi_z.h"
+#include "instance_transform.h"
+#include "instance_buffer.h"
+
+// GPU driven culling of instanced models, the alternative to CullInstances. The instance transforms are uploaded once
+// to a static storage buffer. Every frame a compute pass tests them against the frustum and the distance bound, picks
+// the level of detail, and appends the index of every survivor to its level with an atomic add on the instanceCount
+// of that level's draw command. The commands are then drawn with glDrawElementsIndirect, so neither the instances
+// nor the counts ever come back to the CPU. Render with instanced_indirect.vert, which reads the transform of the
+// instance index it gets at location 7.
+//
+// Occlusion culling takes two phases a frame. The early phase draws what was visible last frame, the Hi-Z pyramid is
+// built from that depth, and the late phase tests every instance against it. Only instances that turned visible are
+// drawn late, so nothing pops in a frame late, and the late results are what the next early phase draws.
+
+#define GPU_INSTANCE_CULLING_GROUP_SIZE 256
+#define GPU_INSTANCE_INDEX_LOCATION     7
+
+struct Gpu_Instance_Culling
+{
+    Shader shader;
+
+    //@NOTE: Instance_Transform per instance, bound to storage binding 0 for the compute pass and the vertex shader
+    u32 instanceBuffer;
+    int instancesCount;
+
+    //@NOTE: u32 instance indices, level l owns instancesCount entries starting at l * instancesCount
+    u32 indexBuffer;
+
+    //@NOTE: Draw_Elements_Indirect_Command per mesh and level, mesh * lodsCount + level. The template holds
+    // the same commands with zero instances and is copied over the commands before every cull.
+    u32 commandBuffer;
+    u32 templateBuffer;
+
+    //@NOTE: u32 per instance, 1 when it passed the last late phase
+    u32 visibilityBuffer;
+
+    //@NOTE: Object space bounding sphere of the model
+    glm::vec3 center;
+    float32 radius;
+
+    int lodsCount;
+};
+
+// The instances are copied to the GPU and can be freed. Adds the instance index attribute to the mesh VAOs.
+internal Gpu_Instance_Culling CreateGpuInstanceCulling( Model *model, Instance_Transform *instances, int count )
+{
+    Gpu_Instance_Culling result = {};
+    result.shader = CreateComputeShader( "../src/shaders/instance_cull.comp" );
+    result.instancesCount = count;
+    result.lodsCount = model->lodsCount > 0 ? model->lodsCount : 1;
+    GetModelBoundingSphere( *model, &result.center, &result.radius );
+
+    glGenBuffers( 1, &result.instanceBuffer );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, result.instanceBuffer );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, count * sizeof( Instance_Transform ), instances, GL_STATIC_DRAW );
+
+    glGenBuffers( 1, &result.indexBuffer );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, result.indexBuffer );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, result.lodsCount * count * sizeof( u32 ), 0, GL_DYNAMIC_COPY );
+
+    glGenBuffers( 1, &result.visibilityBuffer );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, result.visibilityBuffer );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, count * sizeof( u32 ), 0, GL_DYNAMIC_COPY );
+    glClearBufferData( GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, 0 );
+
+    int commandsCount = model->meshesCount * result.lodsCount;
+    Draw_Elements_Indirect_Command *commands = ( Draw_Elements_Indirect_Command * ) calloc( commandsCount, sizeof( Draw_Elements_Indirect_Command ) );
+    defer { free( commands ); };
+    for ( int i = 0; i < model->meshesCount; ++i )
+    {
+        Mesh mesh = model->meshes[ i ];
+        for ( int level = 0; level < result.lodsCount; ++level )
+        {
+            //@NOTE: Meshes with fewer levels than the model draw their coarsest one
+            int meshLevel = level < mesh.lodsCount ? level : mesh.lodsCount - 1;
+            u32 indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof( u16 ) : sizeof( u32 );
+            Draw_Elements_Indirect_Command *command = &commands[ i * result.lodsCount + level ];
+            command->count = mesh.lods[ meshLevel ].indexCount;
+            command->firstIndex = ( u32 ) ( ( u64 ) GetMeshLodOffset( mesh, meshLevel ) / indexSize );
+            command->baseInstance = ( u32 ) ( level * count );
+        }
+    }
+
+    glGenBuffers( 1, &result.templateBuffer );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, result.templateBuffer );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, commandsCount * sizeof( Draw_Elements_Indirect_Command ), commands, GL_STATIC_COPY );
+
+    glGenBuffers( 1, &result.commandBuffer );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, result.commandBuffer );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, commandsCount * sizeof( Draw_Elements_Indirect_Command ), 0, GL_DYNAMIC_COPY );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+    //@NOTE: baseInstance offsets the index attribute into the level's range, the transform attributes at 3 and 4
+    // stay for the CPU path and are not read by instanced_indirect.vert
+    Instance_Layout layout = CreateInstanceLayout( sizeof( u32 ) );
+    AddInstanceIntegerAttribute( &layout, GPU_INSTANCE_INDEX_LOCATION, 1, GL_UNSIGNED_INT, 0 );
+    AttachInstanceAttributes( model, &layout, result.indexBuffer );
+    return result;
+}
+
+internal void FreeGpuInstanceCulling( Gpu_Instance_Culling *culling )
+{
+    glDeleteProgram( culling->shader.id );
+    u32 buffers[] = { culling->instanceBuffer, culling->indexBuffer, culling->commandBuffer, culling->templateBuffer, culling->visibilityBuffer };
+    glDeleteBuffers( 5, buffers );
+    *culling = {};
+}
+
+// Culls on the GPU and draws every level of every mesh with the render shader. A maxDistance of 0 disables the
+// distance bound. The late phase needs the pyramid built from the depth after the early one.
+internal void DrawModelGpuCulled( Gpu_Instance_Culling *culling, Model model, Shader shader, glm::mat4 viewProjection, glm::vec3 cameraPosition,
+                                  float32 projectionScale, float32 pixelError, float32 maxDistance = 0.0f,
+                                  Gpu_Culling_Phase phase = GPU_CULLING_ALL, Hi_Z *hiZ = 0 )
+{
+    Assert( phase != GPU_CULLING_LATE || hiZ );
+
+    if ( !culling->instancesCount ) { return; }
+
+    int commandsCount = model.meshesCount * culling->lodsCount;
+    glBindBuffer( GL_COPY_READ_BUFFER, culling->templateBuffer );
+    glBindBuffer( GL_COPY_WRITE_BUFFER, culling->commandBuffer );
+    glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandsCount * sizeof( Draw_Elements_Indirect_Command ) );
+    glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+    glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+    Frustum frustum = GetFrustum( viewProjection );
+    UseShader( culling->shader );
+    ShaderSetVec4Array( culling->shader, "frustumPlanes", frustum.planes, 6 );
+    ShaderSetVec3( culling->shader, "cameraPosition", cameraPosition );
+    ShaderSetVec3( culling->shader, "sphereCenter", culling->center );
+    ShaderSetFloat32( culling->shader, "sphereRadius", culling->radius );
+    ShaderSetFloat32( culling->shader, "maxDistance", maxDistance );
+    ShaderSetFloat32Array( culling->shader, "lodErrors", model.lodErrors, culling->lodsCount );
+    ShaderSetInt( culling->shader, "lodsCount", culling->lodsCount );
+    ShaderSetFloat32( culling->shader, "lodScale", projectionScale / pixelError );
+    ShaderSetInt( culling->shader, "meshesCount", model.meshesCount );
+    ShaderSetUInt( culling->shader, "instancesCount", ( u32 ) culling->instancesCount );
+    ShaderSetInt( culling->shader, "phase", phase );
+    ShaderSetMat4( culling->shader, "viewProjection", glm::value_ptr( viewProjection ) );
+    ShaderSetInt( culling->shader, "hiZ", HI_Z_TEXTURE_UNIT );
+    if ( hiZ )
+    {
+        glActiveTexture( GL_TEXTURE0 + HI_Z_TEXTURE_UNIT );
+        glBindTexture( GL_TEXTURE_2D, hiZ->texture );
+        glActiveTexture( GL_TEXTURE0 );
+    }
+
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, culling->instanceBuffer );
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, culling->indexBuffer );
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, culling->commandBuffer );
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 3, culling->visibilityBuffer );
+    glDispatchCompute( ( culling->instancesCount + GPU_INSTANCE_CULLING_GROUP_SIZE - 1 ) / GPU_INSTANCE_CULLING_GROUP_SIZE, 1, 1 );
+    glMemoryBarrier( GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT );
+
+    //@NOTE: Binding 0 keeps the transforms for instanced_indirect.vert
+    UseShader( shader );
+    glBindBuffer( GL_DRAW_INDIRECT_BUFFER, culling->commandBuffer );
+    for ( int i = 0; i < model.meshesCount; ++i )
+    {
+        Mesh mesh = model.meshes[ i ];
+        SetMeshVertexFormat( mesh, shader );
+        glBindVertexArray( mesh.vao );
+        for ( int level = 0; level < culling->lodsCount; ++level )
+        {
+            u64 offset = ( i * culling->lodsCount + level ) * sizeof( Draw_Elements_Indirect_Command );
+            glDrawElementsIndirect( GL_TRIANGLES, mesh.indexType, ( void * ) offset );
+        }
+        glBindVertexArray( 0 );
+    }
+    glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+}
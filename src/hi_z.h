@@ -0,0 +1,114 @@
+#pragma once
+#include <glad/glad.h>
+#include <stdio.h>
+#include "utils/utils.h"
+#include "shader.h"
+
+// Hierarchical depth for occlusion culling. The depth of what was drawn so far is copied out of the framebuffer and
+// reduced into a mip chain where every texel holds the furthest depth of the texels it covers. A bounding rectangle
+// is then occluded when its nearest depth lies behind the texels of the level where it covers at most 2x2 of them.
+
+//@NOTE: Used for building and sampling, so the pyramid never replaces the material textures of a draw
+#define HI_Z_TEXTURE_UNIT 7
+
+//@NOTE: The culling passes that sample the pyramid, DrawModelGpuCulled and DrawModelMeshlets, run twice a frame
+enum Gpu_Culling_Phase
+{
+    GPU_CULLING_ALL,   // frustum, distance and cone only
+    GPU_CULLING_EARLY, // what was visible after the last late phase
+    GPU_CULLING_LATE   // everything else that passes the Hi-Z test
+};
+
+struct Hi_Z
+{
+    Shader shader;
+
+    //@NOTE: Blit target, GL_DEPTH24_STENCIL8 to match the default framebuffer
+    u32 depthFramebuffer;
+    u32 depthTexture;
+
+    //@NOTE: GL_R32F, level 0 is half the framebuffer size
+    u32 texture;
+    int width;
+    int height;
+    int levelsCount;
+};
+
+internal Hi_Z CreateHiZ()
+{
+    Hi_Z result = {};
+    result.shader = CreateComputeShader( "../src/shaders/hi_z_downsample.comp" );
+    glGenFramebuffers( 1, &result.depthFramebuffer );
+    return result;
+}
+
+internal void ResizeHiZ( Hi_Z *hiZ, int width, int height )
+{
+    if ( hiZ->depthTexture ) { glDeleteTextures( 1, &hiZ->depthTexture ); }
+    if ( hiZ->texture ) { glDeleteTextures( 1, &hiZ->texture ); }
+
+    glGenTextures( 1, &hiZ->depthTexture );
+    glBindTexture( GL_TEXTURE_2D, hiZ->depthTexture );
+    glTexStorage2D( GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+    glBindFramebuffer( GL_FRAMEBUFFER, hiZ->depthFramebuffer );
+    glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, hiZ->depthTexture, 0 );
+    if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+    {
+        printf( "Creating Hi-Z frame buffer failed!\n" );
+    }
+    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+    hiZ->width = width > 1 ? width / 2 : 1;
+    hiZ->height = height > 1 ? height / 2 : 1;
+    hiZ->levelsCount = 1;
+    for ( int size = hiZ->width > hiZ->height ? hiZ->width : hiZ->height; size > 1; size /= 2 ) { ++hiZ->levelsCount; }
+
+    glGenTextures( 1, &hiZ->texture );
+    glBindTexture( GL_TEXTURE_2D, hiZ->texture );
+    glTexStorage2D( GL_TEXTURE_2D, hiZ->levelsCount, GL_R32F, hiZ->width, hiZ->height );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+}
+
+// Builds the pyramid from the depth of the default framebuffer, recreating it when the size changed
+internal void BuildHiZ( Hi_Z *hiZ, int framebufferWidth, int framebufferHeight )
+{
+    int width = framebufferWidth > 1 ? framebufferWidth / 2 : 1;
+    int height = framebufferHeight > 1 ? framebufferHeight / 2 : 1;
+    if ( !hiZ->texture || width != hiZ->width || height != hiZ->height )
+    {
+        ResizeHiZ( hiZ, framebufferWidth, framebufferHeight );
+    }
+
+    glBindFramebuffer( GL_READ_FRAMEBUFFER, 0 );
+    glBindFramebuffer( GL_DRAW_FRAMEBUFFER, hiZ->depthFramebuffer );
+    glBlitFramebuffer( 0, 0, framebufferWidth, framebufferHeight, 0, 0, framebufferWidth, framebufferHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST );
+    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+    UseShader( hiZ->shader );
+    ShaderSetInt( hiZ->shader, "source", HI_Z_TEXTURE_UNIT );
+    glActiveTexture( GL_TEXTURE0 + HI_Z_TEXTURE_UNIT );
+
+    for ( int level = 0; level < hiZ->levelsCount; ++level )
+    {
+        //@NOTE: Level 0 reduces the depth copy, every other level the one above it
+        glBindTexture( GL_TEXTURE_2D, level ? hiZ->texture : hiZ->depthTexture );
+        ShaderSetInt( hiZ->shader, "sourceLevel", level ? level - 1 : 0 );
+        glBindImageTexture( 0, hiZ->texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F );
+
+        int levelWidth = hiZ->width >> level;
+        int levelHeight = hiZ->height >> level;
+        levelWidth = levelWidth > 1 ? levelWidth : 1;
+        levelHeight = levelHeight > 1 ? levelHeight : 1;
+        glDispatchCompute( ( levelWidth + 7 ) / 8, ( levelHeight + 7 ) / 8, 1 );
+        glMemoryBarrier( GL_TEXTURE_FETCH_BARRIER_BIT );
+    }
+    glBindTexture( GL_TEXTURE_2D, hiZ->texture );
+    glActiveTexture( GL_TEXTURE0 );
+}
@@ -0,0 +1,194 @@
+#pragma once
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+#include <gtc/type_ptr.hpp>
+#include <glad/glad.h>
+#include <math.h>
+#include <stdio.h>
+#include "utils/utils.h"
+#include "shader.h"
+#include "model.h"
+#include "instance_buffer.h"
+
+// Octahedral impostors: the model is rendered once at load from viewsPerSide * viewsPerSide directions spread over
+// the sphere with the octahedral mapping, one texture array layer per direction. Far instances are then drawn as a
+// single quad that picks the layer baked closest to its view direction, with the baked normals lit like the mesh.
+
+#define IMPOSTOR_VIEWS_PER_SIDE 8
+#define IMPOSTOR_RESOLUTION     128
+
+struct Impostor
+{
+    //@NOTE: GL_TEXTURE_2D_ARRAY, layer y * viewsPerSide + x. Albedo alpha is coverage, the normal array holds
+    // object space normals scaled to 0..1 and the specular intensity in alpha.
+    u32 albedoArray;
+    u32 normalArray;
+    int viewsPerSide;
+
+    //@NOTE: Object space bounding sphere, the quads cover it
+    glm::vec3 center;
+    float32 radius;
+
+    //@NOTE: Instance attributes only, the quad corners come from gl_VertexID
+    u32 vao;
+};
+
+//@NOTE: Inverse of EncodeOctahedral in mesh.h, without the snorm16 quantization
+inline glm::vec3 DecodeOctahedral( float32 x, float32 y )
+{
+    glm::vec3 result( x, y, 1.0f - fabsf( x ) - fabsf( y ) );
+    float32 fold = glm::max( -result.z, 0.0f );
+    result.x += result.x >= 0.0f ? -fold : fold;
+    result.y += result.y >= 0.0f ? -fold : fold;
+    return glm::normalize( result );
+}
+
+//@NOTE: Has to match the cell centers in impostor.vert
+inline glm::vec3 GetImpostorViewDirection( int viewsPerSide, int x, int y )
+{
+    return DecodeOctahedral( ( x + 0.5f ) / viewsPerSide * 2.0f - 1.0f, ( y + 0.5f ) / viewsPerSide * 2.0f - 1.0f );
+}
+
+internal u32 CreateImpostorArray( int resolution, int layers )
+{
+    u32 result;
+    glGenTextures( 1, &result );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, result );
+    glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, resolution, resolution, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    return result;
+}
+
+// Renders the model into both arrays, the textures of the model have to be loaded. GL state other than
+// the bound shader and textures is restored. Returns an empty impostor, vao 0, when the arrays can't be rendered to.
+internal Impostor BakeImpostor( Model model, int viewsPerSide = IMPOSTOR_VIEWS_PER_SIDE, int resolution = IMPOSTOR_RESOLUTION )
+{
+    Impostor result = {};
+    result.viewsPerSide = viewsPerSide;
+    GetModelBoundingSphere( model, &result.center, &result.radius );
+
+    int layers = viewsPerSide * viewsPerSide;
+    result.albedoArray = CreateImpostorArray( resolution, layers );
+    result.normalArray = CreateImpostorArray( resolution, layers );
+
+    int previousFramebuffer;
+    int previousViewport[ 4 ];
+    glGetIntegerv( GL_FRAMEBUFFER_BINDING, &previousFramebuffer );
+    glGetIntegerv( GL_VIEWPORT, previousViewport );
+    bool depthTest = glIsEnabled( GL_DEPTH_TEST ) == GL_TRUE;
+    bool cullFace = glIsEnabled( GL_CULL_FACE ) == GL_TRUE;
+
+    u32 depth;
+    glGenRenderbuffers( 1, &depth );
+    glBindRenderbuffer( GL_RENDERBUFFER, depth );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, resolution, resolution );
+    glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+    u32 framebuffer;
+    glGenFramebuffers( 1, &framebuffer );
+    glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth );
+    u32 drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers( 2, drawBuffers );
+
+    //@NOTE: Every layer has the same format and size, if the first one is complete they all are
+    glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, result.albedoArray, 0, 0 );
+    glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, result.normalArray, 0, 0 );
+    if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+    {
+        printf( "Creating impostor frame buffer failed!\n" );
+        glBindFramebuffer( GL_FRAMEBUFFER, previousFramebuffer );
+        glDeleteFramebuffers( 1, &framebuffer );
+        glDeleteRenderbuffers( 1, &depth );
+        glDeleteTextures( 1, &result.albedoArray );
+        glDeleteTextures( 1, &result.normalArray );
+        return {};
+    }
+
+    Shader bakeShader = CreateShader( "../src/shaders/impostor_bake.vert", "../src/shaders/impostor_bake.frag" );
+    UseShader( bakeShader );
+    glm::mat4 identity( 1.0f );
+    ShaderSetMat4( bakeShader, "model", glm::value_ptr( identity ) );
+
+    //@NOTE: The eye sits outside the bounding sphere, the orthographic volume is the sphere's bounding box
+    float32 radius = result.radius > 0.0f ? result.radius : 1.0f;
+    glm::mat4 projection = glm::ortho( -radius, radius, -radius, radius, 0.0f, radius * 4.0f );
+    ShaderSetMat4( bakeShader, "projection", glm::value_ptr( projection ) );
+
+    glViewport( 0, 0, resolution, resolution );
+    glEnable( GL_DEPTH_TEST );
+    glDisable( GL_CULL_FACE );
+    glClearColor( 0.0f, 0.0f, 0.0f, 0.0f );
+
+    for ( int y = 0; y < viewsPerSide; ++y )
+    {
+        for ( int x = 0; x < viewsPerSide; ++x )
+        {
+            int layer = y * viewsPerSide + x;
+            glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, result.albedoArray, 0, layer );
+            glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, result.normalArray, 0, layer );
+            glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+            glm::vec3 direction = GetImpostorViewDirection( viewsPerSide, x, y );
+            glm::vec3 up = fabsf( direction.y ) > 0.99f ? glm::vec3( 0.0f, 0.0f, 1.0f ) : glm::vec3( 0.0f, 1.0f, 0.0f );
+            glm::mat4 view = glm::lookAt( result.center + direction * radius * 2.0f, result.center, up );
+            ShaderSetMat4( bakeShader, "view", glm::value_ptr( view ) );
+            DrawModel( model, bakeShader );
+        }
+    }
+
+    glBindTexture( GL_TEXTURE_2D_ARRAY, result.albedoArray );
+    glGenerateMipmap( GL_TEXTURE_2D_ARRAY );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, result.normalArray );
+    glGenerateMipmap( GL_TEXTURE_2D_ARRAY );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+
+    glDeleteProgram( bakeShader.id );
+    glDeleteFramebuffers( 1, &framebuffer );
+    glDeleteRenderbuffers( 1, &depth );
+
+    glBindFramebuffer( GL_FRAMEBUFFER, previousFramebuffer );
+    glViewport( previousViewport[ 0 ], previousViewport[ 1 ], previousViewport[ 2 ], previousViewport[ 3 ] );
+    if ( !depthTest ) { glDisable( GL_DEPTH_TEST ); }
+    if ( cullFace ) { glEnable( GL_CULL_FACE ); }
+
+    glGenVertexArrays( 1, &result.vao );
+    return result;
+}
+
+// Reads Instance_Transform instances, the same layout as instanced.vert
+internal void SetImpostorInstanceBuffer( Impostor *impostor, u32 instanceBuffer )
+{
+    if ( !impostor->vao ) { return; }
+
+    Instance_Layout layout = GetInstanceTransformLayout();
+    glBindVertexArray( impostor->vao );
+    SetInstanceAttributes( &layout, instanceBuffer );
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+// Draws instances first to first + count of the instance buffer as impostors, shader has to be in use
+internal void DrawImpostors( Impostor *impostor, Shader shader, int first, int count )
+{
+    if ( !count || !impostor->vao ) { return; }
+
+    glActiveTexture( GL_TEXTURE0 );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, impostor->albedoArray );
+    ShaderSetInt( shader, "impostorAlbedo", 0 );
+    glActiveTexture( GL_TEXTURE1 );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, impostor->normalArray );
+    ShaderSetInt( shader, "impostorNormal", 1 );
+    glActiveTexture( GL_TEXTURE0 );
+
+    ShaderSetInt( shader, "viewsPerSide", impostor->viewsPerSide );
+    ShaderSetVec3( shader, "impostorCenter", impostor->center );
+    ShaderSetFloat32( shader, "impostorRadius", impostor->radius );
+
+    glBindVertexArray( impostor->vao );
+    glDrawArraysInstancedBaseInstance( GL_TRIANGLE_STRIP, 0, 4, count, ( u32 ) first );
+    glBindVertexArray( 0 );
+}
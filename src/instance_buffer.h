@@ -0,0 +1,190 @@
+#pragma once
+#include <glm.hpp>
+#include <glad/glad.h>
+#include "utils/utils.h"
+#include "shader.h"
+#include "model.h"
+#include "instance_transform.h"
+
+// Per instance vertex attributes for any model. An Instance_Layout declares where every attribute of an instance
+// lives and which shader location reads it. Attaching a buffer with a layout to a model points the instance
+// attributes of every mesh VAO at that buffer, after which DrawModelInstanced or any other instanced draw of the
+// model reads from it. Instance_Buffer owns such a buffer and grows it as instances are added.
+
+#define INSTANCE_LAYOUT_MAX_ATTRIBUTES 8
+
+//@NOTE: Locations 0 to 2 are the mesh vertex, see Vertex
+#define INSTANCE_FIRST_LOCATION 3
+
+struct Instance_Attribute
+{
+    u32 location;
+    int components; // 1 to 4
+    GLenum type;    // GL_FLOAT, GL_HALF_FLOAT, GL_UNSIGNED_INT, ...
+
+    //@NOTE: Integer types read as floats in [0, 1] or [-1, 1]
+    bool normalized;
+
+    //@NOTE: Read as int or uint in the shader, never converted to float
+    bool integer;
+
+    u32 offset;
+};
+
+struct Instance_Layout
+{
+    Instance_Attribute attributes[ INSTANCE_LAYOUT_MAX_ATTRIBUTES ];
+    int attributesCount;
+    u32 stride;
+};
+
+inline Instance_Layout CreateInstanceLayout( u32 stride )
+{
+    Instance_Layout result = {};
+    result.stride = stride;
+    return result;
+}
+
+inline void AddInstanceAttribute( Instance_Layout *layout, u32 location, int components, GLenum type, u32 offset, bool normalized = false )
+{
+    Assert( layout->attributesCount < INSTANCE_LAYOUT_MAX_ATTRIBUTES );
+    Instance_Attribute *attribute = &layout->attributes[ layout->attributesCount++ ];
+    *attribute = {};
+    attribute->location = location;
+    attribute->components = components;
+    attribute->type = type;
+    attribute->normalized = normalized;
+    attribute->offset = offset;
+}
+
+inline void AddInstanceIntegerAttribute( Instance_Layout *layout, u32 location, int components, GLenum type, u32 offset )
+{
+    AddInstanceAttribute( layout, location, components, type, offset );
+    layout->attributes[ layout->attributesCount - 1 ].integer = true;
+}
+
+//@NOTE: A mat4 attribute takes four locations, one per column
+inline void AddInstanceMatrixAttribute( Instance_Layout *layout, u32 location, u32 offset )
+{
+    for ( u32 i = 0; i < 4; ++i ) { AddInstanceAttribute( layout, location + i, 4, GL_FLOAT, offset + i * ( u32 ) sizeof( glm::vec4 ) ); }
+}
+
+// Instance_Transform, position and scale then the rotation, as read by instanced.vert and impostor.vert
+inline Instance_Layout GetInstanceTransformLayout()
+{
+    Instance_Layout result = CreateInstanceLayout( sizeof( Instance_Transform ) );
+    AddInstanceAttribute( &result, INSTANCE_FIRST_LOCATION, 4, GL_FLOAT, 0 );
+    AddInstanceAttribute( &result, INSTANCE_FIRST_LOCATION + 1, 4, GL_FLOAT, sizeof( glm::vec4 ) );
+    return result;
+}
+
+// Points the attributes of the bound VAO at buffer, advancing once per instance
+internal void SetInstanceAttributes( Instance_Layout *layout, u32 buffer )
+{
+    glBindBuffer( GL_ARRAY_BUFFER, buffer );
+    for ( int i = 0; i < layout->attributesCount; ++i )
+    {
+        Instance_Attribute *attribute = &layout->attributes[ i ];
+        glEnableVertexAttribArray( attribute->location );
+        if ( attribute->integer )
+        {
+            glVertexAttribIPointer( attribute->location, attribute->components, attribute->type, layout->stride, ( void * ) ( u64 ) attribute->offset );
+        }
+        else
+        {
+            glVertexAttribPointer( attribute->location, attribute->components, attribute->type, attribute->normalized, layout->stride,
+                                   ( void * ) ( u64 ) attribute->offset );
+        }
+        glVertexAttribDivisor( attribute->location, 1 );
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+// Same for the VAO of every mesh of the model
+internal void AttachInstanceAttributes( Model *model, Instance_Layout *layout, u32 buffer )
+{
+    for ( int i = 0; i < model->meshesCount; ++i )
+    {
+        glBindVertexArray( model->meshes[ i ].vao );
+        SetInstanceAttributes( layout, buffer );
+        glBindVertexArray( 0 );
+    }
+}
+
+// Draws instances first to first + count of whatever the instance attributes of the model point at. Meshes with
+// fewer levels than level draw their coarsest one.
+internal void DrawModelInstances( Model model, Shader shader, int first, int count, int level = 0 )
+{
+    if ( !count ) { return; }
+
+    for ( int i = 0; i < model.meshesCount; ++i )
+    {
+        Mesh mesh = model.meshes[ i ];
+        SetMeshVertexFormat( mesh, shader );
+        glBindVertexArray( mesh.vao );
+        int meshLevel = level < mesh.lodsCount ? level : mesh.lodsCount - 1;
+        glDrawElementsInstancedBaseInstance( GL_TRIANGLES, mesh.lods[ meshLevel ].indexCount, mesh.indexType, GetMeshLodOffset( mesh, meshLevel ),
+                                             count, ( u32 ) first );
+        glBindVertexArray( 0 );
+    }
+}
+
+struct Instance_Buffer
+{
+    u32 buffer;
+    Instance_Layout layout;
+    GLenum usage;
+
+    //@NOTE: Instances held and room for them, the GL buffer keeps its name when it grows so attached VAOs stay valid
+    int count;
+    int capacity;
+};
+
+internal Instance_Buffer CreateInstanceBuffer( Instance_Layout layout, int capacity = 0, GLenum usage = GL_DYNAMIC_DRAW )
+{
+    Instance_Buffer result = {};
+    result.layout = layout;
+    result.usage = usage;
+    result.capacity = capacity;
+    glGenBuffers( 1, &result.buffer );
+    if ( capacity )
+    {
+        glBindBuffer( GL_ARRAY_BUFFER, result.buffer );
+        glBufferData( GL_ARRAY_BUFFER, ( GLsizeiptr ) capacity * layout.stride, 0, usage );
+        glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    }
+    return result;
+}
+
+internal void FreeInstanceBuffer( Instance_Buffer *instances )
+{
+    glDeleteBuffers( 1, &instances->buffer );
+    *instances = {};
+}
+
+inline void AttachInstanceBuffer( Instance_Buffer *instances, Model *model )
+{
+    AttachInstanceAttributes( model, &instances->layout, instances->buffer );
+}
+
+// Replaces the instances with count new ones laid out as the layout says. The storage is orphaned first, so the
+// draws still reading the old instances never stall the upload.
+internal void SetInstanceBufferData( Instance_Buffer *instances, void *data, int count )
+{
+    if ( count > instances->capacity )
+    {
+        instances->capacity = instances->capacity * 2 > count ? instances->capacity * 2 : count;
+    }
+    instances->count = count;
+
+    glBindBuffer( GL_ARRAY_BUFFER, instances->buffer );
+    glBufferData( GL_ARRAY_BUFFER, ( GLsizeiptr ) instances->capacity * instances->layout.stride, 0, instances->usage );
+    if ( count ) { glBufferSubData( GL_ARRAY_BUFFER, 0, ( GLsizeiptr ) count * instances->layout.stride, data ); }
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+// The buffer has to be attached to the model
+inline void DrawModelInstanced( Model model, Shader shader, Instance_Buffer *instances, int level = 0 )
+{
+    DrawModelInstances( model, shader, 0, instances->count, level );
+}
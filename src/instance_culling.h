@@ -0,0 +1,355 @@
+#pragma once
+#include <glm.hpp>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#include "utils/utils.h"
+#include "platform.h"
+#include "jobs.h"
+#include "frustum.h"
+#include "model.h"
+#include "lod.h"
+#include "software_occlusion.h"
+
+// CPU culling of instanced models. The world space bounding spheres are kept as a structure of arrays and tested
+// against the frustum 8 at a time with AVX2 (4 with SSE when the CPU lacks AVX2), in batches spread over the job
+// queue. The same pass picks the level of detail of every visible sphere. The visible instances are then copied,
+// grouped by level, into Lod_Buckets, so the instance buffer only ever holds what gets drawn. With an occlusion
+// buffer the spheres that pass are also tested against the occluders rendered into it. Given a destination, the
+// visible instances are streamed straight into it instead, a mapped region of a Dynamic_Instance_Buffer.
+
+//@NOTE: Multiple of 8 so every batch starts on a full SIMD group
+#define INSTANCE_CULLING_BATCH_SIZE 4096
+#define INSTANCE_CULLED             0xff
+
+struct Instance_Culling
+{
+    //@NOTE: Padded to a multiple of 8 with spheres of radius -FLT_MAX, which fail every plane
+    float32 *x;
+    float32 *y;
+    float32 *z;
+    float32 *radius;
+    int count;
+    int paddedCount;
+
+    //@NOTE: Object space bounding radius of the model, radius / modelRadius is the instance scale
+    float32 modelRadius;
+
+    //@NOTE: Per instance level, or INSTANCE_CULLED. Per batch counts of every level, turned into write offsets.
+    u8 *levels;
+    int ( *batchCounts )[ MESH_MAX_LODS + 1 ];
+    int batchesCount;
+
+    bool avx2;
+};
+
+// The instances have to stay where they are, their spheres are computed once here
+internal Instance_Culling CreateInstanceCulling( Model *model, Instance_Transform *instances, int count )
+{
+    Instance_Culling result = {};
+    result.count = count;
+    result.paddedCount = ( count + 7 ) & ~7;
+    result.batchesCount = ( count + INSTANCE_CULLING_BATCH_SIZE - 1 ) / INSTANCE_CULLING_BATCH_SIZE;
+    result.avx2 = IsAvx2Supported();
+
+    glm::vec3 center;
+    GetModelBoundingSphere( *model, &center, &result.modelRadius );
+    if ( result.modelRadius <= 0.0f ) { result.modelRadius = 1.0f; }
+
+    result.x = ( float32 * ) malloc( result.paddedCount * sizeof( float32 ) );
+    result.y = ( float32 * ) malloc( result.paddedCount * sizeof( float32 ) );
+    result.z = ( float32 * ) malloc( result.paddedCount * sizeof( float32 ) );
+    result.radius = ( float32 * ) malloc( result.paddedCount * sizeof( float32 ) );
+    result.levels = ( u8 * ) malloc( result.paddedCount * sizeof( u8 ) );
+    result.batchCounts = ( int ( * )[ MESH_MAX_LODS + 1 ] ) malloc( ( result.batchesCount + 1 ) * sizeof( *result.batchCounts ) );
+
+    for ( int i = 0; i < result.paddedCount; ++i )
+    {
+        glm::vec3 position( 0.0f );
+        float32 radius = -FLT_MAX;
+        if ( i < count )
+        {
+            position = TransformInstancePoint( instances[ i ], center );
+            radius = result.modelRadius * instances[ i ].scale;
+        }
+        result.x[ i ] = position.x;
+        result.y[ i ] = position.y;
+        result.z[ i ] = position.z;
+        result.radius[ i ] = radius;
+    }
+    return result;
+}
+
+internal void FreeInstanceCulling( Instance_Culling *culling )
+{
+    free( culling->x );
+    free( culling->y );
+    free( culling->z );
+    free( culling->radius );
+    free( culling->levels );
+    free( culling->batchCounts );
+    *culling = {};
+}
+
+struct Cull_Instances_Job
+{
+    Instance_Culling *culling;
+    Lod_Buckets *buckets;
+    Instance_Transform *instances;
+    Instance_Transform *destination;
+
+    Frustum frustum;
+    glm::vec3 cameraPosition;
+
+    //@NOTE: Level l is good enough while lodErrors[ l ] * scale * projectionScale <= pixelError * distance
+    float32 lodErrors[ MESH_MAX_LODS ];
+    int lodsCount;
+    float32 projectionScale;
+    float32 pixelError;
+    float32 impostorDistance;
+
+    Occlusion_Buffer *occlusion;
+};
+
+internal void CullInstancesSse( Cull_Instances_Job *job, int start, int end )
+{
+    Instance_Culling *culling = job->culling;
+
+    __m128 planes[ 6 ][ 4 ];
+    for ( int i = 0; i < 6; ++i )
+    {
+        for ( int j = 0; j < 4; ++j ) { planes[ i ][ j ] = _mm_set1_ps( job->frustum.planes[ i ][ j ] ); }
+    }
+
+    __m128 cameraX = _mm_set1_ps( job->cameraPosition.x );
+    __m128 cameraY = _mm_set1_ps( job->cameraPosition.y );
+    __m128 cameraZ = _mm_set1_ps( job->cameraPosition.z );
+    __m128 pixelError = _mm_set1_ps( job->pixelError );
+    __m128 errorScale = _mm_set1_ps( job->projectionScale / culling->modelRadius );
+    __m128 impostorDistance = _mm_set1_ps( job->impostorDistance > 0.0f ? job->impostorDistance : FLT_MAX );
+    __m128 impostorLevel = _mm_set1_ps( ( float32 ) LOD_IMPOSTOR_BUCKET );
+    __m128 one = _mm_set1_ps( 1.0f );
+
+    for ( int i = start; i < end; i += 4 )
+    {
+        __m128 x = _mm_loadu_ps( culling->x + i );
+        __m128 y = _mm_loadu_ps( culling->y + i );
+        __m128 z = _mm_loadu_ps( culling->z + i );
+        __m128 radius = _mm_loadu_ps( culling->radius + i );
+        __m128 negativeRadius = _mm_sub_ps( _mm_setzero_ps(), radius );
+
+        __m128 visible = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+        for ( int p = 0; p < 6; ++p )
+        {
+            __m128 distance = _mm_add_ps( _mm_add_ps( _mm_mul_ps( planes[ p ][ 0 ], x ), _mm_mul_ps( planes[ p ][ 1 ], y ) ),
+                                          _mm_add_ps( _mm_mul_ps( planes[ p ][ 2 ], z ), planes[ p ][ 3 ] ) );
+            visible = _mm_and_ps( visible, _mm_cmpge_ps( distance, negativeRadius ) );
+        }
+
+        int mask = _mm_movemask_ps( visible );
+        if ( !mask )
+        {
+            memset( culling->levels + i, INSTANCE_CULLED, 4 );
+            continue;
+        }
+
+        __m128 dx = _mm_sub_ps( x, cameraX );
+        __m128 dy = _mm_sub_ps( y, cameraY );
+        __m128 dz = _mm_sub_ps( z, cameraZ );
+        __m128 distance = _mm_sqrt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) ) );
+
+        __m128 allowed = _mm_mul_ps( pixelError, distance );
+        __m128 scale = _mm_mul_ps( radius, errorScale );
+        __m128 level = _mm_setzero_ps();
+        for ( int l = 1; l < job->lodsCount; ++l )
+        {
+            __m128 error = _mm_mul_ps( _mm_set1_ps( job->lodErrors[ l ] ), scale );
+            level = _mm_add_ps( level, _mm_and_ps( _mm_cmple_ps( error, allowed ), one ) );
+        }
+        __m128 impostor = _mm_cmpgt_ps( distance, impostorDistance );
+        level = _mm_or_ps( _mm_and_ps( impostor, impostorLevel ), _mm_andnot_ps( impostor, level ) );
+
+        int levels[ 4 ];
+        _mm_storeu_si128( ( __m128i * ) levels, _mm_cvttps_epi32( level ) );
+        for ( int j = 0; j < 4; ++j )
+        {
+            culling->levels[ i + j ] = ( mask & ( 1 << j ) ) ? ( u8 ) levels[ j ] : ( u8 ) INSTANCE_CULLED;
+        }
+    }
+}
+
+//@NOTE: Same as CullInstancesSse 8 wide, only called when IsAvx2Supported
+internal void CullInstancesAvx2( Cull_Instances_Job *job, int start, int end )
+{
+    Instance_Culling *culling = job->culling;
+
+    __m256 planes[ 6 ][ 4 ];
+    for ( int i = 0; i < 6; ++i )
+    {
+        for ( int j = 0; j < 4; ++j ) { planes[ i ][ j ] = _mm256_set1_ps( job->frustum.planes[ i ][ j ] ); }
+    }
+
+    __m256 cameraX = _mm256_set1_ps( job->cameraPosition.x );
+    __m256 cameraY = _mm256_set1_ps( job->cameraPosition.y );
+    __m256 cameraZ = _mm256_set1_ps( job->cameraPosition.z );
+    __m256 pixelError = _mm256_set1_ps( job->pixelError );
+    __m256 errorScale = _mm256_set1_ps( job->projectionScale / culling->modelRadius );
+    __m256 impostorDistance = _mm256_set1_ps( job->impostorDistance > 0.0f ? job->impostorDistance : FLT_MAX );
+    __m256i impostorLevel = _mm256_set1_epi32( LOD_IMPOSTOR_BUCKET );
+    __m256i culled = _mm256_set1_epi32( INSTANCE_CULLED );
+
+    for ( int i = start; i < end; i += 8 )
+    {
+        __m256 x = _mm256_loadu_ps( culling->x + i );
+        __m256 y = _mm256_loadu_ps( culling->y + i );
+        __m256 z = _mm256_loadu_ps( culling->z + i );
+        __m256 radius = _mm256_loadu_ps( culling->radius + i );
+        __m256 negativeRadius = _mm256_sub_ps( _mm256_setzero_ps(), radius );
+
+        __m256 visible = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+        for ( int p = 0; p < 6; ++p )
+        {
+            __m256 distance = _mm256_fmadd_ps( planes[ p ][ 0 ], x, _mm256_fmadd_ps( planes[ p ][ 1 ], y, _mm256_fmadd_ps( planes[ p ][ 2 ], z, planes[ p ][ 3 ] ) ) );
+            visible = _mm256_and_ps( visible, _mm256_cmp_ps( distance, negativeRadius, _CMP_GE_OQ ) );
+        }
+
+        if ( _mm256_testz_ps( visible, visible ) )
+        {
+            memset( culling->levels + i, INSTANCE_CULLED, 8 );
+            continue;
+        }
+
+        __m256 dx = _mm256_sub_ps( x, cameraX );
+        __m256 dy = _mm256_sub_ps( y, cameraY );
+        __m256 dz = _mm256_sub_ps( z, cameraZ );
+        __m256 distance = _mm256_sqrt_ps( _mm256_fmadd_ps( dx, dx, _mm256_fmadd_ps( dy, dy, _mm256_mul_ps( dz, dz ) ) ) );
+
+        //@NOTE: Passed comparisons are -1, subtracting them counts the levels that are good enough
+        __m256 allowed = _mm256_mul_ps( pixelError, distance );
+        __m256 scale = _mm256_mul_ps( radius, errorScale );
+        __m256i level = _mm256_setzero_si256();
+        for ( int l = 1; l < job->lodsCount; ++l )
+        {
+            __m256 error = _mm256_mul_ps( _mm256_set1_ps( job->lodErrors[ l ] ), scale );
+            level = _mm256_sub_epi32( level, _mm256_castps_si256( _mm256_cmp_ps( error, allowed, _CMP_LE_OQ ) ) );
+        }
+        level = _mm256_blendv_epi8( level, impostorLevel, _mm256_castps_si256( _mm256_cmp_ps( distance, impostorDistance, _CMP_GT_OQ ) ) );
+        level = _mm256_blendv_epi8( culled, level, _mm256_castps_si256( visible ) );
+
+        //@NOTE: Every lane fits in a byte, pack the low bytes of the 8 lanes together
+        __m256i bytes = _mm256_shuffle_epi8( level, _mm256_setr_epi8( 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                                      0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 ) );
+        u32 low = ( u32 ) _mm256_extract_epi32( bytes, 0 );
+        u32 high = ( u32 ) _mm256_extract_epi32( bytes, 4 );
+        memcpy( culling->levels + i, &low, sizeof( low ) );
+        memcpy( culling->levels + i + 4, &high, sizeof( high ) );
+    }
+}
+
+internal void CullInstancesJob( void *data, int start, int end )
+{
+    Cull_Instances_Job *job = ( Cull_Instances_Job * ) data;
+    Instance_Culling *culling = job->culling;
+
+    //@NOTE: The padding is culled already, the last batch can run to the padded end
+    int simdEnd = end == culling->count ? culling->paddedCount : end;
+    if ( culling->avx2 ) { CullInstancesAvx2( job, start, simdEnd ); }
+    else { CullInstancesSse( job, start, simdEnd ); }
+
+    int *counts = culling->batchCounts[ start / INSTANCE_CULLING_BATCH_SIZE ];
+    memset( counts, 0, sizeof( *culling->batchCounts ) );
+    for ( int i = start; i < end; ++i )
+    {
+        if ( culling->levels[ i ] == INSTANCE_CULLED ) { continue; }
+
+        //@NOTE: Only what survived the frustum, the occlusion test is far more expensive
+        if ( job->occlusion && IsSphereOccluded( job->occlusion, glm::vec3( culling->x[ i ], culling->y[ i ], culling->z[ i ] ), culling->radius[ i ] ) )
+        {
+            culling->levels[ i ] = INSTANCE_CULLED;
+            continue;
+        }
+        ++counts[ culling->levels[ i ] ];
+    }
+}
+
+internal void CompactInstancesJob( void *data, int start, int end )
+{
+    Cull_Instances_Job *job = ( Cull_Instances_Job * ) data;
+    Instance_Culling *culling = job->culling;
+
+    int *offsets = culling->batchCounts[ start / INSTANCE_CULLING_BATCH_SIZE ];
+    if ( !job->destination )
+    {
+        for ( int i = start; i < end; ++i )
+        {
+            u8 level = culling->levels[ i ];
+            if ( level != INSTANCE_CULLED ) { job->buckets->instances[ offsets[ level ]++ ] = job->instances[ i ]; }
+        }
+        return;
+    }
+
+    //@NOTE: Mapped buffers are usually write combined, streaming stores skip the cache and never read them back.
+    // Mappings are at least 64 byte aligned, so every Instance_Transform is two aligned vec4.
+    for ( int i = start; i < end; ++i )
+    {
+        u8 level = culling->levels[ i ];
+        if ( level == INSTANCE_CULLED ) { continue; }
+
+        float32 *source = ( float32 * ) &job->instances[ i ];
+        float32 *destination = ( float32 * ) &job->destination[ offsets[ level ]++ ];
+        _mm_stream_ps( destination, _mm_loadu_ps( source ) );
+        _mm_stream_ps( destination + 4, _mm_loadu_ps( source + 4 ) );
+    }
+    _mm_sfence();
+}
+
+// Culls the instances against the view, picks their levels and writes the visible ones grouped by level to buckets.
+// An impostorDistance of 0 disables the impostor bucket. The occlusion buffer has to hold this frame's occluders.
+// With a destination, room for every instance, buckets only get the counts and firsts.
+internal void CullInstances( Instance_Culling *culling, Lod_Buckets *buckets, Job_Queue *queue, Model *model, Instance_Transform *instances,
+                             glm::mat4 viewProjection, glm::vec3 cameraPosition, float32 projectionScale, float32 pixelError,
+                             float32 impostorDistance = 0.0f, Occlusion_Buffer *occlusion = 0, Instance_Transform *destination = 0 )
+{
+    if ( !destination && culling->count > buckets->capacity )
+    {
+        buckets->capacity = culling->count;
+        buckets->instances = ( Instance_Transform * ) realloc( buckets->instances, buckets->capacity * sizeof( Instance_Transform ) );
+    }
+
+    Cull_Instances_Job job = {};
+    job.culling = culling;
+    job.buckets = buckets;
+    job.instances = instances;
+    job.destination = destination;
+    job.frustum = GetFrustum( viewProjection );
+    job.cameraPosition = cameraPosition;
+    memcpy( job.lodErrors, model->lodErrors, sizeof( job.lodErrors ) );
+    job.lodsCount = model->lodsCount;
+    job.projectionScale = projectionScale;
+    job.pixelError = pixelError;
+    job.impostorDistance = impostorDistance;
+    job.occlusion = occlusion;
+
+    ParallelFor( queue, culling->count, INSTANCE_CULLING_BATCH_SIZE, CullInstancesJob, &job );
+
+    //@NOTE: Without a queue ParallelFor runs everything as one range, its counts all land in the first batch
+    int batchesCount = queue ? culling->batchesCount : ( culling->batchesCount ? 1 : 0 );
+
+    int first = 0;
+    for ( int level = 0; level < MESH_MAX_LODS + 1; ++level )
+    {
+        buckets->firsts[ level ] = first;
+        for ( int batch = 0; batch < batchesCount; ++batch )
+        {
+            int count = culling->batchCounts[ batch ][ level ];
+            culling->batchCounts[ batch ][ level ] = first;
+            first += count;
+        }
+        buckets->counts[ level ] = first - buckets->firsts[ level ];
+    }
+    buckets->instancesCount = first;
+
+    ParallelFor( queue, culling->count, INSTANCE_CULLING_BATCH_SIZE, CompactInstancesJob, &job );
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <glm.hpp>
+#include <math.h>
+#include "utils/utils.h"
+
+// Compact per instance transform, half the size of a glm::mat4. Instances only ever carry a rotation and a uniform
+// scale, so a position, a scale and a unit quaternion describe them exactly. The vertex shaders rebuild the
+// transform from it and rotate normals with the quaternion, uniform scale needs no inverse transpose.
+
+struct Instance_Transform
+{
+    glm::vec3 position;
+    float32 scale;
+
+    //@NOTE: Unit quaternion, x y z is the vector part and w the scalar
+    glm::vec4 rotation;
+};
+
+inline glm::vec3 RotateByQuaternion( glm::vec4 rotation, glm::vec3 v )
+{
+    glm::vec3 axis( rotation.x, rotation.y, rotation.z );
+    return v + 2.0f * glm::cross( axis, glm::cross( axis, v ) + rotation.w * v );
+}
+
+inline glm::mat3 GetQuaternionMatrix( glm::vec4 q )
+{
+    glm::mat3 result;
+    result[ 0 ] = glm::vec3( 1.0f - 2.0f * ( q.y * q.y + q.z * q.z ), 2.0f * ( q.x * q.y + q.w * q.z ), 2.0f * ( q.x * q.z - q.w * q.y ) );
+    result[ 1 ] = glm::vec3( 2.0f * ( q.x * q.y - q.w * q.z ), 1.0f - 2.0f * ( q.x * q.x + q.z * q.z ), 2.0f * ( q.y * q.z + q.w * q.x ) );
+    result[ 2 ] = glm::vec3( 2.0f * ( q.x * q.z + q.w * q.y ), 2.0f * ( q.y * q.z - q.w * q.x ), 1.0f - 2.0f * ( q.x * q.x + q.y * q.y ) );
+    return result;
+}
+
+// Unit quaternion of a rotation matrix, from the largest of the four diagonal combinations so it stays precise
+inline glm::vec4 GetMatrixQuaternion( glm::mat3 m )
+{
+    glm::vec4 result;
+    float32 trace = m[ 0 ][ 0 ] + m[ 1 ][ 1 ] + m[ 2 ][ 2 ];
+    if ( trace > 0.0f )
+    {
+        float32 s = sqrtf( trace + 1.0f ) * 2.0f;
+        result = glm::vec4( ( m[ 1 ][ 2 ] - m[ 2 ][ 1 ] ) / s, ( m[ 2 ][ 0 ] - m[ 0 ][ 2 ] ) / s, ( m[ 0 ][ 1 ] - m[ 1 ][ 0 ] ) / s, 0.25f * s );
+    }
+    else if ( m[ 0 ][ 0 ] > m[ 1 ][ 1 ] && m[ 0 ][ 0 ] > m[ 2 ][ 2 ] )
+    {
+        float32 s = sqrtf( 1.0f + m[ 0 ][ 0 ] - m[ 1 ][ 1 ] - m[ 2 ][ 2 ] ) * 2.0f;
+        result = glm::vec4( 0.25f * s, ( m[ 1 ][ 0 ] + m[ 0 ][ 1 ] ) / s, ( m[ 2 ][ 0 ] + m[ 0 ][ 2 ] ) / s, ( m[ 1 ][ 2 ] - m[ 2 ][ 1 ] ) / s );
+    }
+    else if ( m[ 1 ][ 1 ] > m[ 2 ][ 2 ] )
+    {
+        float32 s = sqrtf( 1.0f + m[ 1 ][ 1 ] - m[ 0 ][ 0 ] - m[ 2 ][ 2 ] ) * 2.0f;
+        result = glm::vec4( ( m[ 1 ][ 0 ] + m[ 0 ][ 1 ] ) / s, 0.25f * s, ( m[ 2 ][ 1 ] + m[ 1 ][ 2 ] ) / s, ( m[ 2 ][ 0 ] - m[ 0 ][ 2 ] ) / s );
+    }
+    else
+    {
+        float32 s = sqrtf( 1.0f + m[ 2 ][ 2 ] - m[ 0 ][ 0 ] - m[ 1 ][ 1 ] ) * 2.0f;
+        result = glm::vec4( ( m[ 2 ][ 0 ] + m[ 0 ][ 2 ] ) / s, ( m[ 2 ][ 1 ] + m[ 1 ][ 2 ] ) / s, 0.25f * s, ( m[ 0 ][ 1 ] - m[ 1 ][ 0 ] ) / s );
+    }
+    return glm::normalize( result );
+}
+
+// The transform has to be a rotation, a uniform scale and a translation, anything else is lost
+inline Instance_Transform CompressInstanceTransform( glm::mat4 transform )
+{
+    Instance_Transform result;
+    result.position = glm::vec3( transform[ 3 ] );
+    result.scale = glm::length( glm::vec3( transform[ 0 ] ) );
+    result.rotation = GetMatrixQuaternion( glm::mat3( transform ) * ( 1.0f / result.scale ) );
+    return result;
+}
+
+inline glm::mat4 GetInstanceMatrix( Instance_Transform instance )
+{
+    glm::mat3 rotation = GetQuaternionMatrix( instance.rotation ) * instance.scale;
+    glm::mat4 result( rotation );
+    result[ 3 ] = glm::vec4( instance.position, 1.0f );
+    return result;
+}
+
+inline glm::vec3 TransformInstancePoint( Instance_Transform instance, glm::vec3 point )
+{
+    return instance.position + RotateByQuaternion( instance.rotation, point * instance.scale );
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "utils/utils.h"
+#include "platform.h"
+
+typedef void Job_Callback( void *data, int index );
+typedef void Job_Range_Callback( void *data, int start, int end );
+
+struct Job_Group
+{
+    std::atomic< int > pending;
+};
+
+struct Job
+{
+    Job_Callback *callback;
+    void *data;
+    int index;
+    Job_Group *group;
+};
+
+struct Job_Queue
+{
+    std::vector< std::thread > workers;
+    std::deque< Job > jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stop;
+};
+
+internal int GetProcessorCount()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    return ( int ) info.dwNumberOfProcessors;
+}
+
+internal bool TryRunJob( Job_Queue *queue )
+{
+    Job job;
+    {
+        std::lock_guard< std::mutex > lock( queue->mutex );
+        if ( queue->jobs.empty() ) { return false; }
+        job = queue->jobs.front();
+        queue->jobs.pop_front();
+    }
+
+    job.callback( job.data, job.index );
+    if ( job.group ) { job.group->pending.fetch_sub( 1, std::memory_order_release ); }
+    return true;
+}
+
+internal void WorkerThread( Job_Queue *queue )
+{
+    for ( ;; )
+    {
+        Job job;
+        {
+            std::unique_lock< std::mutex > lock( queue->mutex );
+            queue->wake.wait( lock, [ queue ] { return queue->stop || !queue->jobs.empty(); } );
+            if ( queue->jobs.empty() ) { return; }
+            job = queue->jobs.front();
+            queue->jobs.pop_front();
+        }
+
+        job.callback( job.data, job.index );
+        if ( job.group ) { job.group->pending.fetch_sub( 1, std::memory_order_release ); }
+    }
+}
+
+//@NOTE: threadCount 0 means one worker per core except the calling thread, which helps out in WaitForJobs
+internal Job_Queue *CreateJobQueue( int threadCount = 0 )
+{
+    if ( threadCount <= 0 ) { threadCount = GetProcessorCount() - 1; }
+    if ( threadCount < 1 ) { threadCount = 1; }
+
+    Job_Queue *queue = new Job_Queue();
+    for ( int i = 0; i < threadCount; ++i )
+    {
+        queue->workers.emplace_back( WorkerThread, queue );
+    }
+    return queue;
+}
+
+internal void DestroyJobQueue( Job_Queue *queue )
+{
+    {
+        std::lock_guard< std::mutex > lock( queue->mutex );
+        queue->stop = true;
+    }
+    queue->wake.notify_all();
+
+    for ( std::thread &worker : queue->workers )
+    {
+        worker.join();
+    }
+    delete queue;
+}
+
+inline int GetJobQueueThreadCount( Job_Queue *queue )
+{
+    return queue ? ( int ) queue->workers.size() + 1 : 1;
+}
+
+internal void AddJob( Job_Queue *queue, Job_Group *group, Job_Callback *callback, void *data, int index )
+{
+    if ( group ) { group->pending.fetch_add( 1, std::memory_order_relaxed ); }
+    {
+        std::lock_guard< std::mutex > lock( queue->mutex );
+        queue->jobs.push_back( Job{ callback, data, index, group } );
+    }
+    queue->wake.notify_one();
+}
+
+// Runs queued jobs on the calling thread until every job of the group is finished
+internal void WaitForJobs( Job_Queue *queue, Job_Group *group )
+{
+    while ( group->pending.load( std::memory_order_acquire ) > 0 )
+    {
+        if ( !TryRunJob( queue ) )
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+struct Parallel_For_Batch
+{
+    Job_Range_Callback *callback;
+    void *data;
+    int count;
+    int batchSize;
+};
+
+internal void RunParallelForBatch( void *data, int index )
+{
+    Parallel_For_Batch *batch = ( Parallel_For_Batch * ) data;
+    int start = index * batch->batchSize;
+    int end = start + batch->batchSize;
+    if ( end > batch->count ) { end = batch->count; }
+    batch->callback( batch->data, start, end );
+}
+
+// Splits [0, count) into batches of batchSize and blocks until all of them ran. Without a queue
+// the whole range runs on the calling thread.
+internal void ParallelFor( Job_Queue *queue, int count, int batchSize, Job_Range_Callback *callback, void *data )
+{
+    if ( count <= 0 ) { return; }
+    if ( batchSize < 1 ) { batchSize = 1; }
+
+    if ( !queue || count <= batchSize )
+    {
+        callback( data, 0, count );
+        return;
+    }
+
+    Parallel_For_Batch batch = { callback, data, count, batchSize };
+    int batchesCount = ( count + batchSize - 1 ) / batchSize;
+
+    Job_Group group = {};
+    for ( int i = 0; i < batchesCount; ++i )
+    {
+        AddJob( queue, &group, RunParallelForBatch, &batch, i );
+    }
+    WaitForJobs( queue, &group );
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <glm.hpp>
+#include <glad/glad.h>
+#include <math.h>
+#include <stdlib.h>
+#include "utils/utils.h"
+#include "model.h"
+#include "instance_transform.h"
+
+// Runtime level of detail selection. A level is good enough while its object space error, scaled by the instance
+// and projected at the instance distance, stays under lodPixelError pixels. Instances are grouped by the level they
+// picked, so every level of every mesh is one instanced draw over a contiguous range of the instance buffer.
+// Instances past impostorDistance go to one more bucket after the levels, for DrawImpostors.
+
+//@NOTE: Index of the bucket drawn with impostors instead of a mesh level
+#define LOD_IMPOSTOR_BUCKET MESH_MAX_LODS
+
+//@NOTE: Pixels covered by one world unit at distance 1, for a symmetric perspective projection
+inline float32 GetLodProjectionScale( float32 fieldOfViewY, float32 viewportHeight )
+{
+    return viewportHeight / ( 2.0f * tanf( fieldOfViewY * 0.5f ) );
+}
+
+// Coarsest level whose projected error stays under pixelError, errors have to grow with the level
+inline int SelectLod( float32 *lodErrors, int lodsCount, float32 distance, float32 scale, float32 projectionScale, float32 pixelError )
+{
+    float32 maxError = pixelError * distance / ( scale * projectionScale );
+    int result = 0;
+    while ( result + 1 < lodsCount && lodErrors[ result + 1 ] <= maxError ) { ++result; }
+    return result;
+}
+
+struct Lod_Buckets
+{
+    //@NOTE: The instances reordered by level, level i starts at firsts[ i ]. Filled by CullInstances, unless it
+    // wrote them to a destination of its own.
+    Instance_Transform *instances;
+    int instancesCount;
+    int capacity;
+
+    int counts[ MESH_MAX_LODS + 1 ];
+    int firsts[ MESH_MAX_LODS + 1 ];
+};
+
+internal void FreeLodBuckets( Lod_Buckets *buckets )
+{
+    free( buckets->instances );
+    *buckets = {};
+}
+
+// Draws every non empty level, the bound instance attributes have to hold buckets->instances from baseInstance on.
+// Meshes with fewer levels than the model draw their coarsest one.
+internal void DrawModelLodBuckets( Model model, Shader shader, Lod_Buckets *buckets, int baseInstance = 0 )
+{
+    for ( int i = 0; i < model.meshesCount; ++i )
+    {
+        Mesh mesh = model.meshes[ i ];
+        SetMeshVertexFormat( mesh, shader );
+        glBindVertexArray( mesh.vao );
+        for ( int level = 0; level < MESH_MAX_LODS; ++level )
+        {
+            if ( !buckets->counts[ level ] ) { continue; }
+
+            int meshLevel = level < mesh.lodsCount ? level : mesh.lodsCount - 1;
+            glDrawElementsInstancedBaseInstance( GL_TRIANGLES, mesh.lods[ meshLevel ].indexCount, mesh.indexType, GetMeshLodOffset( mesh, meshLevel ),
+                                                 buckets->counts[ level ], ( u32 ) ( baseInstance + buckets->firsts[ level ] ) );
+        }
+        glBindVertexArray( 0 );
+    }
+}
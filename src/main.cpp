@@ -12,6 +12,16 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "lod.h"
+#include "impostor.h"
+#include "instance_culling.h"
+#include "instance_transform.h"
+#include "instance_buffer.h"
+#include "dynamic_instances.h"
+#include "gpu_instance_culling.h"
+#include "bvh.h"
+#include "orbit.h"
+#include "asteroid_field.h"
 
 global_variable float32 deltaTime = 0.0f;
 global_variable float32 lastFrame = 0.0f;
@@ -25,6 +35,18 @@ global_variable Camera camera;
 global_variable int windowWidth = 1280;
 global_variable int windowHeight = 1280;
 
+//@NOTE: G switches the asteroids between CullInstances and DrawModelGpuCulled
+global_variable bool gpuInstanceCulling = false;
+global_variable bool gpuInstanceCullingKeyDown = false;
+
+//@NOTE: O switches the asteroids between the static belt and orbits animated in the vertex shader
+global_variable bool orbitingAsteroids = false;
+global_variable bool orbitingAsteroidsKeyDown = false;
+
+//@NOTE: Left click picks whatever is under the crosshair from the scene BVH
+global_variable bool pickRequested = false;
+global_variable bool pickButtonDown = false;
+
 GLenum glCheckError( char *file, int line )
 {
     GLenum errorCode;
@@ -131,6 +153,26 @@ void ProcessInput( GLFWwindow *window )
     {
         camera.movementSpeed = defaultSpeed;
     }
+
+    bool gpuInstanceCullingKey = glfwGetKey( window, GLFW_KEY_G ) == GLFW_PRESS;
+    if ( gpuInstanceCullingKey && !gpuInstanceCullingKeyDown )
+    {
+        gpuInstanceCulling = !gpuInstanceCulling;
+        printf( "Asteroid culling on the %s\n", gpuInstanceCulling ? "GPU" : "CPU" );
+    }
+    gpuInstanceCullingKeyDown = gpuInstanceCullingKey;
+
+    bool orbitingAsteroidsKey = glfwGetKey( window, GLFW_KEY_O ) == GLFW_PRESS;
+    if ( orbitingAsteroidsKey && !orbitingAsteroidsKeyDown )
+    {
+        orbitingAsteroids = !orbitingAsteroids;
+        printf( "Asteroids %s\n", orbitingAsteroids ? "orbiting" : "static" );
+    }
+    orbitingAsteroidsKeyDown = orbitingAsteroidsKey;
+
+    bool pickButton = glfwGetMouseButton( window, GLFW_MOUSE_BUTTON_LEFT ) == GLFW_PRESS;
+    pickRequested = pickButton && !pickButtonDown;
+    pickButtonDown = pickButton;
 }
 
 void MouseCallback( GLFWwindow *window, float64 mouseX, float64 mouseY )
@@ -154,28 +196,21 @@ void ScrollCallback( GLFWwindow *window, float64 xOffset, float64 yOffset )
     CameraProcessScroll( &camera, ( float32 ) yOffset );
 }
 
-u32 loadCubemap( char *faces[ 6 ] )
+u32 loadCubemap( char *faces[ 6 ], Job_Queue *queue )
 {
     u32 id;
     glGenTextures( 1, &id );
-    glBindTexture( GL_TEXTURE_CUBE_MAP, id );
-
-    int width, height, channelCount;
 
+    //@NOTE: All six faces decode in parallel, they are uploaded in whatever order they finish
+    Texture_Batch batch;
+    BeginTextureBatch( &batch, queue );
     for ( int i = 0; i < 6; ++i )
     {
-        u8 *data = stbi_load( faces[ i ], &width, &height, &channelCount, 0 );
-        if ( data )
-        {
-            glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data );
-        }
-        else
-        {
-            printf( "Failed to load cubemap texture: %s\n", faces[ i ] );
-        }
-        stbi_image_free( data );
+        QueueCubemapFace( &batch, id, i, faces[ i ] );
     }
+    FinishTextureBatch( &batch );
 
+    glBindTexture( GL_TEXTURE_CUBE_MAP, id );
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
@@ -212,6 +247,8 @@ int main()
         printf( "Failed to initialize GLAD!\n" );
         return -1;
     }
+    LoadBufferStorage( ( GLADloadproc ) glfwGetProcAddress );
+    LoadMultiDrawIndirectCount( ( GLADloadproc ) glfwGetProcAddress );
 
     int flags;
     glGetIntegerv( GL_CONTEXT_FLAGS, &flags );
@@ -228,15 +265,29 @@ int main()
 
     camera = CreateCamera( glm::vec3( 0.0f, 3.0f, 6.0f ), defaultYaw, -20.0f );
 
+    //@NOTE: Built with tools/asset_packer, without it everything is read from the loose files
+    if ( !MountPackage( "engine.pak" ) )
+    {
+        printf( "No asset package, using loose files.\n" );
+    }
+
     Shader modelShader = CreateShader( "../src/shaders/cube.vert", "../src/shaders/cube.frag" );
     Shader lightShader = CreateShader( "../src/shaders/cube.vert", "../src/shaders/light.frag" );
     Shader singleColorShader = CreateShader( "../src/shaders/cube.vert", "../src/shaders/single_color.frag" );
     Shader quadShader = CreateShader( "../src/shaders/render_texture.vert", "../src/shaders/render_texture.frag" );
     Shader skyboxShader = CreateShader( "../src/shaders/skybox.vert", "../src/shaders/skybox.frag" );
     Shader instancedShader = CreateShader( "../src/shaders/instanced.vert", "../src/shaders/cube.frag" );
+    Shader instancedIndirectShader = CreateShader( "../src/shaders/instanced_indirect.vert", "../src/shaders/cube.frag" );
+    Shader impostorShader = CreateShader( "../src/shaders/impostor.vert", "../src/shaders/impostor.frag" );
+    Shader orbitShader = CreateShader( "../src/shaders/orbit_instanced.vert", "../src/shaders/cube.frag" );
+
+    Meshlet_Culler meshletCuller = CreateMeshletCuller();
 
     BindUniformBlock( modelShader, "Matrices", 0 );
     BindUniformBlock( instancedShader, "Matrices", 0 );
+    BindUniformBlock( instancedIndirectShader, "Matrices", 0 );
+    BindUniformBlock( impostorShader, "Matrices", 0 );
+    BindUniformBlock( orbitShader, "Matrices", 0 );
 
     u32 uboMatrices;
     glGenBuffers( 1, &uboMatrices );
@@ -254,7 +305,7 @@ int main()
     UseShader( skyboxShader );
     ShaderSetMat4( skyboxShader, "projection", glm::value_ptr( projection ) );
 
-    Shader shaders[] = { modelShader, instancedShader };
+    Shader shaders[] = { modelShader, instancedShader, instancedIndirectShader, orbitShader };
 
     for ( Shader shader : shaders )
     {
@@ -286,68 +337,98 @@ int main()
         ShaderSetFloat32( shader, "pointLights[0].quadratic", 0.032f );
     }
 
-    stbi_set_flip_vertically_on_load( true );
-    Model backpack = CreateModel( "backpack/backpack.obj" );
-    stbi_set_flip_vertically_on_load( false );
-    Model grass = CreateModel( "grass.obj" );
-    Model redWindow = CreateModel( "red_window.obj" );
+    UseShader( impostorShader );
+    ShaderSetFloat32( impostorShader, "shininess", 32.0f );
+    ShaderSetVec3( impostorShader, "directionalLight.direction", -0.2f, -1.0f, -0.3f );
+    ShaderSetVec3( impostorShader, "directionalLight.ambient", 0.05f, 0.05f, 0.05f );
+    ShaderSetVec3( impostorShader, "directionalLight.diffuse", 0.4f, 0.4f, 0.4f );
+    ShaderSetVec3( impostorShader, "directionalLight.specular", 0.5f, 0.5f, 0.5f );
+
+    Job_Queue *jobQueue = CreateJobQueue();
+
+    Model_Load_Request modelRequests[] = {
+        { "backpack/backpack.obj", MODEL_LOAD_DEFAULT_FLAGS | MODEL_LOAD_FLIP_TEXTURES | MODEL_LOAD_MESHLETS },
+        { "grass.obj", MODEL_LOAD_DEFAULT_FLAGS },
+        { "red_window.obj", MODEL_LOAD_DEFAULT_FLAGS },
+        { "planet/planet.obj", MODEL_LOAD_DEFAULT_FLAGS | MODEL_LOAD_MESHLETS | MODEL_LOAD_LODS },
+        { "rock/rock.obj", MODEL_LOAD_DEFAULT_FLAGS | MODEL_LOAD_COMPACT_VERTICES | MODEL_LOAD_LODS },
+    };
+    Model models[ 5 ];
+    CreateModels( modelRequests, 5, models, jobQueue );
 
-    Model planet = CreateModel( "planet/planet.obj" );
-    Model asteroid = CreateModel( "rock/rock.obj" );
+    Model backpack = models[ 0 ];
+    Model grass = models[ 1 ];
+    Model redWindow = models[ 2 ];
+    Model planet = models[ 3 ];
+    Model asteroid = models[ 4 ];
 
     const int asteroidCount = 250000;
-    glm::mat4 *asteroidMatrices = ( glm::mat4 * ) malloc( asteroidCount * sizeof( glm::mat4 ) );
-    srand( ( u32 ) glfwGetTime() );
-    float32 radius = 150.0f;
-    float32 offset = 25.0f;
-
+    Instance_Transform *asteroidInstances = ( Instance_Transform * ) malloc( asteroidCount * sizeof( Instance_Transform ) );
+    Orbit_Instance *asteroidOrbitsData = ( Orbit_Instance * ) malloc( asteroidCount * sizeof( Orbit_Instance ) );
+
+    //@NOTE: Fixed seed, the same belt on every run and machine for benchmarks
+    Asteroid_Field_Settings asteroidField = {};
+    asteroidField.seed = 0x5eed;
+    asteroidField.radius = 150.0f;
+    asteroidField.offset = 25.0f;
+    asteroidField.minScale = 0.05f;
+    asteroidField.maxScale = 0.25f;
+    asteroidField.orbitSpeed = 100.0f;
+    asteroidField.maxInclination = glm::radians( 2.0f );
+    GenerateAsteroidField( asteroidField, asteroidInstances, asteroidOrbitsData, asteroidCount, jobQueue );
+
+    //@NOTE: The orbits stay on the CPU as well, picking builds a tree over them at the time of the pick
+    Orbit_Instances asteroidOrbits = CreateOrbitInstances( asteroidOrbitsData, asteroidCount );
+
+    //@NOTE: The instance buffer is refilled every frame with the visible asteroids grouped by level of detail,
+    // written by the culling jobs straight into the next region of the ring
+    Dynamic_Instance_Buffer asteroidBuffer = CreateDynamicInstanceBuffer( asteroidCount );
+    Instance_Culling asteroidCulling = CreateInstanceCulling( &asteroid, asteroidInstances, asteroidCount );
+    Lod_Buckets asteroidBuckets = {};
+    float32 lodProjectionScale = GetLodProjectionScale( glm::radians( 45.0f ), ( float32 ) windowHeight );
+    float32 lodPixelError = 1.0f;
+
+    Instance_Layout asteroidLayout = GetInstanceTransformLayout();
+    AttachInstanceAttributes( &asteroid, &asteroidLayout, asteroidBuffer.buffer );
+
+    //@NOTE: Asteroids further than this are drawn as impostors, all of them as meshes when baking failed
+    Impostor asteroidImpostor = BakeImpostor( asteroid );
+    float32 impostorDistance = asteroidImpostor.vao ? 80.0f : 0.0f;
+    SetImpostorInstanceBuffer( &asteroidImpostor, asteroidBuffer.buffer );
+
+    //@NOTE: The GPU path keeps every asteroid on the GPU, past gpuCullingDistance they are dropped instead of
+    // drawn as impostors
+    Gpu_Instance_Culling asteroidGpuCulling = CreateGpuInstanceCulling( &asteroid, asteroidInstances, asteroidCount );
+    float32 gpuCullingDistance = 250.0f;
+    Hi_Z hiZ = CreateHiZ();
+
+    //@NOTE: The CPU path culls against the coarsest level of the planet, rasterized on the job queue
+    Occluder planetOccluder = CreateOccluder( planet.meshes, planet.meshesCount );
+    Occlusion_Buffer occlusionBuffer = CreateOcclusionBuffer( 256, 256 );
+
+    //@NOTE: World boxes of every asteroid followed by every planet mesh, for picking. The tree copies them, the
+    // arrays are reused for the orbit boxes of a pick.
+    glm::mat4 planetTransform = glm::scale( glm::mat4( 1.0f ), glm::vec3( 4.0f, 4.0f, 4.0f ) );
+    int sceneItemsCount = asteroidCount + planet.meshesCount;
+    glm::vec3 *sceneItemsMin = ( glm::vec3 * ) malloc( sceneItemsCount * sizeof( glm::vec3 ) );
+    glm::vec3 *sceneItemsMax = ( glm::vec3 * ) malloc( sceneItemsCount * sizeof( glm::vec3 ) );
+    glm::vec3 asteroidMin( FLT_MAX );
+    glm::vec3 asteroidMax( -FLT_MAX );
+    for ( int i = 0; i < asteroid.meshesCount; ++i )
+    {
+        asteroidMin = glm::min( asteroidMin, asteroid.meshes[ i ].bounds.min );
+        asteroidMax = glm::max( asteroidMax, asteroid.meshes[ i ].bounds.max );
+    }
     for ( int i = 0; i < asteroidCount; ++i )
     {
-        glm::mat4 asteroidModel = glm::mat4( 1.0f );
-        float32 angle = ( ( float32 ) i / ( float32 ) asteroidCount ) * 360.0f;
-        float32 displacement = ( rand() % ( int ) ( 2 * offset * 100 ) ) / 100.0f - offset;
-        float32 x = sin( angle ) * radius + displacement;
-        displacement = ( rand() % ( int ) ( 2 * offset * 100 ) ) / 100.0f - offset;
-        float32 y = displacement * 0.4f;
-        displacement = ( rand() % ( int ) ( 2 * offset * 100 ) ) / 100.0f - offset;
-        float32 z = cos( angle ) * radius + displacement;
-        asteroidModel = glm::translate( asteroidModel, glm::vec3( x, y, z ) );
-
-        float32 scale = ( rand() % 20 ) / 100.0f + 0.05f;
-        asteroidModel = glm::scale( asteroidModel, glm::vec3( scale ) );
-
-        float32 rotation = ( float32 ) ( rand() % 360 );
-        asteroidModel = glm::rotate( asteroidModel, rotation, glm::vec3( 0.4f, 0.6f, 0.8f ) );
-
-        asteroidMatrices[ i ] = asteroidModel;
+        TransformBox( GetInstanceMatrix( asteroidInstances[ i ] ), asteroidMin, asteroidMax, &sceneItemsMin[ i ], &sceneItemsMax[ i ] );
     }
-
-    u32 asteroidBuffer;
-    glGenBuffers( 1, &asteroidBuffer );
-    glBindBuffer( GL_ARRAY_BUFFER, asteroidBuffer );
-    glBufferData( GL_ARRAY_BUFFER, asteroidCount * sizeof( glm::mat4 ), asteroidMatrices, GL_STATIC_DRAW );
-
-    for ( int i = 0; i < asteroid.meshesCount; ++i )
+    for ( int i = 0; i < planet.meshesCount; ++i )
     {
-        u32 vao = asteroid.meshes[ i ].vao;
-        glBindVertexArray( vao );
-        u32 vec4Size = sizeof( glm::vec4 );
-        glEnableVertexAttribArray( 3 );
-        glVertexAttribPointer( 3, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, ( void * ) 0 );
-        glEnableVertexAttribArray( 4 );
-        glVertexAttribPointer( 4, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, ( void * ) ( 1 * vec4Size ) );
-        glEnableVertexAttribArray( 5 );
-        glVertexAttribPointer( 5, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, ( void * ) ( 2 * vec4Size ) );
-        glEnableVertexAttribArray( 6 );
-        glVertexAttribPointer( 6, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, ( void * ) ( 3 * vec4Size ) );
-
-        glVertexAttribDivisor( 3, 1 );
-        glVertexAttribDivisor( 4, 1 );
-        glVertexAttribDivisor( 5, 1 );
-        glVertexAttribDivisor( 6, 1 );
-
-        glBindVertexArray( 0 );
+        TransformBox( planetTransform, planet.meshes[ i ].bounds.min, planet.meshes[ i ].bounds.max,
+                      &sceneItemsMin[ asteroidCount + i ], &sceneItemsMax[ asteroidCount + i ] );
     }
+    Bvh sceneBvh = BuildBvh( sceneItemsMin, sceneItemsMax, sceneItemsCount, jobQueue );
 
     u32 fbo;
     glGenFramebuffers( 1, &fbo );
@@ -456,7 +537,7 @@ int main()
 
     char *cubemapFaces[ 6 ] = { "skybox/right.jpg", "skybox/left.jpg", "skybox/top.jpg",
                                 "skybox/bottom.jpg", "skybox/front.jpg", "skybox/back.jpg" };
-    u32 cubemapTexture = loadCubemap( cubemapFaces );
+    u32 cubemapTexture = loadCubemap( cubemapFaces, jobQueue );
 
     glEnable( GL_DEPTH_TEST );
     // glEnable( GL_STENCIL_TEST );
@@ -466,12 +547,49 @@ int main()
     glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
     // glCullFace( GL_FRONT ); //GL_BACK is default
     // glPolygonMode( GL_FRONT_AND_BACK, GL_LINE ); //Wireframe
+    //@NOTE: The culled mesh count of one frame is printed every second
+    Draw_Stats drawStats = {};
+    float32 lastStatsTime = 0.0f;
+
     while ( !glfwWindowShouldClose( window ) )
     {
         float32 currentFrame = ( float32 ) glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
         ProcessInput( window );
+        drawStats = {};
+
+        if ( pickRequested )
+        {
+            //@NOTE: The orbits move every frame, so their tree is only built when a pick needs it. Refitting the
+            // static tree instead would keep the layout of the belt, which gets looser as the orbits shear apart.
+            Bvh orbitBvh = {};
+            Bvh *pickBvh = &sceneBvh;
+            if ( orbitingAsteroids )
+            {
+                GetOrbitInstanceBoxes( asteroidOrbitsData, asteroidCount, currentFrame, asteroidMin, asteroidMax, sceneItemsMin, sceneItemsMax,
+                                       jobQueue );
+                orbitBvh = BuildBvh( sceneItemsMin, sceneItemsMax, sceneItemsCount, jobQueue );
+                pickBvh = &orbitBvh;
+            }
+
+            float32 pickDistance;
+            int picked = RaycastBvh( pickBvh, camera.position, camera.front, 1000.0f, &pickDistance );
+            if ( picked < 0 )
+            {
+                u32 nearest;
+                float32 nearestDistance;
+                if ( FindBvhNearest( pickBvh, camera.position, 1, &nearest, &nearestDistance ) && nearest < ( u32 ) asteroidCount )
+                {
+                    printf( "Picked nothing, closest asteroid %u is %.2f away\n", nearest, nearestDistance );
+                }
+                else { printf( "Picked nothing\n" ); }
+            }
+            else if ( picked < asteroidCount ) { printf( "Picked asteroid %d at %.2f\n", picked, pickDistance ); }
+            else { printf( "Picked planet mesh %d at %.2f\n", picked - asteroidCount, pickDistance ); }
+
+            if ( orbitingAsteroids ) { FreeBvh( &orbitBvh ); }
+        }
 
         // glBindFramebuffer( GL_FRAMEBUFFER, fbo );
         glClearColor( 0.4f, 0.4f, 0.4f, 1.0f );
@@ -493,31 +611,66 @@ int main()
 
         glm::mat4 model = glm::mat4( 1.0f );
         model = glm::scale( model, glm::vec3( 4.0f, 4.0f, 4.0f ) );
-        ShaderSetMat4( modelShader, "model", glm::value_ptr( model ) );
 
         // glStencilFunc( GL_ALWAYS, 1, 0xff );
         // glStencilMask( 0xff );
         glActiveTexture( GL_TEXTURE5 );
         ShaderSetInt( modelShader, "skybox", 5 );
         glBindTexture( GL_TEXTURE_CUBE_MAP, cubemapTexture );
-        // DrawModel( backpack, modelShader );
+        //@NOTE: Rendered before the first draw, so the model draws of the CPU path test their meshes against it too
+        bool cpuOcclusion = !orbitingAsteroids && !gpuInstanceCulling;
+        if ( cpuOcclusion ) { RenderOccluders( &occlusionBuffer, &planetOccluder, &model, 1, projection * view, jobQueue ); }
+        Occlusion_Buffer *modelOcclusion = cpuOcclusion ? &occlusionBuffer : 0;
+
+        // DrawModel( backpack, modelShader, model, projection * view, &drawStats, modelOcclusion );
 
-        DrawModel( planet, modelShader );
+        //@NOTE: The GPU path occludes the planet meshlets with the Hi-Z pyramid of the asteroids, in the same two phases
+        Gpu_Culling_Phase planetPhase = gpuInstanceCulling && !orbitingAsteroids ? GPU_CULLING_EARLY : GPU_CULLING_ALL;
+        DrawModelMeshlets( planet, modelShader, &meshletCuller, model, projection * view, camera.position, &drawStats, modelOcclusion,
+                           planetPhase );
 
-        UseShader( instancedShader );
-        ShaderSetInt( instancedShader, "skybox", 5 );
-        ShaderSetVec3( instancedShader, "viewPosition", camera.position );
-        ShaderSetVec3( instancedShader, "spotLight.position", camera.position );
-        ShaderSetVec3( instancedShader, "spotLight.direction", camera.front );
+        Shader asteroidShader = orbitingAsteroids ? orbitShader : gpuInstanceCulling ? instancedIndirectShader : instancedShader;
+        UseShader( asteroidShader );
+        ShaderSetInt( asteroidShader, "skybox", 5 );
+        ShaderSetVec3( asteroidShader, "viewPosition", camera.position );
+        ShaderSetVec3( asteroidShader, "spotLight.position", camera.position );
+        ShaderSetVec3( asteroidShader, "spotLight.direction", camera.front );
 
         glActiveTexture( GL_TEXTURE0 );
         glBindTexture( GL_TEXTURE_2D, asteroid.loadedTextures[ 0 ].id );
-        ShaderSetInt( instancedShader, "material.texture_diffuse1", 0 );
-        for ( int i = 0; i < asteroid.meshesCount; ++i )
+        ShaderSetInt( asteroidShader, "material.texture_diffuse1", 0 );
+
+        if ( orbitingAsteroids )
         {
-            glBindVertexArray( asteroid.meshes[ i ].vao );
-            glDrawElementsInstanced( GL_TRIANGLES, asteroid.meshes[ i ].indicesCount, GL_UNSIGNED_INT, 0, asteroidCount );
-            glBindVertexArray( 0 );
+            DrawModelOrbits( &asteroidOrbits, asteroid, asteroidShader, currentFrame );
+        }
+        else if ( gpuInstanceCulling )
+        {
+            //@NOTE: The early planet meshlets are already in the depth buffer, so they occlude the asteroids as well
+            DrawModelGpuCulled( &asteroidGpuCulling, asteroid, asteroidShader, projection * view, camera.position,
+                                lodProjectionScale, lodPixelError, gpuCullingDistance, GPU_CULLING_EARLY );
+            BuildHiZ( &hiZ, windowWidth, windowHeight );
+            DrawModelGpuCulled( &asteroidGpuCulling, asteroid, asteroidShader, projection * view, camera.position,
+                                lodProjectionScale, lodPixelError, gpuCullingDistance, GPU_CULLING_LATE, &hiZ );
+
+            UseShader( modelShader );
+            DrawModelMeshlets( planet, modelShader, &meshletCuller, model, projection * view, camera.position, &drawStats, 0,
+                               GPU_CULLING_LATE, &hiZ );
+        }
+        else
+        {
+            Instance_Transform *asteroidRegion = BeginDynamicInstances( &asteroidBuffer );
+            CullInstances( &asteroidCulling, &asteroidBuckets, jobQueue, &asteroid, asteroidInstances, projection * view, camera.position,
+                           lodProjectionScale, lodPixelError, impostorDistance, &occlusionBuffer, asteroidRegion );
+            EndDynamicInstances( &asteroidBuffer );
+            int asteroidBase = GetDynamicInstancesBase( &asteroidBuffer );
+            DrawModelLodBuckets( asteroid, asteroidShader, &asteroidBuckets, asteroidBase );
+
+            UseShader( impostorShader );
+            ShaderSetVec3( impostorShader, "viewPosition", camera.position );
+            DrawImpostors( &asteroidImpostor, impostorShader, asteroidBase + asteroidBuckets.firsts[ LOD_IMPOSTOR_BUCKET ],
+                           asteroidBuckets.counts[ LOD_IMPOSTOR_BUCKET ] );
+            FenceDynamicInstances( &asteroidBuffer );
         }
 
         // glStencilFunc( GL_NOTEQUAL, 1, 0xff );
@@ -574,11 +727,26 @@ int main()
         //         glDrawArrays( GL_TRIANGLES, 0, 6 );
         //         glEnable( GL_DEPTH_TEST );
 
+        if ( currentFrame - lastStatsTime >= 1.0f )
+        {
+            printf( "Meshes drawn: %d, culled: %d, occluded: %d, instance buffer stalls: %d\n", drawStats.meshesDrawn, drawStats.meshesCulled,
+                    drawStats.meshesOccluded, asteroidBuffer.stalls );
+            lastStatsTime = currentFrame;
+        }
+
         glfwSwapBuffers( window );
         glfwPollEvents();
     }
 
     glDeleteFramebuffers( 1, &fbo );
+    FreeBvh( &sceneBvh );
+    free( sceneItemsMin );
+    free( sceneItemsMax );
+    FreeOrbitInstances( &asteroidOrbits );
+    free( asteroidOrbitsData );
+    FreeDynamicInstanceBuffer( &asteroidBuffer );
+    DestroyJobQueue( jobQueue );
+    UnmountPackage();
 
     glfwTerminate();
     return 0;
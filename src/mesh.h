@@ -1,7 +1,10 @@
 #pragma once
 #include <glm.hpp>
 #include <glad/glad.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "utils/utils.h"
 #include "shader.h"
 
@@ -12,6 +15,15 @@ struct Vertex
     glm::vec2 textureCoordinates;
 };
 
+//@NOTE: GPU only format made by CreateCompactMesh, decoded in the vertex shaders when compactVertices is set:
+// position = unorm16 * positionScale + positionOffset, normal = octahedral snorm16, UVs are half floats
+struct Compact_Vertex
+{
+    u16 position[ 4 ];
+    s16 normal[ 2 ];
+    u16 textureCoordinates[ 2 ];
+};
+
 enum Texture_Type
 {
     DIFFUSE,
@@ -25,6 +37,56 @@ struct Texture
     char path[ 128 ];
 };
 
+struct Texture_Reference
+{
+    Texture_Type type;
+    char path[ 128 ];
+};
+
+struct Meshlet;
+
+//@NOTE: Object space, the sphere is centered on the box and reaches the furthest vertex
+struct Mesh_Bounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center;
+    float32 radius;
+};
+
+#define MESH_MAX_LODS 5
+
+//@NOTE: Range of the index buffer drawn for one level of detail. Every level indexes the same vertices,
+// error is the object space deviation from the full detail mesh (see mesh_simplifier.h).
+struct Mesh_Lod
+{
+    u32 firstIndex;
+    u32 indexCount;
+    float32 error;
+};
+
+//@NOTE: CPU side mesh produced by the importers, turned into a Mesh by CreateMesh
+struct Mesh_Data
+{
+    Vertex *vertices;
+    int verticesCount;
+
+    u32 *indices;
+    int indicesCount;
+
+    Texture_Reference *textures;
+    int texturesCount;
+
+    Meshlet *meshlets;
+    int meshletsCount;
+
+    //@NOTE: 0 when the mesh wasn't simplified, otherwise lods[ 0 ] is the full detail mesh and the indices hold every level
+    Mesh_Lod lods[ MESH_MAX_LODS ];
+    int lodsCount;
+
+    Mesh_Bounds bounds;
+};
+
 struct Mesh
 {
     Vertex *vertices;
@@ -39,8 +101,44 @@ struct Mesh
     u32 vao;
     u32 vbo;
     u32 ebo;
+
+    //@NOTE: GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+    u32 indexType;
+    bool compact;
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+
+    //@NOTE: Shader storage buffer of Meshlet, 0 when the mesh wasn't split
+    u32 meshletBuffer;
+    int meshletsCount;
+
+    //@NOTE: u32 per meshlet, 1 when it passed the last late Hi-Z phase of DrawMeshMeshlets
+    u32 meshletVisibilityBuffer;
+
+    //@NOTE: At least one level covering all indices
+    Mesh_Lod lods[ MESH_MAX_LODS ];
+    int lodsCount;
+
+    Mesh_Bounds bounds;
 };
 
+inline Mesh_Bounds ComputeMeshBounds( Vertex *vertices, int verticesCount )
+{
+    Mesh_Bounds result = {};
+    for ( int i = 0; i < verticesCount; ++i )
+    {
+        result.min = i ? glm::min( result.min, vertices[ i ].position ) : vertices[ i ].position;
+        result.max = i ? glm::max( result.max, vertices[ i ].position ) : vertices[ i ].position;
+    }
+
+    result.center = ( result.min + result.max ) * 0.5f;
+    for ( int i = 0; i < verticesCount; ++i )
+    {
+        result.radius = glm::max( result.radius, glm::length( vertices[ i ].position - result.center ) );
+    }
+    return result;
+}
+
 Mesh CreateMesh( Vertex *vertices, int verticesCount, u32 *indices, int indicesCount, Texture *textures, int texturesCount )
 {
     Mesh result = {};
@@ -51,6 +149,8 @@ Mesh CreateMesh( Vertex *vertices, int verticesCount, u32 *indices, int indicesC
     result.indicesCount = indicesCount;
     result.textures = textures;
     result.texturesCount = texturesCount;
+    result.lods[ 0 ] = { 0, ( u32 ) indicesCount, 0.0f };
+    result.lodsCount = 1;
 
     glGenVertexArrays( 1, &result.vao );
     glGenBuffers( 1, &result.vbo );
@@ -62,6 +162,8 @@ Mesh CreateMesh( Vertex *vertices, int verticesCount, u32 *indices, int indicesC
 
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, result.ebo );
     glBufferData( GL_ELEMENT_ARRAY_BUFFER, indicesCount * sizeof( u32 ), indices, GL_STATIC_DRAW );
+    result.indexType = GL_UNSIGNED_INT;
+    result.positionScale = glm::vec3( 1.0f );
 
     glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, sizeof( Vertex ), 0 );
     glEnableVertexAttribArray( 0 );
@@ -77,7 +179,147 @@ Mesh CreateMesh( Vertex *vertices, int verticesCount, u32 *indices, int indicesC
     return result;
 }
 
-void DrawMesh( Mesh mesh, Shader shader )
+// Round to nearest even, denormals flush to zero, overflow goes to infinity
+inline u16 FloatToHalf( float32 value )
+{
+    u32 bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+
+    u32 sign = ( bits >> 16 ) & 0x8000;
+    u32 mantissa = bits & 0x7fffff;
+    s32 exponent = ( s32 ) ( ( bits >> 23 ) & 0xff ) - 127 + 15;
+
+    if ( ( ( bits >> 23 ) & 0xff ) == 0xff ) { return ( u16 ) ( sign | 0x7c00 | ( mantissa ? 0x200 : 0 ) ); }
+    if ( exponent <= 0 ) { return ( u16 ) sign; }
+    if ( exponent >= 31 ) { return ( u16 ) ( sign | 0x7c00 ); }
+
+    u32 result = sign | ( ( u32 ) exponent << 10 ) | ( mantissa >> 13 );
+    u32 remainder = mantissa & 0x1fff;
+    if ( remainder > 0x1000 || ( remainder == 0x1000 && ( result & 1 ) ) ) { ++result; }
+    return ( u16 ) result;
+}
+
+inline s16 FloatToSnorm16( float32 value )
+{
+    value = value < -1.0f ? -1.0f : ( value > 1.0f ? 1.0f : value );
+    return ( s16 ) ( value * 32767.0f + ( value >= 0.0f ? 0.5f : -0.5f ) );
+}
+
+// Projects the unit normal on the octahedron and unfolds the lower half over the corners of the square
+inline void EncodeOctahedral( glm::vec3 normal, s16 *result )
+{
+    float32 length = fabsf( normal.x ) + fabsf( normal.y ) + fabsf( normal.z );
+    if ( length == 0.0f ) { length = 1.0f; }
+
+    float32 x = normal.x / length;
+    float32 y = normal.y / length;
+    if ( normal.z < 0.0f )
+    {
+        float32 foldedX = ( 1.0f - fabsf( y ) ) * ( x >= 0.0f ? 1.0f : -1.0f );
+        float32 foldedY = ( 1.0f - fabsf( x ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+        x = foldedX;
+        y = foldedY;
+    }
+
+    result[ 0 ] = FloatToSnorm16( x );
+    result[ 1 ] = FloatToSnorm16( y );
+}
+
+// Same as CreateMesh but uploads 16 byte Compact_Vertex instead of the 32 byte Vertex, and 16 bit indices
+// when the mesh has few enough vertices. The float vertices stay on the CPU side mesh.
+Mesh CreateCompactMesh( Vertex *vertices, int verticesCount, u32 *indices, int indicesCount, Texture *textures, int texturesCount )
+{
+    Mesh result = {};
+
+    result.vertices = vertices;
+    result.verticesCount = verticesCount;
+    result.indices = indices;
+    result.indicesCount = indicesCount;
+    result.textures = textures;
+    result.texturesCount = texturesCount;
+    result.lods[ 0 ] = { 0, ( u32 ) indicesCount, 0.0f };
+    result.lodsCount = 1;
+    result.compact = true;
+
+    glm::vec3 boundsMin = verticesCount ? vertices[ 0 ].position : glm::vec3( 0.0f );
+    glm::vec3 boundsMax = boundsMin;
+    for ( int i = 1; i < verticesCount; ++i )
+    {
+        boundsMin = glm::min( boundsMin, vertices[ i ].position );
+        boundsMax = glm::max( boundsMax, vertices[ i ].position );
+    }
+
+    result.positionOffset = boundsMin;
+    result.positionScale = boundsMax - boundsMin;
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        if ( result.positionScale[ axis ] == 0.0f ) { result.positionScale[ axis ] = 1.0f; }
+    }
+
+    Compact_Vertex *compactVertices = ( Compact_Vertex * ) malloc( verticesCount * sizeof( Compact_Vertex ) );
+    defer { free( compactVertices ); };
+
+    for ( int i = 0; i < verticesCount; ++i )
+    {
+        Compact_Vertex *compact = &compactVertices[ i ];
+        glm::vec3 position = ( vertices[ i ].position - result.positionOffset ) / result.positionScale;
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            compact->position[ axis ] = ( u16 ) ( glm::clamp( position[ axis ], 0.0f, 1.0f ) * 65535.0f + 0.5f );
+        }
+        compact->position[ 3 ] = 0;
+
+        EncodeOctahedral( vertices[ i ].normal, compact->normal );
+        compact->textureCoordinates[ 0 ] = FloatToHalf( vertices[ i ].textureCoordinates.x );
+        compact->textureCoordinates[ 1 ] = FloatToHalf( vertices[ i ].textureCoordinates.y );
+    }
+
+    glGenVertexArrays( 1, &result.vao );
+    glGenBuffers( 1, &result.vbo );
+    glGenBuffers( 1, &result.ebo );
+
+    glBindVertexArray( result.vao );
+    glBindBuffer( GL_ARRAY_BUFFER, result.vbo );
+    glBufferData( GL_ARRAY_BUFFER, verticesCount * sizeof( Compact_Vertex ), compactVertices, GL_STATIC_DRAW );
+
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, result.ebo );
+    if ( verticesCount <= 0x10000 )
+    {
+        u16 *shortIndices = ( u16 * ) malloc( indicesCount * sizeof( u16 ) );
+        for ( int i = 0; i < indicesCount; ++i ) { shortIndices[ i ] = ( u16 ) indices[ i ]; }
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, indicesCount * sizeof( u16 ), shortIndices, GL_STATIC_DRAW );
+        free( shortIndices );
+        result.indexType = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, indicesCount * sizeof( u32 ), indices, GL_STATIC_DRAW );
+        result.indexType = GL_UNSIGNED_INT;
+    }
+
+    glVertexAttribPointer( 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof( Compact_Vertex ), 0 );
+    glEnableVertexAttribArray( 0 );
+    glVertexAttribPointer( 1, 2, GL_SHORT, GL_TRUE, sizeof( Compact_Vertex ), ( void * ) offsetof( Compact_Vertex, normal ) );
+    glEnableVertexAttribArray( 1 );
+    glVertexAttribPointer( 2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof( Compact_Vertex ), ( void * ) offsetof( Compact_Vertex, textureCoordinates ) );
+    glEnableVertexAttribArray( 2 );
+
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+
+    return result;
+}
+
+// Tells the vertex shader how to decode the mesh attributes, has to be set before every draw of the mesh
+inline void SetMeshVertexFormat( Mesh mesh, Shader shader )
+{
+    ShaderSetBool( shader, "compactVertices", mesh.compact );
+    ShaderSetVec3( shader, "positionOffset", mesh.positionOffset );
+    ShaderSetVec3( shader, "positionScale", mesh.positionScale );
+}
+
+void BindMeshTextures( Mesh mesh, Shader shader )
 {
     int diffuseNumber = 1;
     int specularNumber = 1;
@@ -106,8 +348,19 @@ void DrawMesh( Mesh mesh, Shader shader )
     }
 
     glActiveTexture( GL_TEXTURE0 );
+}
 
+inline void *GetMeshLodOffset( Mesh mesh, int lod )
+{
+    u32 indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof( u16 ) : sizeof( u32 );
+    return ( void * ) ( ( size_t ) mesh.lods[ lod ].firstIndex * indexSize );
+}
+
+void DrawMesh( Mesh mesh, Shader shader )
+{
+    BindMeshTextures( mesh, shader );
+    SetMeshVertexFormat( mesh, shader );
     glBindVertexArray( mesh.vao );
-    glDrawElements( GL_TRIANGLES, mesh.indicesCount, GL_UNSIGNED_INT, 0 );
+    glDrawElements( GL_TRIANGLES, mesh.lods[ 0 ].indexCount, mesh.indexType, 0 );
     glBindVertexArray( 0 );
 }
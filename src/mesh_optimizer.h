@@ -0,0 +1,322 @@
+#pragma once
+#include <glm.hpp>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "utils/utils.h"
+#include "mesh.h"
+
+// Import time mesh optimization, run on freshly imported Mesh_Data before it is cached or uploaded:
+//   weld identical vertices -> Tipsify triangle order for the post-transform cache (Sander et al. 2007) ->
+//   sort the Tipsify clusters outside-in to reduce overdraw -> renumber vertices in order of first use.
+// ACMR (cache misses per triangle, 0.5 is the ideal for a regular grid, 3 is the worst) is measured on a FIFO cache.
+
+#define MESH_OPTIMIZER_CACHE_SIZE 16
+
+internal float32 GetACMR( u32 *indices, int indicesCount, int verticesCount )
+{
+    if ( indicesCount == 0 ) { return 0.0f; }
+
+    //@NOTE: FIFO cache, a vertex is a hit while fewer than cache size misses happened since it was loaded
+    int *loadedAt = ( int * ) malloc( verticesCount * sizeof( int ) );
+    defer { free( loadedAt ); };
+    for ( int i = 0; i < verticesCount; ++i ) { loadedAt[ i ] = -MESH_OPTIMIZER_CACHE_SIZE - 1; }
+
+    int misses = 0;
+    for ( int i = 0; i < indicesCount; ++i )
+    {
+        u32 vertex = indices[ i ];
+        if ( misses - loadedAt[ vertex ] > MESH_OPTIMIZER_CACHE_SIZE )
+        {
+            loadedAt[ vertex ] = misses;
+            ++misses;
+        }
+    }
+    return ( float32 ) misses / ( float32 ) ( indicesCount / 3 );
+}
+
+inline u32 HashVertex( Vertex *vertex )
+{
+    u32 *words = ( u32 * ) vertex;
+    u32 hash = 2166136261u;
+    for ( int i = 0; i < ( int ) ( sizeof( Vertex ) / sizeof( u32 ) ); ++i )
+    {
+        hash = ( hash ^ words[ i ] ) * 16777619u;
+    }
+    return hash;
+}
+
+// Merges bitwise identical vertices, the vertex array is compacted in place
+internal void WeldVertices( Mesh_Data *mesh )
+{
+    u32 slotsCount = 16;
+    while ( slotsCount < ( u32 ) mesh->verticesCount * 2 ) { slotsCount *= 2; }
+
+    //@NOTE: A slot holds the welded vertex index + 1, 0 is empty
+    u32 *slots = ( u32 * ) calloc( slotsCount, sizeof( u32 ) );
+    u32 *remap = ( u32 * ) malloc( mesh->verticesCount * sizeof( u32 ) );
+    defer { free( slots ); free( remap ); };
+
+    int weldedCount = 0;
+    u32 mask = slotsCount - 1;
+    for ( int i = 0; i < mesh->verticesCount; ++i )
+    {
+        Vertex *vertex = &mesh->vertices[ i ];
+        u32 slot = HashVertex( vertex ) & mask;
+        while ( slots[ slot ] && memcmp( &mesh->vertices[ slots[ slot ] - 1 ], vertex, sizeof( Vertex ) ) != 0 )
+        {
+            slot = ( slot + 1 ) & mask;
+        }
+
+        if ( !slots[ slot ] )
+        {
+            mesh->vertices[ weldedCount ] = *vertex;
+            slots[ slot ] = ( u32 ) ++weldedCount;
+        }
+        remap[ i ] = slots[ slot ] - 1;
+    }
+
+    for ( int i = 0; i < mesh->indicesCount; ++i ) { mesh->indices[ i ] = remap[ mesh->indices[ i ] ]; }
+    mesh->verticesCount = weldedCount;
+}
+
+struct Triangle_Adjacency
+{
+    int *offsets;   // first triangle of every vertex in triangles, verticesCount + 1 entries
+    int *triangles;
+};
+
+internal Triangle_Adjacency BuildTriangleAdjacency( u32 *indices, int indicesCount, int verticesCount )
+{
+    Triangle_Adjacency result;
+    result.offsets = ( int * ) calloc( verticesCount + 1, sizeof( int ) );
+    result.triangles = ( int * ) malloc( indicesCount * sizeof( int ) );
+
+    for ( int i = 0; i < indicesCount; ++i ) { ++result.offsets[ indices[ i ] + 1 ]; }
+    for ( int i = 0; i < verticesCount; ++i ) { result.offsets[ i + 1 ] += result.offsets[ i ]; }
+
+    int *cursor = ( int * ) malloc( verticesCount * sizeof( int ) );
+    memcpy( cursor, result.offsets, verticesCount * sizeof( int ) );
+    for ( int i = 0; i < indicesCount; ++i ) { result.triangles[ cursor[ indices[ i ] ]++ ] = i / 3; }
+    free( cursor );
+    return result;
+}
+
+// Tipsify: fans around the vertex that is most likely still in the cache, falling back to recently used vertices
+// (the dead end stack) and then to the input order. Every fall back starts a new cluster, the first triangle of
+// each cluster is stored in clusters.
+internal void OptimizeVertexCache( u32 *indices, int indicesCount, int verticesCount, std::vector< int > *clusters )
+{
+    int trianglesCount = indicesCount / 3;
+    Triangle_Adjacency adjacency = BuildTriangleAdjacency( indices, indicesCount, verticesCount );
+
+    int *liveTriangles = ( int * ) malloc( verticesCount * sizeof( int ) );
+    int *cacheTime = ( int * ) calloc( verticesCount, sizeof( int ) );
+    bool *emitted = ( bool * ) calloc( trianglesCount, sizeof( bool ) );
+    u32 *result = ( u32 * ) malloc( indicesCount * sizeof( u32 ) );
+    defer { free( adjacency.offsets ); free( adjacency.triangles ); free( liveTriangles ); free( cacheTime ); free( emitted ); free( result ); };
+
+    for ( int i = 0; i < verticesCount; ++i ) { liveTriangles[ i ] = adjacency.offsets[ i + 1 ] - adjacency.offsets[ i ]; }
+
+    std::vector< u32 > deadEnds;
+    std::vector< u32 > candidates;
+    int time = MESH_OPTIMIZER_CACHE_SIZE + 1;
+    int resultCount = 0;
+    int inputCursor = 0;
+
+    int fanning = verticesCount ? 0 : -1;
+    while ( fanning >= 0 && liveTriangles[ fanning ] == 0 ) { fanning = fanning + 1 < verticesCount ? fanning + 1 : -1; }
+    if ( fanning >= 0 ) { clusters->push_back( 0 ); }
+
+    while ( fanning >= 0 )
+    {
+        candidates.clear();
+        for ( int i = adjacency.offsets[ fanning ]; i < adjacency.offsets[ fanning + 1 ]; ++i )
+        {
+            int triangle = adjacency.triangles[ i ];
+            if ( emitted[ triangle ] ) { continue; }
+
+            for ( int j = 0; j < 3; ++j )
+            {
+                u32 vertex = indices[ triangle * 3 + j ];
+                result[ resultCount++ ] = vertex;
+                deadEnds.push_back( vertex );
+                candidates.push_back( vertex );
+                --liveTriangles[ vertex ];
+                if ( time - cacheTime[ vertex ] > MESH_OPTIMIZER_CACHE_SIZE )
+                {
+                    cacheTime[ vertex ] = time;
+                    ++time;
+                }
+            }
+            emitted[ triangle ] = true;
+        }
+
+        // Prefer the candidate that is oldest in the cache but will still be in it after fanning around it
+        int next = -1;
+        int bestPriority = -1;
+        for ( u32 vertex : candidates )
+        {
+            if ( liveTriangles[ vertex ] == 0 ) { continue; }
+
+            int priority = 0;
+            if ( time - cacheTime[ vertex ] + 2 * liveTriangles[ vertex ] <= MESH_OPTIMIZER_CACHE_SIZE )
+            {
+                priority = time - cacheTime[ vertex ];
+            }
+            if ( priority > bestPriority )
+            {
+                bestPriority = priority;
+                next = ( int ) vertex;
+            }
+        }
+
+        if ( next < 0 )
+        {
+            while ( !deadEnds.empty() && next < 0 )
+            {
+                u32 vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if ( liveTriangles[ vertex ] > 0 ) { next = ( int ) vertex; }
+            }
+            while ( next < 0 && inputCursor < verticesCount )
+            {
+                if ( liveTriangles[ inputCursor ] > 0 ) { next = inputCursor; }
+                ++inputCursor;
+            }
+            if ( next >= 0 && resultCount < indicesCount ) { clusters->push_back( resultCount / 3 ); }
+        }
+        fanning = next;
+    }
+
+    Assert( resultCount == indicesCount );
+    memcpy( indices, result, indicesCount * sizeof( u32 ) );
+}
+
+struct Overdraw_Cluster
+{
+    int firstTriangle;
+    int trianglesCount;
+    glm::vec3 center;
+    glm::vec3 normal;
+    float32 sortKey;
+};
+
+// Draws clusters facing away from the mesh center first, outer surfaces then occlude the inner ones.
+// The key is the view independent measure from the Tipsify paper: dot( cluster center - mesh center, cluster normal ).
+internal void OptimizeOverdraw( Vertex *vertices, u32 *indices, int indicesCount, std::vector< int > *clusters )
+{
+    int trianglesCount = indicesCount / 3;
+    int clustersCount = ( int ) clusters->size();
+    if ( clustersCount < 2 ) { return; }
+
+    std::vector< Overdraw_Cluster > sorted( clustersCount );
+    glm::vec3 meshCenter( 0.0f );
+    float32 meshArea = 0.0f;
+
+    for ( int i = 0; i < clustersCount; ++i )
+    {
+        Overdraw_Cluster *cluster = &sorted[ i ];
+        cluster->firstTriangle = ( *clusters )[ i ];
+        cluster->trianglesCount = ( i + 1 < clustersCount ? ( *clusters )[ i + 1 ] : trianglesCount ) - cluster->firstTriangle;
+
+        glm::vec3 center( 0.0f );
+        glm::vec3 normal( 0.0f );
+        float32 area = 0.0f;
+        for ( int triangle = cluster->firstTriangle; triangle < cluster->firstTriangle + cluster->trianglesCount; ++triangle )
+        {
+            glm::vec3 a = vertices[ indices[ triangle * 3 + 0 ] ].position;
+            glm::vec3 b = vertices[ indices[ triangle * 3 + 1 ] ].position;
+            glm::vec3 c = vertices[ indices[ triangle * 3 + 2 ] ].position;
+
+            glm::vec3 crossProduct = glm::cross( b - a, c - a );
+            float32 triangleArea = glm::length( crossProduct ) * 0.5f;
+            center += ( a + b + c ) * ( triangleArea / 3.0f );
+            normal += crossProduct;
+            area += triangleArea;
+        }
+
+        meshCenter += center;
+        meshArea += area;
+
+        float32 normalLength = glm::length( normal );
+        cluster->center = area > 0.0f ? center / area : vertices[ indices[ cluster->firstTriangle * 3 ] ].position;
+        cluster->normal = normalLength > 0.0f ? normal / normalLength : normal;
+    }
+
+    if ( meshArea > 0.0f ) { meshCenter /= meshArea; }
+    for ( Overdraw_Cluster &cluster : sorted )
+    {
+        cluster.sortKey = glm::dot( cluster.center - meshCenter, cluster.normal );
+    }
+
+    std::stable_sort( sorted.begin(), sorted.end(),
+                      []( const Overdraw_Cluster &a, const Overdraw_Cluster &b ) { return a.sortKey > b.sortKey; } );
+
+    u32 *result = ( u32 * ) malloc( indicesCount * sizeof( u32 ) );
+    int resultCount = 0;
+    for ( Overdraw_Cluster &cluster : sorted )
+    {
+        memcpy( result + resultCount, indices + cluster.firstTriangle * 3, cluster.trianglesCount * 3 * sizeof( u32 ) );
+        resultCount += cluster.trianglesCount * 3;
+    }
+    memcpy( indices, result, indicesCount * sizeof( u32 ) );
+    free( result );
+}
+
+// Renumbers vertices in the order the index buffer first references them, so fetches walk memory forward.
+// Unreferenced vertices are dropped.
+internal void OptimizeVertexFetch( Mesh_Data *mesh )
+{
+    u32 *remap = ( u32 * ) malloc( mesh->verticesCount * sizeof( u32 ) );
+    Vertex *vertices = ( Vertex * ) malloc( mesh->verticesCount * sizeof( Vertex ) );
+    memset( remap, 0xff, mesh->verticesCount * sizeof( u32 ) );
+
+    u32 verticesCount = 0;
+    for ( int i = 0; i < mesh->indicesCount; ++i )
+    {
+        u32 vertex = mesh->indices[ i ];
+        if ( remap[ vertex ] == 0xffffffff )
+        {
+            vertices[ verticesCount ] = mesh->vertices[ vertex ];
+            remap[ vertex ] = verticesCount++;
+        }
+        mesh->indices[ i ] = remap[ vertex ];
+    }
+
+    memcpy( mesh->vertices, vertices, verticesCount * sizeof( Vertex ) );
+    mesh->verticesCount = ( int ) verticesCount;
+    free( vertices );
+    free( remap );
+}
+
+struct Mesh_Optimization_Stats
+{
+    int verticesBefore;
+    int verticesAfter;
+    float32 acmrBefore;
+    float32 acmrAfter;
+};
+
+// Mesh data has to be owned by the caller (not pointing into a cache mapping)
+internal Mesh_Optimization_Stats OptimizeMesh( Mesh_Data *mesh )
+{
+    Mesh_Optimization_Stats stats = {};
+    stats.verticesBefore = mesh->verticesCount;
+    stats.acmrBefore = GetACMR( mesh->indices, mesh->indicesCount, mesh->verticesCount );
+
+    if ( mesh->indicesCount >= 3 )
+    {
+        WeldVertices( mesh );
+
+        std::vector< int > clusters;
+        OptimizeVertexCache( mesh->indices, mesh->indicesCount, mesh->verticesCount, &clusters );
+        OptimizeOverdraw( mesh->vertices, mesh->indices, mesh->indicesCount, &clusters );
+        OptimizeVertexFetch( mesh );
+    }
+
+    stats.verticesAfter = mesh->verticesCount;
+    stats.acmrAfter = GetACMR( mesh->indices, mesh->indicesCount, mesh->verticesCount );
+    return stats;
+}
@@ -0,0 +1,336 @@
+#pragma once
+#include <glm.hpp>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "utils/utils.h"
+#include "mesh.h"
+#include "mesh_optimizer.h"
+
+// Import time level of detail generation with quadric error metrics (Garland and Heckbert 1997).
+// Every vertex accumulates the planes of its triangles. Edges are collapsed onto one of their endpoints,
+// cheapest first, so the simplified levels only need new indices and share the vertex buffer of the
+// full detail mesh. Vertices on UV/normal seams and open borders never move, which keeps the texture
+// mapping and the silhouette of open meshes intact at the cost of some reduction on heavily seamed meshes.
+
+//@NOTE: Each level targets this fraction of the triangles of the previous one
+#define MESH_SIMPLIFIER_LOD_RATIO 0.5f
+
+//@NOTE: Symmetric 4x4 matrix of the summed planes, error( p ) = p A p + 2 b p + c, weighted by triangle area
+struct Quadric
+{
+    float32 a00, a11, a22, a01, a02, a12;
+    float32 b0, b1, b2;
+    float32 c;
+    float32 weight;
+};
+
+inline Quadric GetPlaneQuadric( glm::vec3 normal, float32 distance, float32 weight )
+{
+    Quadric result;
+    result.a00 = normal.x * normal.x * weight;
+    result.a11 = normal.y * normal.y * weight;
+    result.a22 = normal.z * normal.z * weight;
+    result.a01 = normal.x * normal.y * weight;
+    result.a02 = normal.x * normal.z * weight;
+    result.a12 = normal.y * normal.z * weight;
+    result.b0 = normal.x * distance * weight;
+    result.b1 = normal.y * distance * weight;
+    result.b2 = normal.z * distance * weight;
+    result.c = distance * distance * weight;
+    result.weight = weight;
+    return result;
+}
+
+inline void AddQuadric( Quadric *quadric, Quadric *other )
+{
+    quadric->a00 += other->a00;
+    quadric->a11 += other->a11;
+    quadric->a22 += other->a22;
+    quadric->a01 += other->a01;
+    quadric->a02 += other->a02;
+    quadric->a12 += other->a12;
+    quadric->b0 += other->b0;
+    quadric->b1 += other->b1;
+    quadric->b2 += other->b2;
+    quadric->c += other->c;
+    quadric->weight += other->weight;
+}
+
+// Area weighted mean of the squared distances to the planes
+inline float32 GetQuadricError( Quadric *quadric, glm::vec3 p )
+{
+    float32 result = quadric->a00 * p.x * p.x + quadric->a11 * p.y * p.y + quadric->a22 * p.z * p.z +
+                     2.0f * ( quadric->a01 * p.x * p.y + quadric->a02 * p.x * p.z + quadric->a12 * p.y * p.z ) +
+                     2.0f * ( quadric->b0 * p.x + quadric->b1 * p.y + quadric->b2 * p.z ) + quadric->c;
+    return quadric->weight > 0.0f ? fabsf( result ) / quadric->weight : 0.0f;
+}
+
+struct Edge_Collapse
+{
+    u32 from;
+    u32 to;
+    float32 cost;
+};
+
+inline u64 GetEdgeKey( u32 from, u32 to )
+{
+    return ( ( u64 ) from << 32 ) | to;
+}
+
+// Seam vertices share their position with another vertex, border vertices sit on an edge with a single triangle.
+// Neither can be collapsed without tearing the mesh.
+internal void FindLockedVertices( glm::vec3 *positions, u32 *indices, int indicesCount, int verticesCount, u8 *locked )
+{
+    u32 *canonical = ( u32 * ) malloc( verticesCount * sizeof( u32 ) );
+    defer { free( canonical ); };
+
+    u32 tableSize = 1;
+    while ( tableSize < ( u32 ) verticesCount * 2 ) { tableSize *= 2; }
+    u32 *table = ( u32 * ) malloc( tableSize * sizeof( u32 ) );
+    defer { free( table ); };
+    memset( table, 0xff, tableSize * sizeof( u32 ) );
+
+    for ( int i = 0; i < verticesCount; ++i )
+    {
+        u32 bits[ 3 ];
+        memcpy( bits, &positions[ i ], sizeof( bits ) );
+        u32 slot = ( bits[ 0 ] * 73856093u ^ bits[ 1 ] * 19349663u ^ bits[ 2 ] * 83492791u ) & ( tableSize - 1 );
+        while ( table[ slot ] != 0xffffffff && memcmp( &positions[ table[ slot ] ], &positions[ i ], sizeof( glm::vec3 ) ) != 0 )
+        {
+            slot = ( slot + 1 ) & ( tableSize - 1 );
+        }
+
+        if ( table[ slot ] == 0xffffffff )
+        {
+            table[ slot ] = ( u32 ) i;
+            canonical[ i ] = ( u32 ) i;
+        }
+        else
+        {
+            canonical[ i ] = table[ slot ];
+            locked[ i ] = 1;
+            locked[ table[ slot ] ] = 1;
+        }
+    }
+
+    //@NOTE: Directed edges between positions, an edge without its reverse belongs to a single triangle
+    u64 *edges = ( u64 * ) malloc( indicesCount * sizeof( u64 ) );
+    defer { free( edges ); };
+    for ( int i = 0; i < indicesCount; ++i )
+    {
+        int next = i % 3 == 2 ? i - 2 : i + 1;
+        edges[ i ] = GetEdgeKey( canonical[ indices[ i ] ], canonical[ indices[ next ] ] );
+    }
+    std::sort( edges, edges + indicesCount );
+
+    for ( int i = 0; i < indicesCount; ++i )
+    {
+        u32 from = ( u32 ) ( edges[ i ] >> 32 );
+        u32 to = ( u32 ) edges[ i ];
+        if ( !std::binary_search( edges, edges + indicesCount, GetEdgeKey( to, from ) ) )
+        {
+            locked[ from ] = 1;
+            locked[ to ] = 1;
+        }
+    }
+
+    //@NOTE: Borders were found between canonical vertices, spread them to the other copies of the position
+    for ( int i = 0; i < verticesCount; ++i )
+    {
+        if ( locked[ canonical[ i ] ] ) { locked[ i ] = 1; }
+    }
+}
+
+// Moving from onto to must not flip or collapse any of the triangles that stay
+internal bool IsCollapseValid( glm::vec3 *positions, u32 *indices, Triangle_Adjacency *adjacency, u32 *remap, u32 from, u32 to )
+{
+    for ( int i = adjacency->offsets[ from ]; i < adjacency->offsets[ from + 1 ]; ++i )
+    {
+        u32 *triangle = indices + adjacency->triangles[ i ] * 3;
+        u32 corners[ 3 ] = { remap[ triangle[ 0 ] ], remap[ triangle[ 1 ] ], remap[ triangle[ 2 ] ] };
+        if ( corners[ 0 ] == to || corners[ 1 ] == to || corners[ 2 ] == to ) { continue; }
+
+        glm::vec3 before = glm::cross( positions[ corners[ 1 ] ] - positions[ corners[ 0 ] ], positions[ corners[ 2 ] ] - positions[ corners[ 0 ] ] );
+        for ( int j = 0; j < 3; ++j )
+        {
+            if ( corners[ j ] == from ) { corners[ j ] = to; }
+        }
+        glm::vec3 after = glm::cross( positions[ corners[ 1 ] ] - positions[ corners[ 0 ] ], positions[ corners[ 2 ] ] - positions[ corners[ 0 ] ] );
+
+        float32 lengths = glm::length( before ) * glm::length( after );
+        if ( lengths == 0.0f || glm::dot( before, after ) < 0.25f * lengths ) { return false; }
+    }
+    return true;
+}
+
+// Collapses edges until the triangles are down to targetIndicesCount or nothing can be collapsed anymore.
+// Writes at most indicesCount indices to result and returns how many, error is in the units of the positions.
+internal int SimplifyMesh( u32 *result, u32 *indices, int indicesCount, Vertex *vertices, int verticesCount, int targetIndicesCount,
+                           float32 *resultError )
+{
+    *resultError = 0.0f;
+    memcpy( result, indices, indicesCount * sizeof( u32 ) );
+    if ( indicesCount <= targetIndicesCount || verticesCount == 0 ) { return indicesCount; }
+
+    //@NOTE: Work in the unit cube so the float quadrics keep their precision on large meshes
+    glm::vec3 boundsMin = vertices[ 0 ].position;
+    glm::vec3 boundsMax = boundsMin;
+    for ( int i = 1; i < verticesCount; ++i )
+    {
+        boundsMin = glm::min( boundsMin, vertices[ i ].position );
+        boundsMax = glm::max( boundsMax, vertices[ i ].position );
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    float32 scale = glm::max( extent.x, glm::max( extent.y, extent.z ) );
+    if ( scale == 0.0f ) { return indicesCount; }
+
+    glm::vec3 *positions = ( glm::vec3 * ) malloc( verticesCount * sizeof( glm::vec3 ) );
+    defer { free( positions ); };
+    for ( int i = 0; i < verticesCount; ++i ) { positions[ i ] = ( vertices[ i ].position - boundsMin ) / scale; }
+
+    u8 *locked = ( u8 * ) calloc( verticesCount, sizeof( u8 ) );
+    defer { free( locked ); };
+    FindLockedVertices( positions, indices, indicesCount, verticesCount, locked );
+
+    Quadric *quadrics = ( Quadric * ) calloc( verticesCount, sizeof( Quadric ) );
+    defer { free( quadrics ); };
+    for ( int i = 0; i < indicesCount; i += 3 )
+    {
+        glm::vec3 a = positions[ indices[ i ] ];
+        glm::vec3 normal = glm::cross( positions[ indices[ i + 1 ] ] - a, positions[ indices[ i + 2 ] ] - a );
+        float32 length = glm::length( normal );
+        if ( length == 0.0f ) { continue; }
+
+        normal /= length;
+        Quadric plane = GetPlaneQuadric( normal, -glm::dot( normal, a ), length * 0.5f );
+        for ( int j = 0; j < 3; ++j ) { AddQuadric( &quadrics[ indices[ i + j ] ], &plane ); }
+    }
+
+    u32 *remap = ( u32 * ) malloc( verticesCount * sizeof( u32 ) );
+    defer { free( remap ); };
+    u8 *collapsed = ( u8 * ) malloc( verticesCount * sizeof( u8 ) );
+    defer { free( collapsed ); };
+
+    std::vector< Edge_Collapse > collapses;
+    float32 maxCost = 0.0f;
+    int count = indicesCount;
+
+    //@NOTE: Every pass collapses each vertex at most once, so the adjacency built at its start stays valid
+    while ( count > targetIndicesCount )
+    {
+        Triangle_Adjacency adjacency = BuildTriangleAdjacency( result, count, verticesCount );
+        defer
+        {
+            free( adjacency.offsets );
+            free( adjacency.triangles );
+        };
+
+        collapses.clear();
+        for ( int i = 0; i < count; ++i )
+        {
+            u32 from = result[ i ];
+            u32 to = result[ i % 3 == 2 ? i - 2 : i + 1 ];
+            for ( int direction = 0; direction < 2; ++direction )
+            {
+                if ( !locked[ from ] )
+                {
+                    Quadric quadric = quadrics[ from ];
+                    AddQuadric( &quadric, &quadrics[ to ] );
+                    collapses.push_back( { from, to, GetQuadricError( &quadric, positions[ to ] ) } );
+                }
+                std::swap( from, to );
+            }
+        }
+        std::sort( collapses.begin(), collapses.end(), []( const Edge_Collapse &a, const Edge_Collapse &b ) { return a.cost < b.cost; } );
+
+        for ( int i = 0; i < verticesCount; ++i ) { remap[ i ] = ( u32 ) i; }
+        memset( collapsed, 0, verticesCount );
+
+        int removedTriangles = 0;
+        int targetRemoved = ( count - targetIndicesCount ) / 3;
+        for ( Edge_Collapse &collapse : collapses )
+        {
+            if ( removedTriangles >= targetRemoved ) { break; }
+            if ( collapsed[ collapse.from ] || collapsed[ collapse.to ] ) { continue; }
+            if ( !IsCollapseValid( positions, result, &adjacency, remap, collapse.from, collapse.to ) ) { continue; }
+
+            for ( int i = adjacency.offsets[ collapse.from ]; i < adjacency.offsets[ collapse.from + 1 ]; ++i )
+            {
+                u32 *triangle = result + adjacency.triangles[ i ] * 3;
+                if ( remap[ triangle[ 0 ] ] == collapse.to || remap[ triangle[ 1 ] ] == collapse.to || remap[ triangle[ 2 ] ] == collapse.to )
+                {
+                    ++removedTriangles;
+                }
+            }
+
+            remap[ collapse.from ] = collapse.to;
+            AddQuadric( &quadrics[ collapse.to ], &quadrics[ collapse.from ] );
+            collapsed[ collapse.from ] = 1;
+            collapsed[ collapse.to ] = 1;
+            maxCost = glm::max( maxCost, collapse.cost );
+        }
+
+        if ( removedTriangles == 0 ) { break; }
+
+        int written = 0;
+        for ( int i = 0; i < count; i += 3 )
+        {
+            u32 a = remap[ result[ i ] ];
+            u32 b = remap[ result[ i + 1 ] ];
+            u32 c = remap[ result[ i + 2 ] ];
+            if ( a == b || b == c || c == a ) { continue; }
+
+            result[ written++ ] = a;
+            result[ written++ ] = b;
+            result[ written++ ] = c;
+        }
+        count = written;
+    }
+
+    *resultError = sqrtf( maxCost ) * scale;
+    return count;
+}
+
+// Appends MESH_MAX_LODS - 1 simplified index lists after the full detail indices, each one simplified from the
+// level before it. Levels that couldn't be reduced further repeat the previous range. Mesh data has to be owned
+// by the caller, the same as for OptimizeMesh.
+internal void GenerateMeshLods( Mesh_Data *mesh )
+{
+    int baseCount = mesh->indicesCount;
+    mesh->lods[ 0 ] = { 0, ( u32 ) baseCount, 0.0f };
+    mesh->lodsCount = 1;
+    if ( baseCount < 3 ) { return; }
+
+    u32 *simplified = ( u32 * ) malloc( baseCount * sizeof( u32 ) );
+    defer { free( simplified ); };
+
+    std::vector< int > clusters;
+    for ( int level = 1; level < MESH_MAX_LODS; ++level )
+    {
+        Mesh_Lod previous = mesh->lods[ level - 1 ];
+        int target = ( int ) ( previous.indexCount / 3 * MESH_SIMPLIFIER_LOD_RATIO ) * 3;
+
+        float32 error;
+        int count = SimplifyMesh( simplified, mesh->indices + previous.firstIndex, ( int ) previous.indexCount, mesh->vertices,
+                                  mesh->verticesCount, target, &error );
+
+        if ( count == ( int ) previous.indexCount || count == 0 )
+        {
+            mesh->lods[ mesh->lodsCount++ ] = previous;
+            continue;
+        }
+
+        clusters.clear();
+        OptimizeVertexCache( simplified, count, mesh->verticesCount, &clusters );
+
+        mesh->indices = ( u32 * ) realloc( mesh->indices, ( mesh->indicesCount + count ) * sizeof( u32 ) );
+        memcpy( mesh->indices + mesh->indicesCount, simplified, count * sizeof( u32 ) );
+
+        //@NOTE: Simplified from the previous level, so the deviations add up
+        mesh->lods[ mesh->lodsCount++ ] = { ( u32 ) mesh->indicesCount, ( u32 ) count, previous.error + error };
+        mesh->indicesCount += count;
+    }
+}
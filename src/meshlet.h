@@ -0,0 +1,306 @@
+#pragma once
+#include <glm.hpp>
+#include <gtc/type_ptr.hpp>
+#include <glad/glad.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils/utils.h"
+#include "mesh.h"
+#include "shader.h"
+#include "frustum.h"
+#include "hi_z.h"
+
+// Meshlets: the index buffer is cut into runs of at most 64 unique vertices and 124 triangles, in the order the
+// optimizer left it, so every meshlet is a contiguous range of the existing index buffer. Each one carries a bounding
+// sphere and a normal cone. meshlet_cull.comp tests them against the frustum and the cone, and appends a
+// DrawElementsIndirectCommand for every survivor. With glMultiDrawElementsIndirectCount the draw reads the number of
+// survivors from the buffer and only submits those. Without it every command slot is submitted, and the culled slots
+// are zeroed so they draw nothing.
+//
+// With a Hi-Z pyramid the meshlets are occlusion culled in the same two phases as DrawModelGpuCulled: the early phase
+// draws the meshlets that were visible last frame, the late phase tests the rest against the pyramid built after it.
+
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 124
+
+//@NOTE: GL 4.6 and ARB_indirect_parameters, glad was generated for 4.3 and knows neither
+#ifndef GL_PARAMETER_BUFFER
+    #define GL_PARAMETER_BUFFER 0x80EE
+#endif
+
+typedef void ( APIENTRYP Multi_Draw_Elements_Indirect_Count_Proc )( GLenum mode, GLenum type, const void *indirect, GLintptr drawCount,
+                                                                    GLsizei maxDrawCount, GLsizei stride );
+global_variable Multi_Draw_Elements_Indirect_Count_Proc glMultiDrawElementsIndirectCountProc;
+
+// Loads glMultiDrawElementsIndirectCount when the context has it, has to run after gladLoadGLLoader
+internal bool LoadMultiDrawIndirectCount( GLADloadproc load )
+{
+    int major, minor;
+    glGetIntegerv( GL_MAJOR_VERSION, &major );
+    glGetIntegerv( GL_MINOR_VERSION, &minor );
+    if ( major > 4 || ( major == 4 && minor >= 6 ) )
+    {
+        glMultiDrawElementsIndirectCountProc = ( Multi_Draw_Elements_Indirect_Count_Proc ) load( "glMultiDrawElementsIndirectCount" );
+    }
+
+    int extensionsCount;
+    glGetIntegerv( GL_NUM_EXTENSIONS, &extensionsCount );
+    for ( int i = 0; i < extensionsCount && !glMultiDrawElementsIndirectCountProc; ++i )
+    {
+        if ( strcmp( ( char * ) glGetStringi( GL_EXTENSIONS, i ), "GL_ARB_indirect_parameters" ) == 0 )
+        {
+            glMultiDrawElementsIndirectCountProc = ( Multi_Draw_Elements_Indirect_Count_Proc ) load( "glMultiDrawElementsIndirectCountARB" );
+        }
+    }
+
+    if ( !glMultiDrawElementsIndirectCountProc )
+    {
+        printf( "glMultiDrawElementsIndirectCount is not supported, meshlet draws submit every command\n" );
+        return false;
+    }
+    return true;
+}
+
+//@NOTE: Matches the std430 layout in meshlet_cull.comp
+struct Meshlet
+{
+    glm::vec4 sphere; // object space center, radius
+    glm::vec4 cone;   // axis, cutoff. Back facing when dot( center - camera, axis ) >= cutoff * |center - camera| + radius
+    u32 firstIndex;
+    u32 indexCount;
+    u32 padding[ 2 ];
+};
+
+struct Draw_Elements_Indirect_Command
+{
+    u32 count;
+    u32 instanceCount;
+    u32 firstIndex;
+    s32 baseVertex;
+    u32 baseInstance;
+};
+
+//@NOTE: Matches the Commands block in meshlet_cull.comp, the commands follow right after it
+struct Meshlet_Draw_Header
+{
+    u32 drawCount;
+    u32 padding[ 3 ];
+};
+
+internal void ComputeMeshletBounds( Mesh_Data *mesh, Meshlet *meshlet, u32 *vertices, int verticesCount )
+{
+    glm::vec3 boundsMin = mesh->vertices[ vertices[ 0 ] ].position;
+    glm::vec3 boundsMax = boundsMin;
+    for ( int i = 1; i < verticesCount; ++i )
+    {
+        boundsMin = glm::min( boundsMin, mesh->vertices[ vertices[ i ] ].position );
+        boundsMax = glm::max( boundsMax, mesh->vertices[ vertices[ i ] ].position );
+    }
+
+    glm::vec3 center = ( boundsMin + boundsMax ) * 0.5f;
+    float32 radius = 0.0f;
+    for ( int i = 0; i < verticesCount; ++i )
+    {
+        radius = glm::max( radius, glm::length( mesh->vertices[ vertices[ i ] ].position - center ) );
+    }
+    meshlet->sphere = glm::vec4( center, radius );
+
+    u32 *indices = mesh->indices + meshlet->firstIndex;
+    int trianglesCount = ( int ) meshlet->indexCount / 3;
+
+    glm::vec3 axis( 0.0f );
+    for ( int i = 0; i < trianglesCount; ++i )
+    {
+        glm::vec3 a = mesh->vertices[ indices[ i * 3 + 0 ] ].position;
+        glm::vec3 b = mesh->vertices[ indices[ i * 3 + 1 ] ].position;
+        glm::vec3 c = mesh->vertices[ indices[ i * 3 + 2 ] ].position;
+        glm::vec3 normal = glm::cross( b - a, c - a );
+        float32 length = glm::length( normal );
+        if ( length > 0.0f ) { axis += normal / length; }
+    }
+
+    //@NOTE: A cutoff of 1 can never pass the test, used when the normals spread too wide for a useful cone
+    float32 axisLength = glm::length( axis );
+    if ( axisLength == 0.0f )
+    {
+        meshlet->cone = glm::vec4( 0.0f, 0.0f, 1.0f, 1.0f );
+        return;
+    }
+    axis /= axisLength;
+
+    float32 minimumDot = 1.0f;
+    for ( int i = 0; i < trianglesCount; ++i )
+    {
+        glm::vec3 a = mesh->vertices[ indices[ i * 3 + 0 ] ].position;
+        glm::vec3 b = mesh->vertices[ indices[ i * 3 + 1 ] ].position;
+        glm::vec3 c = mesh->vertices[ indices[ i * 3 + 2 ] ].position;
+        glm::vec3 normal = glm::cross( b - a, c - a );
+        float32 length = glm::length( normal );
+        if ( length > 0.0f ) { minimumDot = glm::min( minimumDot, glm::dot( normal / length, axis ) ); }
+    }
+
+    float32 cutoff = minimumDot <= 0.1f ? 1.0f : sqrtf( 1.0f - minimumDot * minimumDot );
+    meshlet->cone = glm::vec4( axis, cutoff );
+}
+
+// Greedy split in index buffer order, fills mesh->meshlets. Only the full detail level is split.
+internal void BuildMeshlets( Mesh_Data *mesh )
+{
+    int trianglesCount = ( mesh->lodsCount ? ( int ) mesh->lods[ 0 ].indexCount : mesh->indicesCount ) / 3;
+
+    //@NOTE: A meshlet only runs out of vertices after at least MESHLET_MAX_VERTICES / 3 triangles
+    mesh->meshlets = ( Meshlet * ) malloc( ( trianglesCount / ( MESHLET_MAX_VERTICES / 3 ) + 1 ) * sizeof( Meshlet ) );
+    mesh->meshletsCount = 0;
+
+    //@NOTE: Index of the meshlet that last used the vertex + 1, so the array never has to be cleared
+    u32 *usedBy = ( u32 * ) calloc( mesh->verticesCount, sizeof( u32 ) );
+    defer { free( usedBy ); };
+
+    u32 vertices[ MESHLET_MAX_VERTICES ];
+    int verticesCount = 0;
+    Meshlet meshlet = {};
+
+    for ( int i = 0; i < trianglesCount; ++i )
+    {
+        u32 *triangle = mesh->indices + i * 3;
+        u32 stamp = ( u32 ) mesh->meshletsCount + 1;
+
+        int newVertices = 0;
+        for ( int j = 0; j < 3; ++j )
+        {
+            bool repeated = ( j > 0 && triangle[ j ] == triangle[ 0 ] ) || ( j > 1 && triangle[ j ] == triangle[ 1 ] );
+            if ( usedBy[ triangle[ j ] ] != stamp && !repeated ) { ++newVertices; }
+        }
+
+        if ( verticesCount + newVertices > MESHLET_MAX_VERTICES || meshlet.indexCount / 3 >= MESHLET_MAX_TRIANGLES )
+        {
+            ComputeMeshletBounds( mesh, &meshlet, vertices, verticesCount );
+            mesh->meshlets[ mesh->meshletsCount++ ] = meshlet;
+
+            meshlet = {};
+            meshlet.firstIndex = ( u32 ) i * 3;
+            verticesCount = 0;
+            stamp = ( u32 ) mesh->meshletsCount + 1;
+        }
+
+        for ( int j = 0; j < 3; ++j )
+        {
+            if ( usedBy[ triangle[ j ] ] != stamp )
+            {
+                usedBy[ triangle[ j ] ] = stamp;
+                vertices[ verticesCount++ ] = triangle[ j ];
+            }
+        }
+        meshlet.indexCount += 3;
+    }
+
+    if ( meshlet.indexCount )
+    {
+        ComputeMeshletBounds( mesh, &meshlet, vertices, verticesCount );
+        mesh->meshlets[ mesh->meshletsCount++ ] = meshlet;
+    }
+    mesh->meshlets = ( Meshlet * ) realloc( mesh->meshlets, ( mesh->meshletsCount + 1 ) * sizeof( Meshlet ) );
+}
+
+inline void UploadMeshlets( Mesh *mesh, Meshlet *meshlets, int meshletsCount )
+{
+    if ( !meshletsCount ) { return; }
+
+    glGenBuffers( 1, &mesh->meshletBuffer );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, mesh->meshletBuffer );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, meshletsCount * sizeof( Meshlet ), meshlets, GL_STATIC_DRAW );
+
+    glGenBuffers( 1, &mesh->meshletVisibilityBuffer );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, mesh->meshletVisibilityBuffer );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, meshletsCount * sizeof( u32 ), 0, GL_DYNAMIC_COPY );
+    glClearBufferData( GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, 0 );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    mesh->meshletsCount = meshletsCount;
+}
+
+struct Meshlet_Culler
+{
+    Shader shader;
+
+    //@NOTE: Meshlet_Draw_Header followed by one command per meshlet, grown to the largest mesh drawn so far
+    u32 commandBuffer;
+    int commandsCapacity;
+};
+
+internal Meshlet_Culler CreateMeshletCuller()
+{
+    Meshlet_Culler result = {};
+    result.shader = CreateComputeShader( "../src/shaders/meshlet_cull.comp" );
+    glGenBuffers( 1, &result.commandBuffer );
+    return result;
+}
+
+// Culls the meshlets on the GPU and draws the survivors, the render shader has to be in use with the model matrix set.
+// The late phase needs the pyramid built from the depth after the early one.
+internal void DrawMeshMeshlets( Mesh mesh, Shader shader, Meshlet_Culler *culler, glm::mat4 transform, glm::mat4 viewProjection, Frustum *frustum,
+                                glm::vec3 cameraPosition, Gpu_Culling_Phase phase = GPU_CULLING_ALL, Hi_Z *hiZ = 0 )
+{
+    Assert( phase != GPU_CULLING_LATE || hiZ );
+
+    if ( mesh.meshletsCount > culler->commandsCapacity )
+    {
+        culler->commandsCapacity = mesh.meshletsCount;
+        glBindBuffer( GL_SHADER_STORAGE_BUFFER, culler->commandBuffer );
+        glBufferData( GL_SHADER_STORAGE_BUFFER, sizeof( Meshlet_Draw_Header ) + culler->commandsCapacity * sizeof( Draw_Elements_Indirect_Command ),
+                      0, GL_DYNAMIC_DRAW );
+    }
+
+    //@NOTE: The count draw reads only drawCount commands, so resetting the header is enough. Otherwise culled meshlets
+    // leave zeroed commands at the end, those draw nothing.
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, culler->commandBuffer );
+    if ( glMultiDrawElementsIndirectCountProc )
+    {
+        glClearBufferSubData( GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof( Meshlet_Draw_Header ), GL_RED_INTEGER, GL_UNSIGNED_INT, 0 );
+    }
+    else
+    {
+        glClearBufferData( GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, 0 );
+    }
+
+    UseShader( culler->shader );
+    ShaderSetMat4( culler->shader, "model", glm::value_ptr( transform ) );
+    ShaderSetFloat32( culler->shader, "modelScale", GetMaxScale( transform ) );
+    ShaderSetVec4Array( culler->shader, "frustumPlanes", frustum->planes, 6 );
+    ShaderSetVec3( culler->shader, "cameraPosition", cameraPosition );
+    ShaderSetUInt( culler->shader, "meshletsCount", ( u32 ) mesh.meshletsCount );
+    ShaderSetInt( culler->shader, "phase", phase );
+    ShaderSetMat4( culler->shader, "viewProjection", glm::value_ptr( viewProjection ) );
+    ShaderSetInt( culler->shader, "hiZ", HI_Z_TEXTURE_UNIT );
+    if ( hiZ )
+    {
+        glActiveTexture( GL_TEXTURE0 + HI_Z_TEXTURE_UNIT );
+        glBindTexture( GL_TEXTURE_2D, hiZ->texture );
+        glActiveTexture( GL_TEXTURE0 );
+    }
+
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, mesh.meshletBuffer );
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, culler->commandBuffer );
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, mesh.meshletVisibilityBuffer );
+    glDispatchCompute( ( mesh.meshletsCount + 63 ) / 64, 1, 1 );
+    glMemoryBarrier( GL_COMMAND_BARRIER_BIT ); // covers the draw count in GL_PARAMETER_BUFFER as well
+
+    UseShader( shader );
+    BindMeshTextures( mesh, shader );
+    SetMeshVertexFormat( mesh, shader );
+    glBindVertexArray( mesh.vao );
+    glBindBuffer( GL_DRAW_INDIRECT_BUFFER, culler->commandBuffer );
+    if ( glMultiDrawElementsIndirectCountProc )
+    {
+        glBindBuffer( GL_PARAMETER_BUFFER, culler->commandBuffer );
+        glMultiDrawElementsIndirectCountProc( GL_TRIANGLES, mesh.indexType, ( void * ) sizeof( Meshlet_Draw_Header ), 0, mesh.meshletsCount, 0 );
+        glBindBuffer( GL_PARAMETER_BUFFER, 0 );
+    }
+    else
+    {
+        glMultiDrawElementsIndirect( GL_TRIANGLES, mesh.indexType, ( void * ) sizeof( Meshlet_Draw_Header ), mesh.meshletsCount, 0 );
+    }
+    glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+}
@@ -9,8 +9,30 @@
 #include <vector>
 #include <stack> //@TODO: Get rid of this
 #include "mesh.h"
+#include "model_cache.h"
+#include "asset_io.h"
+#include "obj_loader.h"
+#include "mesh_optimizer.h"
+#include "meshlet.h"
+#include "software_occlusion.h"
+#include "mesh_simplifier.h"
+#include "jobs.h"
+#include "texture_loader.h"
 #include "stb_image.h"
 
+enum Model_Load_Flags
+{
+    MODEL_LOAD_CACHE = 1 << 0,            // read/write the binary mesh cache next to the source file
+    MODEL_LOAD_FLIP_TEXTURES = 1 << 1,    // flip textures vertically on load
+    MODEL_LOAD_NATIVE_OBJ = 1 << 2,       // parse .obj files with obj_loader.h, other formats always go through Assimp
+    MODEL_LOAD_OPTIMIZE = 1 << 3,         // weld and reorder imported meshes with mesh_optimizer.h, before the cache is written
+    MODEL_LOAD_COMPACT_VERTICES = 1 << 4, // upload Compact_Vertex and 16 bit indices when possible instead of Vertex
+    MODEL_LOAD_MESHLETS = 1 << 5,         // split meshes into meshlets for DrawModelMeshlets
+    MODEL_LOAD_LODS = 1 << 6,             // generate MESH_MAX_LODS levels of detail with mesh_simplifier.h, before the cache is written
+};
+
+#define MODEL_LOAD_DEFAULT_FLAGS ( MODEL_LOAD_CACHE | MODEL_LOAD_NATIVE_OBJ | MODEL_LOAD_OPTIMIZE )
+
 struct Model
 {
     Mesh *meshes;
@@ -18,6 +40,42 @@ struct Model
 
     char directory[ 128 ];
     std::vector< Texture > loadedTextures = {};
+
+    //@NOTE: Vertex data of meshes loaded from the cache lives in this mapping
+    Asset_File cache;
+
+    //@NOTE: Largest error of every level over all meshes, 1 level when the meshes weren't simplified
+    float32 lodErrors[ MESH_MAX_LODS ];
+    int lodsCount;
+};
+
+//@NOTE: Everything the importers produce before touching GL
+struct Model_Data
+{
+    Mesh_Data *meshes;
+    int meshesCount;
+
+    char directory[ 128 ];
+    u32 flags;
+    Asset_File cache;
+
+    //@NOTE: Material library read by the import, recorded in the cache
+    char materialLibrary[ 256 ];
+};
+
+struct Model_Load_Request
+{
+    char *path;
+    u32 flags;
+};
+
+//@NOTE: Meshes tested by the culling draws, reset by the caller every frame. Culled meshes are out of view,
+// occluded ones in view but hidden behind the occluders.
+struct Draw_Stats
+{
+    int meshesDrawn;
+    int meshesCulled;
+    int meshesOccluded;
 };
 
 void DrawModel( Model model, Shader shader )
@@ -28,46 +86,132 @@ void DrawModel( Model model, Shader shader )
     }
 }
 
-u32 TextureFromFile( char *path, char *directory, bool gamma = false )
+enum Mesh_Visibility
+{
+    MESH_VISIBLE,
+    MESH_CULLED,
+    MESH_OCCLUDED
+};
+
+// The sphere rejects most meshes for less, the box is tighter for the ones that are long or flat. The box in view is
+// then tested against the occlusion buffer when there is one, which has to hold this frame's occluders.
+inline Mesh_Visibility GetMeshVisibility( Mesh *mesh, glm::mat4 transform, Frustum *frustum, Occlusion_Buffer *occlusion )
+{
+    glm::vec3 center = glm::vec3( transform * glm::vec4( mesh->bounds.center, 1.0f ) );
+    if ( !IsSphereInFrustum( frustum, center, mesh->bounds.radius * GetMaxScale( transform ) ) ) { return MESH_CULLED; }
+
+    glm::vec3 boxMin, boxMax;
+    TransformBox( transform, mesh->bounds.min, mesh->bounds.max, &boxMin, &boxMax );
+    if ( !IsBoxInFrustum( frustum, boxMin, boxMax ) ) { return MESH_CULLED; }
+    return occlusion && IsBoxOccluded( occlusion, boxMin, boxMax ) ? MESH_OCCLUDED : MESH_VISIBLE;
+}
+
+inline void AddMeshVisibility( Draw_Stats *stats, Mesh_Visibility visibility )
+{
+    if ( !stats ) { return; }
+    stats->meshesDrawn += visibility == MESH_VISIBLE;
+    stats->meshesCulled += visibility == MESH_CULLED;
+    stats->meshesOccluded += visibility == MESH_OCCLUDED;
+}
+
+// Sets the model uniform and draws the meshes that are in view and not occluded, before any of their textures are bound
+void DrawModel( Model model, Shader shader, glm::mat4 transform, glm::mat4 viewProjection, Draw_Stats *stats = 0,
+                Occlusion_Buffer *occlusion = 0 )
+{
+    Frustum frustum = GetFrustum( viewProjection );
+    ShaderSetMat4( shader, "model", glm::value_ptr( transform ) );
+    for ( int i = 0; i < model.meshesCount; ++i )
+    {
+        Mesh_Visibility visibility = GetMeshVisibility( &model.meshes[ i ], transform, &frustum, occlusion );
+        AddMeshVisibility( stats, visibility );
+        if ( visibility == MESH_VISIBLE ) { DrawMesh( model.meshes[ i ], shader ); }
+    }
+}
+
+// Like DrawModel, meshes that were split into meshlets are culled on the GPU first. With the Hi-Z phases the
+// meshlets are occlusion culled as well, see meshlet.h. Meshes that weren't split draw whole in the early phase and
+// are skipped by the late one, which also doesn't count them again in the stats.
+void DrawModelMeshlets( Model model, Shader shader, Meshlet_Culler *culler, glm::mat4 transform, glm::mat4 viewProjection, glm::vec3 cameraPosition,
+                        Draw_Stats *stats = 0, Occlusion_Buffer *occlusion = 0, Gpu_Culling_Phase phase = GPU_CULLING_ALL, Hi_Z *hiZ = 0 )
+{
+    Frustum frustum = GetFrustum( viewProjection );
+    ShaderSetMat4( shader, "model", glm::value_ptr( transform ) );
+    for ( int i = 0; i < model.meshesCount; ++i )
+    {
+        Mesh_Visibility visibility = GetMeshVisibility( &model.meshes[ i ], transform, &frustum, occlusion );
+        if ( phase != GPU_CULLING_LATE ) { AddMeshVisibility( stats, visibility ); }
+        if ( visibility != MESH_VISIBLE ) { continue; }
+
+        if ( model.meshes[ i ].meshletBuffer )
+        {
+            DrawMeshMeshlets( model.meshes[ i ], shader, culler, transform, viewProjection, &frustum, cameraPosition, phase, hiZ );
+        }
+        else if ( phase != GPU_CULLING_LATE )
+        {
+            DrawMesh( model.meshes[ i ], shader );
+        }
+    }
+}
+
+// Bounding box center and the furthest vertex from it, in object space
+internal void GetModelBoundingSphere( Model model, glm::vec3 *center, float32 *radius )
+{
+    bool empty = true;
+    glm::vec3 boundsMin( 0.0f );
+    glm::vec3 boundsMax( 0.0f );
+    for ( int i = 0; i < model.meshesCount; ++i )
+    {
+        for ( int j = 0; j < model.meshes[ i ].verticesCount; ++j )
+        {
+            glm::vec3 position = model.meshes[ i ].vertices[ j ].position;
+            boundsMin = empty ? position : glm::min( boundsMin, position );
+            boundsMax = empty ? position : glm::max( boundsMax, position );
+            empty = false;
+        }
+    }
+
+    *center = ( boundsMin + boundsMax ) * 0.5f;
+    *radius = 0.0f;
+    for ( int i = 0; i < model.meshesCount; ++i )
+    {
+        for ( int j = 0; j < model.meshes[ i ].verticesCount; ++j )
+        {
+            *radius = glm::max( *radius, glm::length( model.meshes[ i ].vertices[ j ].position - *center ) );
+        }
+    }
+}
+
+internal void GetTexturePath( char *path, char *directory, char *filename, int bufferSize )
 {
-    const int bufferSize = 256;
-    char filename[ bufferSize ] = "";
     char *separator = "/";
+    filename[ 0 ] = '\0';
     strncat_s( filename, bufferSize, directory, strlen( directory ) );
     strncat_s( filename, bufferSize, separator, strlen( separator ) );
     strncat_s( filename, bufferSize, path, strlen( path ) );
+}
+
+u32 TextureFromFile( char *path, char *directory, bool gamma = false )
+{
+    const int bufferSize = 256;
+    char filename[ bufferSize ] = "";
+    GetTexturePath( path, directory, filename, bufferSize );
 
     u32 id;
     glGenTextures( 1, &id );
 
     int width, height, componentsCount;
-    u8 *data = stbi_load( filename, &width, &height, &componentsCount, 0 );
+    u8 *data = 0;
 
-    if ( data )
+    Asset_File file;
+    if ( OpenAssetFile( filename, &file ) )
     {
-        GLenum format = 0;
-        switch ( componentsCount )
-        {
-            case 1:
-                format = GL_RED;
-                break;
-            case 3:
-                format = GL_RGB;
-                break;
-            case 4:
-                format = GL_RGBA;
-                break;
-        }
-
-        glBindTexture( GL_TEXTURE_2D, id );
-        glTexImage2D( GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data );
-        glGenerateMipmap( GL_TEXTURE_2D );
+        data = stbi_load_from_memory( file.memory, ( int ) file.size, &width, &height, &componentsCount, 0 );
+        CloseAssetFile( &file );
+    }
 
-        //@NOTE: GL_CLAMP_TO_EDGE for transparent not repeating textures, GL_REPEAT otherwise
-        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
-        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    if ( data )
+    {
+        UploadTexture2D( id, data, width, height, componentsCount );
     }
     else
     {
@@ -78,7 +222,29 @@ u32 TextureFromFile( char *path, char *directory, bool gamma = false )
     return id;
 }
 
-int LoadMaterialTextures( Model *model, aiMaterial *material, aiTextureType aiType, Texture_Type type, Texture *textures, int index )
+//@NOTE: The id is valid right away, the pixels arrive when the batch is pumped/finished
+u32 LoadModelTexture( Model *model, Texture_Reference *reference, Texture_Batch *batch, bool flip )
+{
+    for ( u32 i = 0; i < model->loadedTextures.size(); ++i )
+    {
+        if ( strcmp( model->loadedTextures[ i ].path, reference->path ) == 0 )
+        {
+            return model->loadedTextures[ i ].id;
+        }
+    }
+
+    char filename[ 256 ];
+    GetTexturePath( reference->path, model->directory, filename, sizeof( filename ) );
+
+    Texture texture;
+    texture.id = QueueTexture2D( batch, filename, flip );
+    texture.type = reference->type;
+    strcpy_s( texture.path, reference->path );
+    model->loadedTextures.push_back( texture );
+    return texture.id;
+}
+
+int GetMaterialTextures( aiMaterial *material, aiTextureType aiType, Texture_Type type, Texture_Reference *textures, int index )
 {
     int result = 0;
     for ( u32 i = 0; i < material->GetTextureCount( aiType ); ++i )
@@ -86,33 +252,16 @@ int LoadMaterialTextures( Model *model, aiMaterial *material, aiTextureType aiTy
         aiString path;
         material->GetTexture( aiType, i, &path );
 
-        bool skip = false;
-        for ( u32 j = 0; j < model->loadedTextures.size(); ++j )
-        {
-            if ( strcmp( model->loadedTextures[ j ].path, path.C_Str() ) == 0 )
-            {
-                textures[ index + i ] = model->loadedTextures[ j ];
-                skip = true;
-                ++result;
-                break;
-            }
-        }
-
-        if ( skip ) { continue; }
-
-        Texture texture;
-        texture.id = TextureFromFile( ( char * ) path.C_Str(), model->directory );
-        texture.type = type;
-        strncpy_s( texture.path, path.C_Str(), path.length );
-        texture.path[ path.length ] = '\0';
-        textures[ index + i ] = texture;
-        model->loadedTextures.push_back( texture );
+        Texture_Reference *texture = &textures[ index + i ];
+        texture->type = type;
+        strncpy_s( texture->path, path.C_Str(), path.length );
+        texture->path[ path.length ] = '\0';
         ++result;
     }
     return result;
 }
 
-Mesh ProcessMesh( Model *model, aiMesh *mesh, const aiScene *scene )
+Mesh_Data ProcessMesh( aiMesh *mesh, const aiScene *scene )
 {
     Vertex *vertices = ( Vertex * ) malloc( mesh->mNumVertices * sizeof( Vertex ) );
 
@@ -145,21 +294,42 @@ Mesh ProcessMesh( Model *model, aiMesh *mesh, const aiScene *scene )
         }
     }
 
-    Texture *textures = 0;
-    int texturesCount = 0;
+    Mesh_Data result = {};
+    result.vertices = vertices;
+    result.verticesCount = mesh->mNumVertices;
+    result.indices = indices;
+    result.indicesCount = mesh->mNumFaces * 3;
+
     if ( mesh->mMaterialIndex >= 0 )
     {
         aiMaterial *material = scene->mMaterials[ mesh->mMaterialIndex ];
-        texturesCount = material->GetTextureCount( aiTextureType_DIFFUSE ) + material->GetTextureCount( aiTextureType_SPECULAR );
-        textures = ( Texture * ) malloc( texturesCount * sizeof( Texture ) );
-        int texturesLoaded = LoadMaterialTextures( model, material, aiTextureType_DIFFUSE, Texture_Type::DIFFUSE, textures, 0 );
-        LoadMaterialTextures( model, material, aiTextureType_SPECULAR, Texture_Type::SPECULAR, textures, texturesLoaded );
+        result.texturesCount = material->GetTextureCount( aiTextureType_DIFFUSE ) + material->GetTextureCount( aiTextureType_SPECULAR );
+        result.textures = ( Texture_Reference * ) malloc( result.texturesCount * sizeof( Texture_Reference ) );
+        int diffuseCount = GetMaterialTextures( material, aiTextureType_DIFFUSE, Texture_Type::DIFFUSE, result.textures, 0 );
+        GetMaterialTextures( material, aiTextureType_SPECULAR, Texture_Type::SPECULAR, result.textures, diffuseCount );
     }
 
-    return CreateMesh( vertices, mesh->mNumVertices, indices, mesh->mNumFaces * 3, textures, texturesCount );
+    return result;
 }
 
-void ProcessNodes( Model *model, const aiScene *scene )
+struct Process_Meshes_Job
+{
+    Model_Data *model;
+    const aiScene *scene;
+    aiMesh **meshes;
+};
+
+internal void ProcessMeshesJob( void *data, int start, int end )
+{
+    Process_Meshes_Job *job = ( Process_Meshes_Job * ) data;
+    for ( int i = start; i < end; ++i )
+    {
+        job->model->meshes[ i ] = ProcessMesh( job->meshes[ i ], job->scene );
+    }
+}
+
+//@NOTE: With a queue every aiMesh is converted on a worker, the output keeps the node traversal order
+void ProcessNodes( Model_Data *model, const aiScene *scene, Job_Queue *queue = 0 )
 {
     std::stack< aiNode * > stack;
     std::vector< aiNode * > visited;
@@ -176,48 +346,313 @@ void ProcessNodes( Model *model, const aiScene *scene )
         }
     }
 
-    int meshIndex = 0;
+    std::vector< aiMesh * > meshes;
     for ( aiNode *node : visited )
     {
         for ( u32 i = 0; i < node->mNumMeshes; ++i )
         {
-            aiMesh *mesh = scene->mMeshes[ node->mMeshes[ i ] ];
-            model->meshes[ meshIndex++ ] = ProcessMesh( model, mesh, scene );
+            meshes.push_back( scene->mMeshes[ node->mMeshes[ i ] ] );
         }
     }
+
+    Process_Meshes_Job job = { model, scene, meshes.data() };
+    ParallelFor( queue, ( int ) meshes.size(), 1, ProcessMeshesJob, &job );
 }
 
-//@TODO: DeleteModel()
-Model CreateModel( char *path )
+internal void SetModelDirectory( char *directory, char *path )
 {
-    Assimp::Importer importer;
-    const aiScene *scene = importer.ReadFile( path, aiProcess_Triangulate | aiProcess_FlipUVs );
+    char *lastSlash = strrchr( path, '/' );
+    if ( lastSlash )
+    {
+        int count = ( int ) ( lastSlash - path );
+        strncpy_s( directory, 128, path, count );
+        directory[ count ] = '\0';
+    }
+    else
+    {
+        directory[ 0 ] = '.';
+        directory[ 1 ] = '/';
+        directory[ 2 ] = '\0';
+    }
+}
+
+//@NOTE: One importer per thread, so concurrent imports never share Assimp state. The importer owns the IO system.
+internal Assimp::Importer *GetThreadImporter()
+{
+    thread_local Assimp::Importer importer;
+    thread_local bool initialized = false;
+    if ( !initialized )
+    {
+        importer.SetIOHandler( new Asset_IO_System() );
+        initialized = true;
+    }
+    return &importer;
+}
+
+bool ImportModel( char *path, Model_Data *result, Job_Queue *queue = 0 )
+{
+    Assimp::Importer *importer = GetThreadImporter();
+    Asset_IO_System *ioSystem = ( Asset_IO_System * ) importer->GetIOHandler();
+    ioSystem->stats.clear();
+
+    const aiScene *scene = importer->ReadFile( path, aiProcess_Triangulate | aiProcess_FlipUVs );
+
+    result->materialLibrary[ 0 ] = '\0';
+    for ( Asset_IO_File_Stats &fileStats : ioSystem->stats )
+    {
+        char *extension = strrchr( fileStats.path, '.' );
+        if ( extension && _stricmp( extension, ".mtl" ) == 0 ) { strcpy_s( result->materialLibrary, fileStats.path ); }
+    }
+    ReportAssetIO( &ioSystem->stats, path );
 
     if ( !scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode )
     {
-        printf( "Error during model loading: %s\n", importer.GetErrorString() );
-        return {};
+        printf( "Error during model loading: %s\n", importer->GetErrorString() );
+        return false;
+    }
+
+    result->meshes = ( Mesh_Data * ) malloc( scene->mNumMeshes * sizeof( Mesh_Data ) );
+    result->meshesCount = scene->mNumMeshes;
+
+    ProcessNodes( result, scene, queue );
+    importer->FreeScene();
+    return true;
+}
+
+struct Optimize_Meshes_Job
+{
+    Model_Data *model;
+    char *path;
+};
+
+internal void OptimizeMeshesJob( void *data, int start, int end )
+{
+    Optimize_Meshes_Job *job = ( Optimize_Meshes_Job * ) data;
+    for ( int i = start; i < end; ++i )
+    {
+        Mesh_Optimization_Stats stats = OptimizeMesh( &job->model->meshes[ i ] );
+        printf( "%s mesh %d: %d -> %d vertices, ACMR %.3f -> %.3f\n", job->path, i, stats.verticesBefore, stats.verticesAfter,
+                stats.acmrBefore, stats.acmrAfter );
     }
+}
+
+internal void BuildMeshletsJob( void *data, int start, int end )
+{
+    Model_Data *model = ( Model_Data * ) data;
+    for ( int i = start; i < end; ++i ) { BuildMeshlets( &model->meshes[ i ] ); }
+}
+
+internal void GenerateLodsJob( void *data, int start, int end )
+{
+    Optimize_Meshes_Job *job = ( Optimize_Meshes_Job * ) data;
+    for ( int i = start; i < end; ++i )
+    {
+        Mesh_Data *mesh = &job->model->meshes[ i ];
+        GenerateMeshLods( mesh );
 
+        char report[ 512 ];
+        int length = snprintf( report, sizeof( report ), "%s mesh %d LODs:", job->path, i );
+        for ( int j = 0; j < mesh->lodsCount && length < ( int ) sizeof( report ); ++j )
+        {
+            length += snprintf( report + length, sizeof( report ) - length, " %u (%.4f)", mesh->lods[ j ].indexCount / 3, mesh->lods[ j ].error );
+        }
+        printf( "%s\n", report );
+    }
+}
+
+// Flags that change what the importers produce, a cache is only used with the flags it was written with
+internal u32 GetModelCacheFlags( char *path, u32 flags )
+{
+    u32 result = flags & ( MODEL_LOAD_OPTIMIZE | MODEL_LOAD_LODS );
+
+    char *extension = strrchr( path, '.' );
+    if ( extension && _stricmp( extension, ".obj" ) == 0 ) { result |= flags & MODEL_LOAD_NATIVE_OBJ; }
+    return result;
+}
+
+// Fills data from the cache or by importing the file, doesn't touch GL so it can run on any thread
+bool LoadModelData( char *path, u32 flags, Model_Data *data, Job_Queue *queue = 0 )
+{
+    *data = {};
+    data->flags = flags;
+    SetModelDirectory( data->directory, path );
+
+    u32 cacheFlags = GetModelCacheFlags( path, flags );
+    bool cached = ( flags & MODEL_LOAD_CACHE ) && ReadModelCache( path, cacheFlags, &data->cache, &data->meshes, &data->meshesCount );
+    if ( !cached )
+    {
+        char *extension = strrchr( path, '.' );
+        bool isObj = extension && _stricmp( extension, ".obj" ) == 0;
+
+        bool imported = false;
+        if ( ( flags & MODEL_LOAD_NATIVE_OBJ ) && isObj )
+        {
+            std::vector< Asset_IO_File_Stats > ioStats;
+            imported = ImportObj( path, data->directory, &data->meshes, &data->meshesCount, data->materialLibrary,
+                                  sizeof( data->materialLibrary ), &ioStats, queue );
+            ReportAssetIO( &ioStats, path );
+        }
+        if ( !imported && !ImportModel( path, data, queue ) ) { return false; }
+
+        //@NOTE: Welding and simplifying keep the positions, so the bounds of the import hold for every level
+        for ( int i = 0; i < data->meshesCount; ++i )
+        {
+            data->meshes[ i ].bounds = ComputeMeshBounds( data->meshes[ i ].vertices, data->meshes[ i ].verticesCount );
+        }
+
+        if ( flags & MODEL_LOAD_OPTIMIZE )
+        {
+            Optimize_Meshes_Job job = { data, path };
+            ParallelFor( queue, data->meshesCount, 1, OptimizeMeshesJob, &job );
+        }
+
+        if ( flags & MODEL_LOAD_LODS )
+        {
+            Optimize_Meshes_Job job = { data, path };
+            ParallelFor( queue, data->meshesCount, 1, GenerateLodsJob, &job );
+        }
+
+        if ( flags & MODEL_LOAD_CACHE )
+        {
+            WriteModelCache( path, cacheFlags, data->materialLibrary, data->meshes, data->meshesCount );
+        }
+    }
+
+    //@NOTE: Not cached, splitting is cheap next to importing and the cache format stays the same
+    if ( flags & MODEL_LOAD_MESHLETS )
+    {
+        ParallelFor( queue, data->meshesCount, 1, BuildMeshletsJob, data );
+    }
+    return true;
+}
+
+//@NOTE: Vertices and indices are owned by the meshes after upload, only the bookkeeping is freed here
+void FreeModelData( Model_Data *data )
+{
+    if ( !data->cache.memory )
+    {
+        for ( int i = 0; i < data->meshesCount; ++i ) { free( data->meshes[ i ].textures ); }
+    }
+    for ( int i = 0; i < data->meshesCount; ++i ) { free( data->meshes[ i ].meshlets ); }
+    free( data->meshes );
+    data->meshes = 0;
+    data->meshesCount = 0;
+}
+
+// Creates the GL objects for the model. Textures are queued on the batch and decoded in the background,
+// they are complete after FinishTextureBatch.
+Model UploadModel( Model_Data *data, Texture_Batch *batch )
+{
     Model result = {};
-    char *lastSlash = strrchr( path, '/' );
-    if ( lastSlash )
+    strcpy_s( result.directory, data->directory );
+    result.cache = data->cache;
+    result.meshes = ( Mesh * ) malloc( data->meshesCount * sizeof( Mesh ) );
+    result.meshesCount = data->meshesCount;
+
+    bool flip = ( data->flags & MODEL_LOAD_FLIP_TEXTURES ) != 0;
+    for ( int i = 0; i < data->meshesCount; ++i )
     {
-        int count = ( int ) ( lastSlash - path );
-        strncpy_s( result.directory, path, count );
-        result.directory[ count ] = '\0';
+        Mesh_Data *mesh = &data->meshes[ i ];
+        Texture *textures = ( Texture * ) malloc( mesh->texturesCount * sizeof( Texture ) );
+        for ( int j = 0; j < mesh->texturesCount; ++j )
+        {
+            textures[ j ].id = LoadModelTexture( &result, &mesh->textures[ j ], batch, flip );
+            textures[ j ].type = mesh->textures[ j ].type;
+            strcpy_s( textures[ j ].path, mesh->textures[ j ].path );
+        }
+
+        if ( data->flags & MODEL_LOAD_COMPACT_VERTICES )
+        {
+            result.meshes[ i ] = CreateCompactMesh( mesh->vertices, mesh->verticesCount, mesh->indices, mesh->indicesCount, textures, mesh->texturesCount );
+        }
+        else
+        {
+            result.meshes[ i ] = CreateMesh( mesh->vertices, mesh->verticesCount, mesh->indices, mesh->indicesCount, textures, mesh->texturesCount );
+        }
+        UploadMeshlets( &result.meshes[ i ], mesh->meshlets, mesh->meshletsCount );
+        result.meshes[ i ].bounds = mesh->bounds;
+        if ( mesh->lodsCount )
+        {
+            memcpy( result.meshes[ i ].lods, mesh->lods, sizeof( mesh->lods ) );
+            result.meshes[ i ].lodsCount = mesh->lodsCount;
+        }
+        PumpTextureBatch( batch );
     }
-    else
+
+    result.lodsCount = data->meshesCount ? MESH_MAX_LODS : 1;
+    for ( int i = 0; i < data->meshesCount; ++i )
     {
-        result.directory[ 0 ] = '.';
-        result.directory[ 1 ] = '/';
-        result.directory[ 2 ] = '\0';
+        Mesh *mesh = &result.meshes[ i ];
+        if ( mesh->lodsCount < result.lodsCount ) { result.lodsCount = mesh->lodsCount; }
+        for ( int j = 0; j < mesh->lodsCount; ++j ) { result.lodErrors[ j ] = glm::max( result.lodErrors[ j ], mesh->lods[ j ].error ); }
     }
 
-    result.meshes = ( Mesh * ) malloc( scene->mNumMeshes * sizeof( Mesh ) );
-    result.meshesCount = scene->mNumMeshes;
+    return result;
+}
 
-    ProcessNodes( &result, scene );
+//@TODO: DeleteModel()
+//@NOTE: Passing a job queue converts the meshes in parallel, GL objects are still created on the calling thread
+Model CreateModel( char *path, u32 flags = MODEL_LOAD_DEFAULT_FLAGS, Job_Queue *queue = 0 )
+{
+    Model_Data data;
+    if ( !LoadModelData( path, flags, &data, queue ) ) { return {}; }
 
+    Texture_Batch batch;
+    BeginTextureBatch( &batch, queue );
+    Model result = UploadModel( &data, &batch );
+    FreeModelData( &data );
+    FinishTextureBatch( &batch );
     return result;
 }
+
+struct Load_Models_Job
+{
+    Model_Load_Request *requests;
+    Model_Data *data;
+    bool *loaded;
+    Job_Queue *queue;
+};
+
+internal void LoadModelsJob( void *data, int index )
+{
+    Load_Models_Job *job = ( Load_Models_Job * ) data;
+    Model_Load_Request *request = &job->requests[ index ];
+    job->loaded[ index ] = LoadModelData( request->path, request->flags, &job->data[ index ], job->queue );
+}
+
+// Imports every request concurrently (one job per file) and then creates the GL objects on the calling thread.
+// models[ i ] is the result of requests[ i ], failed imports are left zeroed.
+void CreateModels( Model_Load_Request *requests, int count, Model *models, Job_Queue *queue )
+{
+    Model_Data *data = ( Model_Data * ) calloc( count, sizeof( Model_Data ) );
+    bool *loaded = ( bool * ) calloc( count, sizeof( bool ) );
+    defer { free( data ); };
+    defer { free( loaded ); };
+
+    Load_Models_Job job = { requests, data, loaded, queue };
+    if ( queue )
+    {
+        Job_Group group = {};
+        for ( int i = 0; i < count; ++i )
+        {
+            AddJob( queue, &group, LoadModelsJob, &job, i );
+        }
+        WaitForJobs( queue, &group );
+    }
+    else
+    {
+        for ( int i = 0; i < count; ++i ) { LoadModelsJob( &job, i ); }
+    }
+
+    Texture_Batch batch;
+    BeginTextureBatch( &batch, queue );
+    for ( int i = 0; i < count; ++i )
+    {
+        models[ i ] = {};
+        if ( !loaded[ i ] ) { continue; }
+
+        models[ i ] = UploadModel( &data[ i ], &batch );
+        FreeModelData( &data[ i ] );
+    }
+    FinishTextureBatch( &batch );
+}
@@ -0,0 +1,295 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils/utils.h"
+#include "platform.h"
+#include "package.h"
+#include "mesh.h"
+
+// Binary mesh cache written next to the source asset (backpack.obj -> backpack.obj.mcache).
+// Layout: header | mesh ranges | texture references | vertices | indices, every block 16 byte aligned
+// so the arrays can be used straight from the mapped file.
+
+#define MODEL_CACHE_MAGIC     0x4843434d // "MCCH"
+#define MODEL_CACHE_VERSION   4
+#define MODEL_CACHE_ALIGNMENT 16
+
+struct Model_Cache_Header
+{
+    u32 magic;
+    u32 version;
+    u32 vertexSize;
+    u32 meshesCount;
+
+    //@NOTE: Stamp of the source file at the time of writing, cache is stale when it doesn't match
+    u64 sourceSize;
+    u64 sourceWriteTime;
+
+    //@NOTE: Load flags that change the meshes, see GetModelCacheFlags in model.h
+    u32 loadFlags;
+    u32 padding;
+
+    //@NOTE: Stamp of the material library (.mtl) the meshes were imported with, the path is empty when there was none
+    u64 materialLibrarySize;
+    u64 materialLibraryWriteTime;
+    char materialLibrary[ 256 ];
+
+    u64 texturesCount;
+    u64 verticesCount;
+    u64 indicesCount;
+
+    u64 meshesOffset;
+    u64 texturesOffset;
+    u64 verticesOffset;
+    u64 indicesOffset;
+    u64 fileSize;
+};
+
+struct Model_Cache_Mesh
+{
+    u64 firstVertex;
+    u64 firstIndex;
+    u64 firstTexture;
+    u32 verticesCount;
+    u32 indicesCount;
+    u32 texturesCount;
+    u32 lodsCount;
+    Mesh_Lod lods[ MESH_MAX_LODS ];
+    Mesh_Bounds bounds;
+};
+
+internal void GetModelCachePath( char *sourcePath, char *cachePath, int cachePathSize )
+{
+    snprintf( cachePath, cachePathSize, "%s.mcache", sourcePath );
+}
+
+inline u64 AlignModelCacheOffset( u64 offset )
+{
+    return ( offset + MODEL_CACHE_ALIGNMENT - 1 ) & ~( ( u64 ) MODEL_CACHE_ALIGNMENT - 1 );
+}
+
+//@NOTE: count elements of elementSize at offset fit in size, written so a corrupt count can't overflow past the check
+inline bool IsModelCacheRangeValid( u64 offset, u64 count, u64 elementSize, u64 size )
+{
+    return offset % MODEL_CACHE_ALIGNMENT == 0 && offset <= size && count <= ( size - offset ) / elementSize;
+}
+
+//@NOTE: first to first + count lies within total
+inline bool IsModelCacheSpanValid( u64 first, u64 count, u64 total )
+{
+    return first <= total && count <= total - first;
+}
+
+// Checks the stamps, then every block against the file size and every mesh against the blocks, so a truncated or
+// corrupt cache is rejected before anything points into it
+internal bool IsModelCacheValid( Asset_File *cache, File_Stamp stamp, u32 loadFlags )
+{
+    Model_Cache_Header *header = ( Model_Cache_Header * ) cache->memory;
+    bool valid = cache->size >= sizeof( Model_Cache_Header ) &&
+                 header->magic == MODEL_CACHE_MAGIC &&
+                 header->version == MODEL_CACHE_VERSION &&
+                 header->vertexSize == sizeof( Vertex ) &&
+                 header->sourceSize == stamp.size &&
+                 header->sourceWriteTime == stamp.lastWriteTime &&
+                 header->loadFlags == loadFlags &&
+                 header->materialLibrary[ sizeof( header->materialLibrary ) - 1 ] == '\0' &&
+                 header->fileSize == cache->size &&
+                 IsModelCacheRangeValid( header->meshesOffset, header->meshesCount, sizeof( Model_Cache_Mesh ), cache->size ) &&
+                 IsModelCacheRangeValid( header->texturesOffset, header->texturesCount, sizeof( Texture_Reference ), cache->size ) &&
+                 IsModelCacheRangeValid( header->verticesOffset, header->verticesCount, sizeof( Vertex ), cache->size ) &&
+                 IsModelCacheRangeValid( header->indicesOffset, header->indicesCount, sizeof( u32 ), cache->size );
+
+    Model_Cache_Mesh *cacheMeshes = valid ? ( Model_Cache_Mesh * ) ( ( u8 * ) cache->memory + header->meshesOffset ) : 0;
+    for ( u32 i = 0; valid && i < header->meshesCount; ++i )
+    {
+        Model_Cache_Mesh *cacheMesh = &cacheMeshes[ i ];
+        valid = IsModelCacheSpanValid( cacheMesh->firstVertex, cacheMesh->verticesCount, header->verticesCount ) &&
+                IsModelCacheSpanValid( cacheMesh->firstIndex, cacheMesh->indicesCount, header->indicesCount ) &&
+                IsModelCacheSpanValid( cacheMesh->firstTexture, cacheMesh->texturesCount, header->texturesCount ) &&
+                cacheMesh->lodsCount <= MESH_MAX_LODS;
+
+        //@NOTE: Levels index into the index range of their mesh
+        for ( u32 j = 0; valid && j < cacheMesh->lodsCount; ++j )
+        {
+            valid = IsModelCacheSpanValid( cacheMesh->lods[ j ].firstIndex, cacheMesh->lods[ j ].indexCount, cacheMesh->indicesCount );
+        }
+    }
+
+    Texture_Reference *textures = valid ? ( Texture_Reference * ) ( ( u8 * ) cache->memory + header->texturesOffset ) : 0;
+    for ( u64 i = 0; valid && i < header->texturesCount; ++i )
+    {
+        valid = textures[ i ].path[ sizeof( textures[ i ].path ) - 1 ] == '\0';
+    }
+
+    if ( valid && header->materialLibrary[ 0 ] )
+    {
+        File_Stamp materialStamp;
+        valid = GetAssetStamp( header->materialLibrary, &materialStamp ) &&
+                header->materialLibrarySize == materialStamp.size &&
+                header->materialLibraryWriteTime == materialStamp.lastWriteTime;
+    }
+    return valid;
+}
+
+// Maps the cache of sourcePath (or finds it in the package) and points meshes into it, nothing is copied.
+// The mapping has to stay alive for as long as the mesh data is used. Returns false when there is no cache, it is stale
+// or it was written with other load flags.
+internal bool ReadModelCache( char *sourcePath, u32 loadFlags, Asset_File *cache, Mesh_Data **meshes, int *meshesCount )
+{
+    File_Stamp stamp;
+    if ( !GetAssetStamp( sourcePath, &stamp ) ) { return false; }
+
+    char cachePath[ 256 ];
+    GetModelCachePath( sourcePath, cachePath, sizeof( cachePath ) );
+    if ( !OpenAssetFile( cachePath, cache ) ) { return false; }
+
+    bool valid = IsModelCacheValid( cache, stamp, loadFlags );
+
+    //@NOTE: WriteModelCache always writes the loose file, so a stale packed cache would otherwise reimport every run
+    if ( !valid && IsPackedAssetFile( cache ) )
+    {
+        CloseAssetFile( cache );
+        valid = OpenLooseAssetFile( cachePath, cache ) && IsModelCacheValid( cache, stamp, loadFlags );
+    }
+
+    if ( !valid )
+    {
+        printf( "Model cache is stale or invalid: %s\n", cachePath );
+        CloseAssetFile( cache );
+        return false;
+    }
+
+    Model_Cache_Header *header = ( Model_Cache_Header * ) cache->memory;
+    u8 *base = ( u8 * ) cache->memory;
+    Model_Cache_Mesh *cacheMeshes = ( Model_Cache_Mesh * ) ( base + header->meshesOffset );
+    Texture_Reference *textures = ( Texture_Reference * ) ( base + header->texturesOffset );
+    Vertex *vertices = ( Vertex * ) ( base + header->verticesOffset );
+    u32 *indices = ( u32 * ) ( base + header->indicesOffset );
+
+    Mesh_Data *result = ( Mesh_Data * ) malloc( header->meshesCount * sizeof( Mesh_Data ) );
+    for ( u32 i = 0; i < header->meshesCount; ++i )
+    {
+        Model_Cache_Mesh *cacheMesh = &cacheMeshes[ i ];
+        Mesh_Data *mesh = &result[ i ];
+        mesh->vertices = vertices + cacheMesh->firstVertex;
+        mesh->verticesCount = ( int ) cacheMesh->verticesCount;
+        mesh->indices = indices + cacheMesh->firstIndex;
+        mesh->indicesCount = ( int ) cacheMesh->indicesCount;
+        mesh->textures = cacheMesh->texturesCount ? textures + cacheMesh->firstTexture : 0;
+        mesh->texturesCount = ( int ) cacheMesh->texturesCount;
+        mesh->meshlets = 0;
+        mesh->meshletsCount = 0;
+        memcpy( mesh->lods, cacheMesh->lods, sizeof( mesh->lods ) );
+        mesh->lodsCount = ( int ) cacheMesh->lodsCount;
+        mesh->bounds = cacheMesh->bounds;
+    }
+
+    *meshes = result;
+    *meshesCount = ( int ) header->meshesCount;
+    return true;
+}
+
+// materialLibrary is the path of the .mtl the meshes were imported with, or 0
+internal bool WriteModelCache( char *sourcePath, u32 loadFlags, char *materialLibrary, Mesh_Data *meshes, int meshesCount )
+{
+    File_Stamp stamp;
+    if ( !GetAssetStamp( sourcePath, &stamp ) ) { return false; }
+
+    File_Stamp materialStamp = {};
+    if ( materialLibrary && materialLibrary[ 0 ] && !GetAssetStamp( materialLibrary, &materialStamp ) ) { return false; }
+
+    Model_Cache_Header header = {};
+    header.magic = MODEL_CACHE_MAGIC;
+    header.version = MODEL_CACHE_VERSION;
+    header.vertexSize = sizeof( Vertex );
+    header.meshesCount = ( u32 ) meshesCount;
+    header.sourceSize = stamp.size;
+    header.sourceWriteTime = stamp.lastWriteTime;
+    header.loadFlags = loadFlags;
+    if ( materialLibrary && materialLibrary[ 0 ] )
+    {
+        strncpy_s( header.materialLibrary, materialLibrary, sizeof( header.materialLibrary ) - 1 );
+        header.materialLibrarySize = materialStamp.size;
+        header.materialLibraryWriteTime = materialStamp.lastWriteTime;
+    }
+
+    Model_Cache_Mesh *cacheMeshes = ( Model_Cache_Mesh * ) calloc( meshesCount, sizeof( Model_Cache_Mesh ) );
+    defer { free( cacheMeshes ); };
+
+    for ( int i = 0; i < meshesCount; ++i )
+    {
+        cacheMeshes[ i ].firstVertex = header.verticesCount;
+        cacheMeshes[ i ].firstIndex = header.indicesCount;
+        cacheMeshes[ i ].firstTexture = header.texturesCount;
+        cacheMeshes[ i ].verticesCount = ( u32 ) meshes[ i ].verticesCount;
+        cacheMeshes[ i ].indicesCount = ( u32 ) meshes[ i ].indicesCount;
+        cacheMeshes[ i ].texturesCount = ( u32 ) meshes[ i ].texturesCount;
+        cacheMeshes[ i ].lodsCount = ( u32 ) meshes[ i ].lodsCount;
+        memcpy( cacheMeshes[ i ].lods, meshes[ i ].lods, sizeof( cacheMeshes[ i ].lods ) );
+        cacheMeshes[ i ].bounds = meshes[ i ].bounds;
+
+        header.verticesCount += meshes[ i ].verticesCount;
+        header.indicesCount += meshes[ i ].indicesCount;
+        header.texturesCount += meshes[ i ].texturesCount;
+    }
+
+    header.meshesOffset = AlignModelCacheOffset( sizeof( Model_Cache_Header ) );
+    header.texturesOffset = AlignModelCacheOffset( header.meshesOffset + meshesCount * sizeof( Model_Cache_Mesh ) );
+    header.verticesOffset = AlignModelCacheOffset( header.texturesOffset + header.texturesCount * sizeof( Texture_Reference ) );
+    header.indicesOffset = AlignModelCacheOffset( header.verticesOffset + header.verticesCount * sizeof( Vertex ) );
+    header.fileSize = header.indicesOffset + header.indicesCount * sizeof( u32 );
+
+    char cachePath[ 256 ];
+    GetModelCachePath( sourcePath, cachePath, sizeof( cachePath ) );
+
+    FILE *file;
+    fopen_s( &file, cachePath, "wb" );
+    if ( !file )
+    {
+        printf( "Failed to open model cache for writing: %s\n", cachePath );
+        return false;
+    }
+
+    u8 zeros[ MODEL_CACHE_ALIGNMENT ] = {};
+    u64 written = 0;
+    auto writeAt = [ & ]( u64 offset, void *data, u64 size ) {
+        fwrite( zeros, 1, ( size_t ) ( offset - written ), file );
+        fwrite( data, 1, ( size_t ) size, file );
+        written = offset + size;
+    };
+
+    writeAt( 0, &header, sizeof( header ) );
+    writeAt( header.meshesOffset, cacheMeshes, meshesCount * sizeof( Model_Cache_Mesh ) );
+
+    u64 offset = header.texturesOffset;
+    for ( int i = 0; i < meshesCount; ++i )
+    {
+        writeAt( offset, meshes[ i ].textures, meshes[ i ].texturesCount * sizeof( Texture_Reference ) );
+        offset = written;
+    }
+
+    offset = header.verticesOffset;
+    for ( int i = 0; i < meshesCount; ++i )
+    {
+        writeAt( offset, meshes[ i ].vertices, meshes[ i ].verticesCount * sizeof( Vertex ) );
+        offset = written;
+    }
+
+    offset = header.indicesOffset;
+    for ( int i = 0; i < meshesCount; ++i )
+    {
+        writeAt( offset, meshes[ i ].indices, meshes[ i ].indicesCount * sizeof( u32 ) );
+        offset = written;
+    }
+
+    bool result = ferror( file ) == 0 && written == header.fileSize;
+    fclose( file );
+
+    if ( !result )
+    {
+        printf( "Failed to write model cache: %s\n", cachePath );
+        remove( cachePath );
+    }
+    return result;
+}
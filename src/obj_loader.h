@@ -0,0 +1,681 @@
+#pragma once
+#include <glm.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "utils/utils.h"
+#include "mesh.h"
+#include "jobs.h"
+#include "package.h"
+#include "asset_io.h"
+
+// Wavefront OBJ/MTL importer producing the same Mesh_Data as the Assimp path (triangulated, UVs flipped,
+// diffuse then specular textures). The file is split into line aligned chunks parsed on the job queue,
+// then one mesh per material is built with a hash table that welds identical position/uv/normal triplets.
+
+#define OBJ_CHUNK_SIZE ( 512 * 1024 )
+
+#define OBJ_CORNER_LOCAL_POSITION ( 1 << 0 )
+#define OBJ_CORNER_LOCAL_TEXTURE_COORDINATES ( 1 << 1 )
+#define OBJ_CORNER_LOCAL_NORMAL ( 1 << 2 )
+
+struct Obj_Corner
+{
+    //@NOTE: A 1 based global index, 0 is missing. Relative indices are kept as a 0 based chunk local index and
+    // flagged in local, negative when they point into an earlier chunk, and resolved once the chunk offsets are known.
+    s32 position;
+    s32 textureCoordinates;
+    s32 normal;
+    u32 local;
+};
+
+struct Obj_Material_Switch
+{
+    int firstTriangle;
+    char name[ 128 ];
+};
+
+struct Obj_Chunk
+{
+    char *start;
+    char *end;
+
+    std::vector< glm::vec3 > positions;
+    std::vector< glm::vec2 > textureCoordinates;
+    std::vector< glm::vec3 > normals;
+    std::vector< Obj_Corner > corners;
+    std::vector< Obj_Material_Switch > materialSwitches;
+    char materialLibrary[ 128 ];
+
+    int positionsOffset;
+    int textureCoordinatesOffset;
+    int normalsOffset;
+    bool failed;
+};
+
+struct Obj_Material
+{
+    char name[ 128 ];
+    char diffuse[ 128 ];
+    char specular[ 128 ];
+};
+
+struct Obj_Range
+{
+    int chunk;
+    int firstTriangle;
+    int trianglesCount;
+};
+
+struct Obj_Group
+{
+    int material;
+    std::vector< Obj_Range > ranges;
+    int trianglesCount;
+};
+
+inline bool IsObjSpace( char c )
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline char *SkipObjSpaces( char *at, char *end )
+{
+    while ( at < end && IsObjSpace( *at ) ) { ++at; }
+    return at;
+}
+
+inline char *SkipObjLine( char *at, char *end )
+{
+    while ( at < end && *at != '\n' ) { ++at; }
+    return at < end ? at + 1 : end;
+}
+
+global_variable float64 objPowersOf10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// Digits are accumulated into an integer and scaled once, plenty for the 6-7 significant digits exporters write
+internal char *ParseObjFloat( char *at, char *end, float32 *result )
+{
+    at = SkipObjSpaces( at, end );
+
+    bool negative = false;
+    if ( at < end && ( *at == '-' || *at == '+' ) )
+    {
+        negative = *at == '-';
+        ++at;
+    }
+
+    u64 mantissa = 0;
+    int exponent = 0;
+    int digitsCount = 0;
+    for ( ; at < end && *at >= '0' && *at <= '9'; ++at )
+    {
+        if ( digitsCount < 18 ) { mantissa = mantissa * 10 + ( *at - '0' ); ++digitsCount; }
+        else { ++exponent; }
+    }
+
+    if ( at < end && *at == '.' )
+    {
+        for ( ++at; at < end && *at >= '0' && *at <= '9'; ++at )
+        {
+            if ( digitsCount < 18 ) { mantissa = mantissa * 10 + ( *at - '0' ); ++digitsCount; --exponent; }
+        }
+    }
+
+    if ( at < end && ( *at == 'e' || *at == 'E' ) )
+    {
+        ++at;
+        bool negativeExponent = false;
+        if ( at < end && ( *at == '-' || *at == '+' ) )
+        {
+            negativeExponent = *at == '-';
+            ++at;
+        }
+
+        int value = 0;
+        for ( ; at < end && *at >= '0' && *at <= '9'; ++at )
+        {
+            if ( value < 1000 ) { value = value * 10 + ( *at - '0' ); }
+        }
+        exponent += negativeExponent ? -value : value;
+    }
+
+    float64 number = ( float64 ) mantissa;
+    while ( exponent > 22 ) { number *= 1e22; exponent -= 22; }
+    while ( exponent < -22 ) { number /= 1e22; exponent += 22; }
+    number = exponent < 0 ? number / objPowersOf10[ -exponent ] : number * objPowersOf10[ exponent ];
+
+    *result = ( float32 ) ( negative ? -number : number );
+    return at;
+}
+
+internal char *ParseObjInt( char *at, char *end, s32 *result )
+{
+    bool negative = false;
+    if ( at < end && *at == '-' )
+    {
+        negative = true;
+        ++at;
+    }
+
+    s32 value = 0;
+    for ( ; at < end && *at >= '0' && *at <= '9'; ++at ) { value = value * 10 + ( *at - '0' ); }
+    *result = negative ? -value : value;
+    return at;
+}
+
+// Copies the rest of the line without surrounding spaces
+internal void ParseObjName( char *at, char *end, char *result, int resultSize )
+{
+    at = SkipObjSpaces( at, end );
+    char *lineEnd = at;
+    while ( lineEnd < end && *lineEnd != '\n' ) { ++lineEnd; }
+    while ( lineEnd > at && IsObjSpace( lineEnd[ -1 ] ) ) { --lineEnd; }
+
+    int count = ( int ) ( lineEnd - at );
+    if ( count > resultSize - 1 ) { count = resultSize - 1; }
+    memcpy( result, at, count );
+    result[ count ] = '\0';
+}
+
+// Turns a relative (negative) index into a chunk local one, from what the chunk has seen so far
+inline void SetObjCornerLocal( s32 *index, int localCount, u32 *local, u32 flag )
+{
+    if ( *index < 0 )
+    {
+        *index += localCount;
+        *local |= flag;
+    }
+}
+
+internal char *ParseObjFace( Obj_Chunk *chunk, char *at, char *end )
+{
+    Obj_Corner corners[ 64 ];
+    int cornersCount = 0;
+
+    for ( ;; )
+    {
+        at = SkipObjSpaces( at, end );
+        if ( at >= end || *at == '\n' || *at == '#' ) { break; }
+
+        Obj_Corner corner = {};
+        at = ParseObjInt( at, end, &corner.position );
+        if ( at < end && *at == '/' )
+        {
+            ++at;
+            if ( at < end && *at != '/' ) { at = ParseObjInt( at, end, &corner.textureCoordinates ); }
+            if ( at < end && *at == '/' ) { at = ParseObjInt( at + 1, end, &corner.normal ); }
+        }
+
+        if ( corner.position == 0 || ( at < end && !IsObjSpace( *at ) && *at != '\n' ) )
+        {
+            chunk->failed = true;
+            return SkipObjLine( at, end );
+        }
+
+        SetObjCornerLocal( &corner.position, ( int ) chunk->positions.size(), &corner.local, OBJ_CORNER_LOCAL_POSITION );
+        SetObjCornerLocal( &corner.textureCoordinates, ( int ) chunk->textureCoordinates.size(), &corner.local,
+                           OBJ_CORNER_LOCAL_TEXTURE_COORDINATES );
+        SetObjCornerLocal( &corner.normal, ( int ) chunk->normals.size(), &corner.local, OBJ_CORNER_LOCAL_NORMAL );
+        if ( cornersCount == 64 )
+        {
+            chunk->failed = true;
+            return SkipObjLine( at, end );
+        }
+        corners[ cornersCount++ ] = corner;
+    }
+
+    //@NOTE: Polygons are fanned, same as aiProcess_Triangulate does for convex faces
+    for ( int i = 2; i < cornersCount; ++i )
+    {
+        chunk->corners.push_back( corners[ 0 ] );
+        chunk->corners.push_back( corners[ i - 1 ] );
+        chunk->corners.push_back( corners[ i ] );
+    }
+    return SkipObjLine( at, end );
+}
+
+internal void ParseObjChunk( Obj_Chunk *chunk )
+{
+    char *at = chunk->start;
+    char *end = chunk->end;
+
+    while ( at < end )
+    {
+        at = SkipObjSpaces( at, end );
+        if ( at >= end ) { break; }
+
+        if ( at[ 0 ] == 'v' && at + 1 < end && IsObjSpace( at[ 1 ] ) )
+        {
+            glm::vec3 position;
+            at = ParseObjFloat( at + 1, end, &position.x );
+            at = ParseObjFloat( at, end, &position.y );
+            at = ParseObjFloat( at, end, &position.z );
+            chunk->positions.push_back( position );
+        }
+        else if ( at[ 0 ] == 'v' && at + 2 < end && at[ 1 ] == 't' && IsObjSpace( at[ 2 ] ) )
+        {
+            glm::vec2 textureCoordinates;
+            at = ParseObjFloat( at + 2, end, &textureCoordinates.x );
+            at = ParseObjFloat( at, end, &textureCoordinates.y );
+            textureCoordinates.y = 1.0f - textureCoordinates.y;
+            chunk->textureCoordinates.push_back( textureCoordinates );
+        }
+        else if ( at[ 0 ] == 'v' && at + 2 < end && at[ 1 ] == 'n' && IsObjSpace( at[ 2 ] ) )
+        {
+            glm::vec3 normal;
+            at = ParseObjFloat( at + 2, end, &normal.x );
+            at = ParseObjFloat( at, end, &normal.y );
+            at = ParseObjFloat( at, end, &normal.z );
+            chunk->normals.push_back( normal );
+        }
+        else if ( at[ 0 ] == 'f' && at + 1 < end && IsObjSpace( at[ 1 ] ) )
+        {
+            at = ParseObjFace( chunk, at + 1, end );
+            continue;
+        }
+        else if ( end - at > 7 && strncmp( at, "usemtl", 6 ) == 0 && IsObjSpace( at[ 6 ] ) )
+        {
+            Obj_Material_Switch materialSwitch;
+            materialSwitch.firstTriangle = ( int ) chunk->corners.size() / 3;
+            ParseObjName( at + 6, end, materialSwitch.name, sizeof( materialSwitch.name ) );
+            chunk->materialSwitches.push_back( materialSwitch );
+        }
+        else if ( end - at > 7 && strncmp( at, "mtllib", 6 ) == 0 && IsObjSpace( at[ 6 ] ) )
+        {
+            ParseObjName( at + 6, end, chunk->materialLibrary, sizeof( chunk->materialLibrary ) );
+        }
+
+        at = SkipObjLine( at, end );
+    }
+}
+
+internal void ParseObjChunksJob( void *data, int start, int end )
+{
+    Obj_Chunk *chunks = ( Obj_Chunk * ) data;
+    for ( int i = start; i < end; ++i )
+    {
+        ParseObjChunk( &chunks[ i ] );
+    }
+}
+
+inline char *SkipObjToken( char *at, char *end )
+{
+    while ( at < end && !IsObjSpace( *at ) && *at != '\n' ) { ++at; }
+    return SkipObjSpaces( at, end );
+}
+
+inline bool IsObjNumber( char *at, char *end )
+{
+    if ( at < end && ( *at == '-' || *at == '+' ) ) { ++at; }
+    return at < end && ( ( *at >= '0' && *at <= '9' ) || *at == '.' );
+}
+
+// Texture options (-bm 1.0, -o 0 0 ...) come before the file name, the rest of the line is the path and may hold spaces
+internal void ParseMtlTexture( char *at, char *end, char *result, int resultSize )
+{
+    at = SkipObjSpaces( at, end );
+    while ( end - at > 2 && *at == '-' )
+    {
+        char *option = at + 1;
+        at = SkipObjToken( at, end );
+
+        //@NOTE: -o, -s and -t take one to three numbers, -mm two, every other option one argument
+        int argumentsCount = 1;
+        if ( ( option[ 0 ] == 'o' || option[ 0 ] == 's' || option[ 0 ] == 't' ) && IsObjSpace( option[ 1 ] ) ) { argumentsCount = 3; }
+        else if ( option[ 0 ] == 'm' && option[ 1 ] == 'm' && IsObjSpace( option[ 2 ] ) ) { argumentsCount = 2; }
+
+        for ( int i = 0; i < argumentsCount && at < end && *at != '\n'; ++i )
+        {
+            if ( i && !IsObjNumber( at, end ) ) { break; }
+            at = SkipObjToken( at, end );
+        }
+    }
+    ParseObjName( at, end, result, resultSize );
+}
+
+// Same as OpenAssetFile, recording the file in ioStats when it isn't 0
+internal bool OpenObjFile( char *path, Asset_File *file, std::vector< Asset_IO_File_Stats > *ioStats )
+{
+    if ( !ioStats ) { return OpenAssetFile( path, file ); }
+    if ( !OpenRecordedAssetFile( path, file, ioStats ) ) { return false; }
+
+    //@NOTE: Parsed in place, every byte is read once and the page faults are paid by the parse
+    ioStats->back().bytesRead = file->size;
+    ioStats->back().readsCount = 1;
+    return true;
+}
+
+internal void ParseMtl( char *path, std::vector< Obj_Material > *materials, std::vector< Asset_IO_File_Stats > *ioStats )
+{
+    Asset_File file;
+    if ( !OpenObjFile( path, &file, ioStats ) )
+    {
+        printf( "Failed to open material library: %s\n", path );
+        return;
+    }
+
+    char *at = ( char * ) file.memory;
+    char *end = at + file.size;
+    Obj_Material *material = 0;
+
+    while ( at < end )
+    {
+        at = SkipObjSpaces( at, end );
+        if ( end - at > 7 && strncmp( at, "newmtl", 6 ) == 0 && IsObjSpace( at[ 6 ] ) )
+        {
+            materials->push_back( Obj_Material{} );
+            material = &materials->back();
+            ParseObjName( at + 6, end, material->name, sizeof( material->name ) );
+        }
+        else if ( material && end - at > 7 && strncmp( at, "map_Kd", 6 ) == 0 && IsObjSpace( at[ 6 ] ) )
+        {
+            ParseMtlTexture( at + 6, end, material->diffuse, sizeof( material->diffuse ) );
+        }
+        else if ( material && end - at > 7 && strncmp( at, "map_Ks", 6 ) == 0 && IsObjSpace( at[ 6 ] ) )
+        {
+            ParseMtlTexture( at + 6, end, material->specular, sizeof( material->specular ) );
+        }
+        at = SkipObjLine( at, end );
+    }
+
+    CloseAssetFile( &file );
+}
+
+struct Build_Obj_Meshes_Job
+{
+    Obj_Chunk *chunks;
+    Obj_Group *groups;
+    Obj_Material *materials;
+
+    glm::vec3 *positions;
+    int positionsCount;
+    glm::vec2 *textureCoordinates;
+    int textureCoordinatesCount;
+    glm::vec3 *normals;
+    int normalsCount;
+
+    Mesh_Data *meshes;
+    std::atomic< bool > failed;
+};
+
+//@NOTE: 0 based global index, -1 when missing and -2 for a relative index pointing before the first element
+inline int ResolveObjIndex( s32 index, bool local, int chunkOffset )
+{
+    if ( !local ) { return index - 1; }
+    return chunkOffset + index >= 0 ? chunkOffset + index : -2;
+}
+
+inline u32 HashObjCorner( int position, int textureCoordinates, int normal )
+{
+    u32 hash = ( u32 ) position * 0x9e3779b1u;
+    hash ^= ( u32 ) textureCoordinates * 0x85ebca77u + ( hash << 6 ) + ( hash >> 2 );
+    hash ^= ( u32 ) normal * 0xc2b2ae3du + ( hash << 6 ) + ( hash >> 2 );
+    return hash;
+}
+
+internal bool BuildObjMesh( Build_Obj_Meshes_Job *job, Obj_Group *group, Mesh_Data *mesh )
+{
+    int cornersCount = group->trianglesCount * 3;
+
+    u32 slotsCount = 16;
+    while ( slotsCount < ( u32 ) cornersCount * 2 ) { slotsCount *= 2; }
+
+    //@NOTE: A slot holds vertex index + 1 and the triplet that produced it, 0 is empty
+    struct Slot
+    {
+        u32 vertex;
+        int position;
+        int textureCoordinates;
+        int normal;
+    };
+    Slot *slots = ( Slot * ) calloc( slotsCount, sizeof( Slot ) );
+    defer { free( slots ); };
+
+    *mesh = {};
+    mesh->vertices = ( Vertex * ) malloc( cornersCount * sizeof( Vertex ) );
+    mesh->indices = ( u32 * ) malloc( cornersCount * sizeof( u32 ) );
+
+    for ( Obj_Range &range : group->ranges )
+    {
+        Obj_Chunk *chunk = &job->chunks[ range.chunk ];
+        Obj_Corner *corners = chunk->corners.data() + range.firstTriangle * 3;
+
+        for ( int i = 0; i < range.trianglesCount * 3; ++i )
+        {
+            Obj_Corner corner = corners[ i ];
+            int position = ResolveObjIndex( corner.position, corner.local & OBJ_CORNER_LOCAL_POSITION, chunk->positionsOffset );
+            int textureCoordinates = ResolveObjIndex( corner.textureCoordinates, corner.local & OBJ_CORNER_LOCAL_TEXTURE_COORDINATES,
+                                                      chunk->textureCoordinatesOffset );
+            int normal = ResolveObjIndex( corner.normal, corner.local & OBJ_CORNER_LOCAL_NORMAL, chunk->normalsOffset );
+
+            if ( position < 0 || position >= job->positionsCount ||
+                 textureCoordinates < -1 || textureCoordinates >= job->textureCoordinatesCount ||
+                 normal < -1 || normal >= job->normalsCount )
+            {
+                return false;
+            }
+
+            u32 mask = slotsCount - 1;
+            u32 slot = HashObjCorner( position, textureCoordinates, normal ) & mask;
+            while ( slots[ slot ].vertex &&
+                    ( slots[ slot ].position != position || slots[ slot ].textureCoordinates != textureCoordinates ||
+                      slots[ slot ].normal != normal ) )
+            {
+                slot = ( slot + 1 ) & mask;
+            }
+
+            if ( !slots[ slot ].vertex )
+            {
+                Vertex *vertex = &mesh->vertices[ mesh->verticesCount ];
+                vertex->position = job->positions[ position ];
+                vertex->normal = normal >= 0 ? job->normals[ normal ] : glm::vec3( 0.0f, 0.0f, 0.0f );
+                vertex->textureCoordinates = textureCoordinates >= 0 ? job->textureCoordinates[ textureCoordinates ] :
+                                                                       glm::vec2( 0.0f, 0.0f );
+                slots[ slot ] = Slot{ ( u32 ) ++mesh->verticesCount, position, textureCoordinates, normal };
+            }
+            mesh->indices[ mesh->indicesCount++ ] = slots[ slot ].vertex - 1;
+        }
+    }
+
+    //@NOTE: Allocated for the worst case of no shared corners
+    mesh->vertices = ( Vertex * ) realloc( mesh->vertices, mesh->verticesCount * sizeof( Vertex ) );
+
+    if ( group->material >= 0 )
+    {
+        Obj_Material *material = &job->materials[ group->material ];
+        mesh->textures = ( Texture_Reference * ) malloc( 2 * sizeof( Texture_Reference ) );
+        if ( material->diffuse[ 0 ] )
+        {
+            mesh->textures[ mesh->texturesCount ].type = DIFFUSE;
+            strcpy_s( mesh->textures[ mesh->texturesCount++ ].path, material->diffuse );
+        }
+        if ( material->specular[ 0 ] )
+        {
+            mesh->textures[ mesh->texturesCount ].type = SPECULAR;
+            strcpy_s( mesh->textures[ mesh->texturesCount++ ].path, material->specular );
+        }
+    }
+    return true;
+}
+
+internal void BuildObjMeshesJob( void *data, int start, int end )
+{
+    Build_Obj_Meshes_Job *job = ( Build_Obj_Meshes_Job * ) data;
+    for ( int i = start; i < end; ++i )
+    {
+        if ( !BuildObjMesh( job, &job->groups[ i ], &job->meshes[ i ] ) )
+        {
+            job->failed = true;
+        }
+    }
+}
+
+internal int GetObjGroup( char *materialName, std::vector< Obj_Group > *groups, std::vector< std::string > *groupNames,
+                         std::vector< Obj_Material > *materials )
+{
+    for ( int i = 0; i < ( int ) groupNames->size(); ++i )
+    {
+        if ( ( *groupNames )[ i ] == materialName ) { return i; }
+    }
+
+    Obj_Group group = {};
+    group.material = -1;
+    for ( int i = 0; i < ( int ) materials->size(); ++i )
+    {
+        if ( strcmp( ( *materials )[ i ].name, materialName ) == 0 ) { group.material = i; }
+    }
+
+    groups->push_back( group );
+    groupNames->push_back( materialName );
+    return ( int ) groups->size() - 1;
+}
+
+internal void FreeObjMeshes( Mesh_Data *meshes, int meshesCount )
+{
+    for ( int i = 0; i < meshesCount; ++i )
+    {
+        free( meshes[ i ].vertices );
+        free( meshes[ i ].indices );
+        free( meshes[ i ].textures );
+    }
+    free( meshes );
+}
+
+// Fills meshes and meshesCount of result, returns false when the file can't be read or isn't valid OBJ
+// so the caller can fall back to Assimp. materialPath gets the path of the material library, empty when there is none.
+// The files read are recorded in ioStats when it isn't 0.
+internal bool ImportObj( char *path, char *directory, Mesh_Data **meshes, int *meshesCount, char *materialPath, int materialPathSize,
+                         std::vector< Asset_IO_File_Stats > *ioStats = 0, Job_Queue *queue = 0 )
+{
+    Asset_File file;
+    if ( !OpenObjFile( path, &file, ioStats ) ) { return false; }
+    defer { CloseAssetFile( &file ); };
+
+    char *text = ( char * ) file.memory;
+    char *textEnd = text + file.size;
+
+    std::vector< Obj_Chunk > chunks( ( size_t ) ( file.size / OBJ_CHUNK_SIZE + 1 ) );
+    char *chunkStart = text;
+    for ( Obj_Chunk &chunk : chunks )
+    {
+        char *chunkEnd = chunkStart + OBJ_CHUNK_SIZE < textEnd ? chunkStart + OBJ_CHUNK_SIZE : textEnd;
+        while ( chunkEnd < textEnd && chunkEnd[ -1 ] != '\n' ) { ++chunkEnd; }
+        chunk.start = chunkStart;
+        chunk.end = chunkEnd;
+        chunkStart = chunkEnd;
+    }
+
+    ParallelFor( queue, ( int ) chunks.size(), 1, ParseObjChunksJob, chunks.data() );
+
+    //@NOTE: Chunk arrays are laid out one after another, the offsets turn chunk local indices into global ones
+    int positionsCount = 0;
+    int textureCoordinatesCount = 0;
+    int normalsCount = 0;
+    char materialLibrary[ 128 ] = "";
+    for ( Obj_Chunk &chunk : chunks )
+    {
+        if ( chunk.failed )
+        {
+            printf( "Unsupported OBJ face in %s\n", path );
+            return false;
+        }
+
+        chunk.positionsOffset = positionsCount;
+        chunk.textureCoordinatesOffset = textureCoordinatesCount;
+        chunk.normalsOffset = normalsCount;
+        positionsCount += ( int ) chunk.positions.size();
+        textureCoordinatesCount += ( int ) chunk.textureCoordinates.size();
+        normalsCount += ( int ) chunk.normals.size();
+        if ( chunk.materialLibrary[ 0 ] ) { strcpy_s( materialLibrary, chunk.materialLibrary ); }
+    }
+
+    std::vector< glm::vec3 > positions;
+    std::vector< glm::vec2 > textureCoordinates;
+    std::vector< glm::vec3 > normals;
+    positions.reserve( positionsCount );
+    textureCoordinates.reserve( textureCoordinatesCount );
+    normals.reserve( normalsCount );
+    for ( Obj_Chunk &chunk : chunks )
+    {
+        positions.insert( positions.end(), chunk.positions.begin(), chunk.positions.end() );
+        textureCoordinates.insert( textureCoordinates.end(), chunk.textureCoordinates.begin(), chunk.textureCoordinates.end() );
+        normals.insert( normals.end(), chunk.normals.begin(), chunk.normals.end() );
+    }
+
+    std::vector< Obj_Material > materials;
+    materialPath[ 0 ] = '\0';
+    if ( materialLibrary[ 0 ] )
+    {
+        snprintf( materialPath, materialPathSize, "%s/%s", directory, materialLibrary );
+        ParseMtl( materialPath, &materials, ioStats );
+    }
+
+    // One group per material in order of first use, faces before any usemtl get no material
+    std::vector< Obj_Group > groups;
+    std::vector< std::string > groupNames;
+    int currentGroup = -1;
+    for ( int i = 0; i < ( int ) chunks.size(); ++i )
+    {
+        Obj_Chunk *chunk = &chunks[ i ];
+        int trianglesCount = ( int ) chunk->corners.size() / 3;
+        int switchIndex = 0;
+        int triangle = 0;
+
+        //@NOTE: Switches after the last face of the chunk still apply to the next chunk
+        while ( triangle < trianglesCount || switchIndex < ( int ) chunk->materialSwitches.size() )
+        {
+            while ( switchIndex < ( int ) chunk->materialSwitches.size() &&
+                    chunk->materialSwitches[ switchIndex ].firstTriangle <= triangle )
+            {
+                currentGroup = GetObjGroup( chunk->materialSwitches[ switchIndex++ ].name, &groups, &groupNames, &materials );
+            }
+            if ( triangle >= trianglesCount ) { break; }
+
+            if ( currentGroup < 0 ) { currentGroup = GetObjGroup( "", &groups, &groupNames, &materials ); }
+
+            int rangeEnd = switchIndex < ( int ) chunk->materialSwitches.size() ?
+                           chunk->materialSwitches[ switchIndex ].firstTriangle : trianglesCount;
+
+            Obj_Group *group = &groups[ currentGroup ];
+            group->ranges.push_back( Obj_Range{ i, triangle, rangeEnd - triangle } );
+            group->trianglesCount += rangeEnd - triangle;
+            triangle = rangeEnd;
+        }
+    }
+
+    for ( int i = ( int ) groups.size() - 1; i >= 0; --i )
+    {
+        if ( groups[ i ].trianglesCount == 0 ) { groups.erase( groups.begin() + i ); }
+    }
+
+    Build_Obj_Meshes_Job job;
+    job.chunks = chunks.data();
+    job.groups = groups.data();
+    job.materials = materials.data();
+    job.positions = positions.data();
+    job.positionsCount = positionsCount;
+    job.textureCoordinates = textureCoordinates.data();
+    job.textureCoordinatesCount = textureCoordinatesCount;
+    job.normals = normals.data();
+    job.normalsCount = normalsCount;
+    job.meshes = ( Mesh_Data * ) calloc( groups.size() + 1, sizeof( Mesh_Data ) );
+    job.failed = false;
+
+    ParallelFor( queue, ( int ) groups.size(), 1, BuildObjMeshesJob, &job );
+
+    if ( job.failed )
+    {
+        printf( "OBJ face references a missing vertex in %s\n", path );
+        FreeObjMeshes( job.meshes, ( int ) groups.size() );
+        return false;
+    }
+
+    *meshes = job.meshes;
+    *meshesCount = ( int ) groups.size();
+    return true;
+}
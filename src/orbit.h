@@ -0,0 +1,127 @@
+#pragma once
+#include <glm.hpp>
+#include <glad/glad.h>
+#include <math.h>
+#include "utils/utils.h"
+#include "shader.h"
+#include "model.h"
+#include "instance_transform.h"
+#include "instance_buffer.h"
+#include "frustum.h"
+#include "jobs.h"
+
+// Instances that orbit the origin, described by their orbit instead of a transform. The orbits are uploaded once and
+// orbit_instanced.vert evaluates every instance from the time uniform, so animating them costs no CPU work and no
+// uploads after creation. Nothing is culled, every instance is drawn at the level passed to DrawModelOrbits.
+// GetOrbitInstanceBoxes gives their boxes at any time for CPU side queries such as picking.
+
+//@NOTE: Storage binding orbit_instanced.vert reads the orbits from, indexed by gl_InstanceID
+#define ORBIT_INSTANCES_BINDING 0
+
+#define ORBIT_BOXES_BATCH_SIZE 4096
+
+//@NOTE: Three vec4 for the std430 layout of orbit_instanced.vert
+struct Orbit_Instance
+{
+    float32 radius;
+    float32 phase;           // radians along the orbit at time 0
+    float32 angularVelocity; // radians per second along the orbit
+    float32 scale;
+
+    //@NOTE: The orbit plane is tilted by inclination around the x axis, then turned by ascendingNode around the y axis.
+    // height lifts the orbit off its plane, which thickens a belt without tilting every orbit.
+    float32 inclination;
+    float32 ascendingNode;
+    float32 height;
+    float32 spinVelocity; // radians per second around spinAxis
+
+    glm::vec3 spinAxis; // unit length
+    float32 spinPhase;
+};
+
+struct Orbit_Instances
+{
+    u32 buffer;
+    int count;
+};
+
+// Same as orbit_instanced.vert, for CPU side queries on the animated instances
+inline Instance_Transform GetOrbitInstanceTransform( Orbit_Instance orbit, float32 time )
+{
+    float32 angle = orbit.phase + orbit.angularVelocity * time;
+    glm::vec3 position( cosf( angle ) * orbit.radius, orbit.height, sinf( angle ) * orbit.radius );
+
+    float32 cosInclination = cosf( orbit.inclination );
+    float32 sinInclination = sinf( orbit.inclination );
+    position = glm::vec3( position.x, position.y * cosInclination - position.z * sinInclination, position.y * sinInclination + position.z * cosInclination );
+
+    float32 cosNode = cosf( orbit.ascendingNode );
+    float32 sinNode = sinf( orbit.ascendingNode );
+    position = glm::vec3( position.x * cosNode + position.z * sinNode, position.y, position.z * cosNode - position.x * sinNode );
+
+    float32 spin = ( orbit.spinPhase + orbit.spinVelocity * time ) * 0.5f;
+
+    Instance_Transform result;
+    result.position = position;
+    result.scale = orbit.scale;
+    result.rotation = glm::vec4( orbit.spinAxis * sinf( spin ), cosf( spin ) );
+    return result;
+}
+
+struct Orbit_Boxes_Job
+{
+    Orbit_Instance *orbits;
+    float32 time;
+    glm::vec3 modelMin;
+    glm::vec3 modelMax;
+    glm::vec3 *boxesMin;
+    glm::vec3 *boxesMax;
+};
+
+internal void GetOrbitInstanceBoxesJob( void *data, int start, int end )
+{
+    Orbit_Boxes_Job *job = ( Orbit_Boxes_Job * ) data;
+    for ( int i = start; i < end; ++i )
+    {
+        glm::mat4 transform = GetInstanceMatrix( GetOrbitInstanceTransform( job->orbits[ i ], job->time ) );
+        TransformBox( transform, job->modelMin, job->modelMax, &job->boxesMin[ i ], &job->boxesMax[ i ] );
+    }
+}
+
+// World space boxes of count instances at time, modelMin and modelMax bound the model in its own space
+internal void GetOrbitInstanceBoxes( Orbit_Instance *orbits, int count, float32 time, glm::vec3 modelMin, glm::vec3 modelMax,
+                                     glm::vec3 *boxesMin, glm::vec3 *boxesMax, Job_Queue *queue = 0 )
+{
+    Orbit_Boxes_Job job = { orbits, time, modelMin, modelMax, boxesMin, boxesMax };
+    ParallelFor( queue, count, ORBIT_BOXES_BATCH_SIZE, GetOrbitInstanceBoxesJob, &job );
+}
+
+// The orbits are copied to the GPU, keep them only for GetOrbitInstanceBoxes
+internal Orbit_Instances CreateOrbitInstances( Orbit_Instance *orbits, int count )
+{
+    Orbit_Instances result = {};
+    result.count = count;
+    glGenBuffers( 1, &result.buffer );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, result.buffer );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, count * sizeof( Orbit_Instance ), orbits, GL_STATIC_DRAW );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    return result;
+}
+
+internal void FreeOrbitInstances( Orbit_Instances *orbits )
+{
+    glDeleteBuffers( 1, &orbits->buffer );
+    *orbits = {};
+}
+
+// Draws every instance at time, in seconds. Meshes with fewer levels than level draw their coarsest one.
+internal void DrawModelOrbits( Orbit_Instances *orbits, Model model, Shader shader, float32 time, int level = 0 )
+{
+    if ( !orbits->count ) { return; }
+
+    UseShader( shader );
+    ShaderSetFloat32( shader, "time", time );
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, ORBIT_INSTANCES_BINDING, orbits->buffer );
+    DrawModelInstances( model, shader, 0, orbits->count, level );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include "utils/utils.h"
+#include "platform.h"
+
+// Single file asset package written by tools/asset_packer.cpp.
+// Layout: header | entries | hash slots | file data, every file starts on a page boundary.
+// Entries are keyed by the same relative path the engine opens ("backpack/backpack.obj",
+// "../src/shaders/cube.vert"), so a mounted package is transparent to the loaders: OpenAssetFile
+// returns a view into the package mapping and only falls back to the loose file when the path is missing.
+// Caches written at run time (.mcache) are the exception, a stale packed one is shadowed by the loose rewrite.
+
+#define PACKAGE_MAGIC     0x4b415045 // "EPAK"
+#define PACKAGE_VERSION   1
+#define PACKAGE_PAGE_SIZE 4096
+#define PACKAGE_PATH_SIZE 128
+
+struct Package_Header
+{
+    u32 magic;
+    u32 version;
+    u32 entriesCount;
+
+    //@NOTE: Power of two, open addressing with linear probing. A slot holds entry index + 1, 0 is empty
+    u32 slotsCount;
+
+    u64 entriesOffset;
+    u64 slotsOffset;
+    u64 fileSize;
+};
+
+struct Package_Entry
+{
+    u64 pathHash;
+    u64 offset;
+    u64 size;
+
+    //@NOTE: Write time of the packed file, so caches validated against their source keep working
+    u64 sourceWriteTime;
+
+    char path[ PACKAGE_PATH_SIZE ];
+};
+
+struct Package
+{
+    Mapped_File file;
+    Package_Header *header;
+    Package_Entry *entries;
+    u32 *slots;
+};
+
+global_variable Package globalPackage;
+
+struct Asset_File
+{
+    u8 *memory;
+    u64 size;
+
+    //@NOTE: Only set for loose files, package entries point into the package mapping
+    Mapped_File mapping;
+};
+
+// Drops leading "./" and turns backslashes into slashes
+internal void NormalizePackagePath( char *path, char *result, int resultSize )
+{
+    while ( path[ 0 ] == '.' && ( path[ 1 ] == '/' || path[ 1 ] == '\\' ) ) { path += 2; }
+
+    int count = 0;
+    for ( ; path[ count ] && count < resultSize - 1; ++count )
+    {
+        result[ count ] = path[ count ] == '\\' ? '/' : path[ count ];
+    }
+    result[ count ] = '\0';
+}
+
+inline u64 HashPackagePath( char *path )
+{
+    u64 hash = 0xcbf29ce484222325ull;
+    for ( char *c = path; *c; ++c )
+    {
+        hash ^= ( u8 ) *c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+internal bool MountPackage( char *path )
+{
+    Package package = {};
+    if ( !MapFile( path, &package.file ) ) { return false; }
+
+    u8 *base = ( u8 * ) package.file.memory;
+    Package_Header *header = ( Package_Header * ) base;
+    bool valid = package.file.size >= sizeof( Package_Header ) &&
+                 header->magic == PACKAGE_MAGIC &&
+                 header->version == PACKAGE_VERSION &&
+                 header->fileSize == package.file.size &&
+                 header->slotsCount && ( header->slotsCount & ( header->slotsCount - 1 ) ) == 0 &&
+                 header->entriesOffset + header->entriesCount * sizeof( Package_Entry ) <= package.file.size &&
+                 header->slotsOffset + header->slotsCount * sizeof( u32 ) <= package.file.size;
+
+    if ( !valid )
+    {
+        printf( "Package is invalid: %s\n", path );
+        UnmapFile( &package.file );
+        return false;
+    }
+
+    package.header = header;
+    package.entries = ( Package_Entry * ) ( base + header->entriesOffset );
+    package.slots = ( u32 * ) ( base + header->slotsOffset );
+
+    for ( u32 i = 0; i < header->entriesCount; ++i )
+    {
+        if ( package.entries[ i ].offset + package.entries[ i ].size > package.file.size )
+        {
+            printf( "Package entry is out of bounds: %s\n", package.entries[ i ].path );
+            UnmapFile( &package.file );
+            return false;
+        }
+    }
+
+    globalPackage = package;
+    return true;
+}
+
+internal void UnmountPackage()
+{
+    UnmapFile( &globalPackage.file );
+    globalPackage = {};
+}
+
+internal Package_Entry *FindPackageEntry( char *path )
+{
+    if ( !globalPackage.header ) { return 0; }
+
+    char normalized[ PACKAGE_PATH_SIZE ];
+    NormalizePackagePath( path, normalized, sizeof( normalized ) );
+    u64 hash = HashPackagePath( normalized );
+
+    u32 mask = globalPackage.header->slotsCount - 1;
+    u32 slot = ( u32 ) hash & mask;
+    for ( u32 i = 0; i < globalPackage.header->slotsCount; ++i, slot = ( slot + 1 ) & mask )
+    {
+        u32 index = globalPackage.slots[ slot ];
+        if ( index == 0 || index > globalPackage.header->entriesCount ) { return 0; }
+
+        Package_Entry *entry = &globalPackage.entries[ index - 1 ];
+        if ( entry->pathHash == hash && strcmp( entry->path, normalized ) == 0 ) { return entry; }
+    }
+    return 0;
+}
+
+// Maps the file from disk even when the package has an entry for it
+internal bool OpenLooseAssetFile( char *path, Asset_File *result )
+{
+    *result = {};
+    if ( !MapFile( path, &result->mapping ) ) { return false; }
+    result->memory = ( u8 * ) result->mapping.memory;
+    result->size = result->mapping.size;
+    return true;
+}
+
+// Points result at the file contents, nothing is read or copied: package entries come from the mounted
+// package, everything else is mapped from disk. Close with CloseAssetFile.
+internal bool OpenAssetFile( char *path, Asset_File *result )
+{
+    *result = {};
+
+    Package_Entry *entry = FindPackageEntry( path );
+    if ( entry )
+    {
+        result->memory = ( u8 * ) globalPackage.file.memory + entry->offset;
+        result->size = entry->size;
+        return true;
+    }
+
+    return OpenLooseAssetFile( path, result );
+}
+
+//@NOTE: The file is a view into the package mapping
+inline bool IsPackedAssetFile( Asset_File *file )
+{
+    return file->memory && !file->mapping.memory;
+}
+
+internal void CloseAssetFile( Asset_File *file )
+{
+    UnmapFile( &file->mapping );
+    *file = {};
+}
+
+internal bool GetAssetStamp( char *path, File_Stamp *stamp )
+{
+    Package_Entry *entry = FindPackageEntry( path );
+    if ( entry )
+    {
+        stamp->size = entry->size;
+        stamp->lastWriteTime = entry->sourceWriteTime;
+        return true;
+    }
+    return GetFileStamp( path, stamp );
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <stdio.h>
+#include "utils/utils.h"
+
+//@NOTE: glad defines APIENTRY on its own, windows.h would redefine it (same trick as in glad.c)
+#ifndef _WINDOWS_
+    #undef APIENTRY
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+    #define NOMINMAX
+#endif
+#include <windows.h>
+#include <intrin.h>
+
+struct Mapped_File
+{
+    void *memory;
+    u64 size;
+
+    HANDLE file;
+    HANDLE mapping;
+};
+
+struct File_Stamp
+{
+    u64 size;
+    u64 lastWriteTime;
+};
+
+internal bool GetFileStamp( char *path, File_Stamp *stamp )
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if ( !GetFileAttributesExA( path, GetFileExInfoStandard, &attributes ) )
+    {
+        return false;
+    }
+
+    stamp->size = ( ( u64 ) attributes.nFileSizeHigh << 32 ) | attributes.nFileSizeLow;
+    stamp->lastWriteTime = ( ( u64 ) attributes.ftLastWriteTime.dwHighDateTime << 32 ) | attributes.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+internal bool MapFile( char *path, Mapped_File *result )
+{
+    *result = {};
+
+    HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+    if ( file == INVALID_HANDLE_VALUE )
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if ( !GetFileSizeEx( file, &fileSize ) || fileSize.QuadPart == 0 )
+    {
+        CloseHandle( file );
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA( file, 0, PAGE_READONLY, 0, 0, 0 );
+    if ( !mapping )
+    {
+        CloseHandle( file );
+        return false;
+    }
+
+    void *memory = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    if ( !memory )
+    {
+        CloseHandle( mapping );
+        CloseHandle( file );
+        return false;
+    }
+
+    result->memory = memory;
+    result->size = ( u64 ) fileSize.QuadPart;
+    result->file = file;
+    result->mapping = mapping;
+    return true;
+}
+
+internal void UnmapFile( Mapped_File *file )
+{
+    if ( file->memory ) { UnmapViewOfFile( file->memory ); }
+    if ( file->mapping ) { CloseHandle( file->mapping ); }
+    if ( file->file ) { CloseHandle( file->file ); }
+    *file = {};
+}
+
+inline u64 GetPerformanceCounter()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter( &counter );
+    return ( u64 ) counter.QuadPart;
+}
+
+inline float64 GetSecondsElapsed( u64 start, u64 end )
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency( &frequency );
+    return ( float64 ) ( end - start ) / ( float64 ) frequency.QuadPart;
+}
+
+//@NOTE: The code using AVX2 is compiled without /arch:AVX2 and picked at runtime, so the OS has to save the YMM registers too
+internal bool IsAvx2Supported()
+{
+    int info[ 4 ];
+    __cpuid( info, 0 );
+    if ( info[ 0 ] < 7 ) { return false; }
+
+    __cpuid( info, 1 );
+    bool osxsave = ( info[ 2 ] & ( 1 << 27 ) ) != 0;
+    bool fma = ( info[ 2 ] & ( 1 << 12 ) ) != 0;
+    if ( !osxsave || !fma || ( _xgetbv( 0 ) & 6 ) != 6 ) { return false; }
+
+    __cpuidex( info, 7, 0 );
+    return ( info[ 1 ] & ( 1 << 5 ) ) != 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "utils/utils.h"
+
+// Counter based random numbers. Every value is a hash of the seed, a stream index and how many values the stream
+// gave before, so there is no state to share between threads. Give every item its own stream, item i of any job
+// split then draws the same numbers as it would serially. Integer only, the same on every platform and compiler.
+
+//@NOTE: 2^64 divided by the golden ratio, spreads consecutive counters over the whole range
+#define RANDOM_GOLDEN_GAMMA 0x9e3779b97f4a7c15ull
+
+struct Random_Stream
+{
+    u64 key;
+    u64 counter;
+};
+
+//@NOTE: SplitMix64 finalizer, every input bit affects every output bit
+inline u64 MixRandom64( u64 value )
+{
+    value = ( value ^ ( value >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+    value = ( value ^ ( value >> 27 ) ) * 0x94d049bb133111ebull;
+    return value ^ ( value >> 31 );
+}
+
+inline Random_Stream GetRandomStream( u64 seed, u64 stream )
+{
+    Random_Stream result;
+    result.key = MixRandom64( seed ^ MixRandom64( stream * RANDOM_GOLDEN_GAMMA + RANDOM_GOLDEN_GAMMA ) );
+    result.counter = 0;
+    return result;
+}
+
+inline u32 NextRandom( Random_Stream *stream )
+{
+    return ( u32 ) ( MixRandom64( stream->key + ++stream->counter * RANDOM_GOLDEN_GAMMA ) >> 32 );
+}
+
+//@NOTE: [0, 1), the top 24 bits so every value is exact in a float
+inline float32 NextRandomFloat( Random_Stream *stream )
+{
+    return ( float32 ) ( NextRandom( stream ) >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+inline float32 NextRandomRange( Random_Stream *stream, float32 min, float32 max )
+{
+    return min + ( max - min ) * NextRandomFloat( stream );
+}
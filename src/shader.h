@@ -1,43 +1,62 @@
 #pragma once
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <glad/glad.h>
 #include <glm.hpp>
 #include "utils/utils.h"
+#include "package.h"
 
 struct Shader
 {
     u32 id;
 };
 
-internal char *GetShaderCode( char *path )
+//@NOTE: The code points into the package or the mapped file, it isn't null terminated so pass the size along
+internal Asset_File GetShaderCode( char *path )
 {
-    FILE *shaderFile;
-    fopen_s( &shaderFile, path, "rt" );
-
-    if ( !shaderFile )
+    Asset_File shaderFile;
+    if ( !OpenAssetFile( path, &shaderFile ) )
     {
         printf( "Failed to open file: %s.\n", path );
         return {};
     }
+    return shaderFile;
+}
+
+//@NOTE: Functions shared by every shader, read from next to the shader it goes into
+#define SHADER_COMMON_FILE "common.glsl"
 
-    fseek( shaderFile, 0, SEEK_END );
-    int shaderFileSize = ( int ) ftell( shaderFile );
-    fseek( shaderFile, 0, SEEK_SET );
+internal Asset_File GetShaderCommonCode( char *path )
+{
+    char commonPath[ 256 ];
+    char *lastSlash = strrchr( path, '/' );
+    int directoryLength = lastSlash ? ( int ) ( lastSlash - path ) + 1 : 0;
+    snprintf( commonPath, sizeof( commonPath ), "%.*s%s", directoryLength, path, SHADER_COMMON_FILE );
+
+    Asset_File result;
+    if ( !OpenAssetFile( commonPath, &result ) ) { return {}; }
+    return result;
+}
 
-    if ( shaderFileSize == 0 )
+// The common code goes right after the #version line, which has to come first. The #line after it keeps the line
+// numbers of compile errors those of the shader file.
+internal void SetShaderSource( u32 shader, Asset_File *code, Asset_File *common )
+{
+    char *source = ( char * ) code->memory;
+    int length = ( int ) code->size;
+    if ( !common->memory )
     {
-        printf( "Vertex shader file size is 0.\n" );
-        fclose( shaderFile );
-        return {};
+        glShaderSource( shader, 1, &source, &length );
+        return;
     }
 
-    char *shaderCode = ( char * ) malloc( ( shaderFileSize + 1 ) * sizeof( char ) );
-    int countRead = ( int ) fread( shaderCode, sizeof( char ), shaderFileSize, shaderFile );
+    int versionLength = 0;
+    while ( versionLength < length && source[ versionLength++ ] != '\n' ) {}
 
-    shaderCode[ countRead ] = '\0';
-    fclose( shaderFile );
-    return shaderCode;
+    char *sources[] = { source, ( char * ) common->memory, "\n#line 2\n", source + versionLength };
+    int lengths[] = { versionLength, ( int ) common->size, ( int ) strlen( sources[ 2 ] ), length - versionLength };
+    glShaderSource( shader, 4, sources, lengths );
 }
 
 internal Shader CreateShader( char *vertexPath, char *fragmentPath, char *geometryPath )
@@ -45,14 +64,17 @@ internal Shader CreateShader( char *vertexPath, char *fragmentPath, char *geomet
     int success;
     char infoLog[ 512 ];
 
-    char *vertexCode = GetShaderCode( vertexPath );
-    defer { free( vertexCode ); };
+    Asset_File vertexCode = GetShaderCode( vertexPath );
+    defer { CloseAssetFile( &vertexCode ); };
+
+    Asset_File fragmentCode = GetShaderCode( fragmentPath );
+    defer { CloseAssetFile( &fragmentCode ); };
 
-    char *fragmentCode = GetShaderCode( fragmentPath );
-    defer { free( fragmentCode ); };
+    Asset_File commonCode = GetShaderCommonCode( vertexPath );
+    defer { CloseAssetFile( &commonCode ); };
 
     u32 vertexShader = glCreateShader( GL_VERTEX_SHADER );
-    glShaderSource( vertexShader, 1, &vertexCode, 0 );
+    SetShaderSource( vertexShader, &vertexCode, &commonCode );
     glCompileShader( vertexShader );
     glGetShaderiv( vertexShader, GL_COMPILE_STATUS, &success );
 
@@ -63,7 +85,7 @@ internal Shader CreateShader( char *vertexPath, char *fragmentPath, char *geomet
     }
 
     u32 fragmentShader = glCreateShader( GL_FRAGMENT_SHADER );
-    glShaderSource( fragmentShader, 1, &fragmentCode, 0 );
+    SetShaderSource( fragmentShader, &fragmentCode, &commonCode );
     glCompileShader( fragmentShader );
     glGetShaderiv( fragmentShader, GL_COMPILE_STATUS, &success );
 
@@ -79,11 +101,11 @@ internal Shader CreateShader( char *vertexPath, char *fragmentPath, char *geomet
 
     if ( geometryPath )
     {
-        char *geometryCode = GetShaderCode( geometryPath );
-        defer { free( geometryCode ); };
+        Asset_File geometryCode = GetShaderCode( geometryPath );
+        defer { CloseAssetFile( &geometryCode ); };
 
         u32 geometryShader = glCreateShader( GL_GEOMETRY_SHADER );
-        glShaderSource( geometryShader, 1, &geometryCode, 0 );
+        SetShaderSource( geometryShader, &geometryCode, &commonCode );
         glCompileShader( geometryShader );
         glGetShaderiv( geometryShader, GL_COMPILE_STATUS, &success );
 
@@ -105,6 +127,10 @@ internal Shader CreateShader( char *vertexPath, char *fragmentPath, char *geomet
         printf( "Error during shader linking:\n%s", infoLog );
     }
 
+    //@NOTE: Meshes set it in SetMeshVertexFormat, draws that don't get the vertices unscaled instead of collapsed to 0
+    int positionScale = glGetUniformLocation( id, "positionScale" );
+    if ( positionScale >= 0 ) { glProgramUniform3f( id, positionScale, 1.0f, 1.0f, 1.0f ); }
+
     glDeleteShader( vertexShader );
     glDeleteShader( fragmentShader );
 
@@ -116,6 +142,44 @@ internal inline Shader CreateShader( char *vertexPath, char *fragmentPath )
     return CreateShader( vertexPath, fragmentPath, 0 );
 }
 
+internal Shader CreateComputeShader( char *computePath )
+{
+    int success;
+    char infoLog[ 512 ];
+
+    Asset_File computeCode = GetShaderCode( computePath );
+    defer { CloseAssetFile( &computeCode ); };
+
+    Asset_File commonCode = GetShaderCommonCode( computePath );
+    defer { CloseAssetFile( &commonCode ); };
+
+    u32 computeShader = glCreateShader( GL_COMPUTE_SHADER );
+    SetShaderSource( computeShader, &computeCode, &commonCode );
+    glCompileShader( computeShader );
+    glGetShaderiv( computeShader, GL_COMPILE_STATUS, &success );
+
+    if ( !success )
+    {
+        glGetShaderInfoLog( computeShader, 512, 0, infoLog );
+        printf( "Error during compute shader compilation:\n%s", infoLog );
+    }
+
+    u32 id = glCreateProgram();
+    glAttachShader( id, computeShader );
+    glLinkProgram( id );
+    glGetProgramiv( id, GL_LINK_STATUS, &success );
+
+    if ( !success )
+    {
+        glGetProgramInfoLog( id, 512, 0, infoLog );
+        printf( "Error during shader linking:\n%s", infoLog );
+    }
+
+    glDeleteShader( computeShader );
+
+    return Shader{ id };
+}
+
 inline void UseShader( Shader shader )
 {
     glUseProgram( shader.id );
@@ -171,3 +235,18 @@ inline void ShaderSetMat4( Shader shader, char *name, float32 *mat4 )
 {
     glUniformMatrix4fv( GetUniformLocation( shader.id, name ), 1, GL_FALSE, mat4 );
 }
+
+inline void ShaderSetUInt( Shader shader, char *name, u32 value )
+{
+    glUniform1ui( GetUniformLocation( shader.id, name ), value );
+}
+
+inline void ShaderSetVec4Array( Shader shader, char *name, glm::vec4 *values, int count )
+{
+    glUniform4fv( GetUniformLocation( shader.id, name ), count, &values[ 0 ].x );
+}
+
+inline void ShaderSetFloat32Array( Shader shader, char *name, float32 *values, int count )
+{
+    glUniform1fv( GetUniformLocation( shader.id, name ), count, values );
+}
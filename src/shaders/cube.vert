@@ -16,10 +16,18 @@ layout (std140) uniform Matrices
 
 uniform mat4 model;
 
+// Set per mesh by SetMeshVertexFormat, see Compact_Vertex
+uniform bool compactVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
 void main()
 {
-    fragmentPosition = vec3(model * vec4(aPosition, 1.0));
+    vec3 position = aPosition * positionScale + positionOffset;
+    vec3 vertexNormal = compactVertices ? DecodeOctahedral(aNormal.xy) : aNormal;
+
+    fragmentPosition = vec3(model * vec4(position, 1.0));
     textureCoords = aTextureCoords;
-    normal = mat3(transpose(inverse(model))) * aNormal;
-    gl_Position = projection * view * model * vec4(aPosition, 1.0);
+    normal = mat3(transpose(inverse(model))) * vertexNormal;
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }  
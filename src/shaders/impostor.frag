@@ -0,0 +1,48 @@
+#version 330 core
+
+struct DirectionalLight
+{
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+out vec4 fragmentColor;
+
+in vec3 textureCoords;
+in vec3 fragmentPosition;
+in mat3 normalMatrix;
+
+uniform vec3 viewPosition;
+uniform float shininess;
+uniform DirectionalLight directionalLight;
+
+uniform sampler2DArray impostorAlbedo;
+uniform sampler2DArray impostorNormal;
+
+// Only the directional light, the point and spot lights have faded out at impostor distances
+void main()
+{
+    vec4 albedo = texture(impostorAlbedo, textureCoords);
+    if(albedo.a < 0.5)
+    {
+        discard;
+    }
+
+    vec4 normalSpecular = texture(impostorNormal, textureCoords);
+    vec3 normal = normalize(normalMatrix * (normalSpecular.xyz * 2.0 - 1.0));
+    vec3 viewDirection = normalize(viewPosition - fragmentPosition);
+    vec3 lightDirection = normalize(-directionalLight.direction);
+
+    float diffuseStrength = max(dot(normal, lightDirection), 0.0);
+    vec3 reflectionDirection = reflect(-lightDirection, normal);
+    float specularStrength = pow(max(dot(viewDirection, reflectionDirection), 0.0), shininess);
+
+    vec3 ambient = directionalLight.ambient * albedo.rgb;
+    vec3 diffuse = directionalLight.diffuse * diffuseStrength * albedo.rgb;
+    vec3 specular = directionalLight.specular * specularStrength * normalSpecular.a;
+
+    fragmentColor = vec4(ambient + diffuse + specular, 1.0);
+}
@@ -0,0 +1,47 @@
+#version 330 core
+
+// See Instance_Transform, position and uniform scale, then the rotation quaternion
+layout (location = 3) in vec4 instancePositionScale;
+layout (location = 4) in vec4 instanceRotation;
+
+out vec3 textureCoords;
+out vec3 fragmentPosition;
+out mat3 normalMatrix;
+
+layout (std140) uniform Matrices
+{
+    mat4 projection;
+    mat4 view;
+};
+
+uniform vec3 viewPosition;
+
+// Set by DrawImpostors, see Impostor
+uniform int viewsPerSide;
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+
+void main()
+{
+    // A pure rotation, so the transpose brings directions back to object space
+    mat3 rotation = GetQuaternionMatrix(instanceRotation);
+    float scale = instancePositionScale.w;
+    vec3 center = instancePositionScale.xyz + rotation * (impostorCenter * scale);
+    vec3 toCamera = normalize(transpose(rotation) * (viewPosition - center));
+
+    // Baked view closest to the camera, the quad is oriented the way that view was rendered
+    ivec2 cell = clamp(ivec2((EncodeOctahedral(toCamera) * 0.5 + 0.5) * float(viewsPerSide)), ivec2(0), ivec2(viewsPerSide - 1));
+    vec3 direction = DecodeOctahedral((vec2(cell) + 0.5) / float(viewsPerSide) * 2.0 - 1.0);
+
+    vec3 forward = -direction;
+    vec3 right = normalize(cross(forward, abs(direction.y) > 0.99 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0)));
+    vec3 up = cross(right, forward);
+
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    vec3 position = impostorCenter + (right * corner.x + up * corner.y) * impostorRadius;
+
+    fragmentPosition = instancePositionScale.xyz + rotation * (position * scale);
+    textureCoords = vec3(corner * 0.5 + 0.5, float(cell.y * viewsPerSide + cell.x));
+    normalMatrix = rotation;
+    gl_Position = projection * view * vec4(fragmentPosition, 1.0);
+}
@@ -0,0 +1,28 @@
+#version 330 core
+
+struct Material
+{
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+};
+
+layout (location = 0) out vec4 albedo;
+layout (location = 1) out vec4 normalSpecular;
+
+in vec2 textureCoords;
+in vec3 normal;
+
+uniform Material material;
+
+void main()
+{
+    vec4 textureColor = texture(material.texture_diffuse1, textureCoords);
+    if(textureColor.a < 0.1)
+    {
+        discard;
+    }
+
+    // Alpha marks the covered texels, the impostor discards everything else
+    albedo = vec4(textureColor.rgb, 1.0);
+    normalSpecular = vec4(normalize(normal) * 0.5 + 0.5, texture(material.texture_specular1, textureCoords).r);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTextureCoords;
+
+out vec2 textureCoords;
+out vec3 normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// Set per mesh by SetMeshVertexFormat, see Compact_Vertex
+uniform bool compactVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+void main()
+{
+    vec3 position = aPosition * positionScale + positionOffset;
+    vec3 vertexNormal = compactVertices ? DecodeOctahedral(aNormal.xy) : aNormal;
+
+    textureCoords = aTextureCoords;
+    normal = mat3(transpose(inverse(model))) * vertexNormal;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+}
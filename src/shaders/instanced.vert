@@ -3,7 +3,9 @@
 layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTextureCoords;
-layout (location = 3) in mat4 instanceMatrix;
+// See Instance_Transform, position and uniform scale, then the rotation quaternion
+layout (location = 3) in vec4 instancePositionScale;
+layout (location = 4) in vec4 instanceRotation;
 
 out vec2 textureCoords;
 out vec3 normal;
@@ -15,10 +17,19 @@ layout (std140) uniform Matrices
     mat4 view;
 };
 
+// Set per mesh by SetMeshVertexFormat, see Compact_Vertex
+uniform bool compactVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
 void main()
 {
-    fragmentPosition = vec3(instanceMatrix * vec4(aPosition, 1.0));
+    vec3 position = aPosition * positionScale + positionOffset;
+    vec3 vertexNormal = compactVertices ? DecodeOctahedral(aNormal.xy) : aNormal;
+
+    fragmentPosition = instancePositionScale.xyz + RotateByQuaternion(instanceRotation, position * instancePositionScale.w);
     textureCoords = aTextureCoords;
-    normal = mat3(transpose(inverse(instanceMatrix))) * aNormal;
-    gl_Position = projection * view * instanceMatrix * vec4(aPosition, 1.0);
+    // Uniform scale, the rotation alone carries the normal
+    normal = RotateByQuaternion(instanceRotation, vertexNormal);
+    gl_Position = projection * view * vec4(fragmentPosition, 1.0);
 }  
@@ -0,0 +1,46 @@
+#version 430 core
+
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTextureCoords;
+layout (location = 7) in uint aInstanceIndex;
+
+// The static instances culled by instance_cull.comp, aInstanceIndex is one of its survivors
+// See Instance_Transform
+struct Instance
+{
+    vec4 positionScale;
+    vec4 rotation;
+};
+
+layout (std430, binding = 0) readonly buffer Instances
+{
+    Instance instances[];
+};
+
+out vec2 textureCoords;
+out vec3 normal;
+out vec3 fragmentPosition;
+
+layout (std140) uniform Matrices
+{
+    mat4 projection;
+    mat4 view;
+};
+
+// Set per mesh by SetMeshVertexFormat, see Compact_Vertex
+uniform bool compactVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+void main()
+{
+    Instance instance = instances[aInstanceIndex];
+    vec3 position = aPosition * positionScale + positionOffset;
+    vec3 vertexNormal = compactVertices ? DecodeOctahedral(aNormal.xy) : aNormal;
+
+    fragmentPosition = instance.positionScale.xyz + RotateByQuaternion(instance.rotation, position * instance.positionScale.w);
+    textureCoords = aTextureCoords;
+    normal = RotateByQuaternion(instance.rotation, vertexNormal);
+    gl_Position = projection * view * vec4(fragmentPosition, 1.0);
+}  
@@ -0,0 +1,64 @@
+#version 430 core
+
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTextureCoords;
+
+// See Orbit_Instance
+struct Orbit
+{
+    vec4 radiusPhaseVelocityScale;
+    vec4 inclinationNodeHeightSpin;
+    vec4 spinAxisPhase;
+};
+
+layout (std430, binding = 0) readonly buffer Orbits
+{
+    Orbit orbits[];
+};
+
+out vec2 textureCoords;
+out vec3 normal;
+out vec3 fragmentPosition;
+
+layout (std140) uniform Matrices
+{
+    mat4 projection;
+    mat4 view;
+};
+
+// Set per mesh by SetMeshVertexFormat, see Compact_Vertex
+uniform bool compactVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// Seconds, set by DrawModelOrbits
+uniform float time;
+
+void main()
+{
+    // Same as GetOrbitInstanceTransform in orbit.h
+    Orbit orbit = orbits[gl_InstanceID];
+    float radius = orbit.radiusPhaseVelocityScale.x;
+    float angle = orbit.radiusPhaseVelocityScale.y + orbit.radiusPhaseVelocityScale.z * time;
+    vec3 center = vec3(cos(angle) * radius, orbit.inclinationNodeHeightSpin.z, sin(angle) * radius);
+
+    float cosInclination = cos(orbit.inclinationNodeHeightSpin.x);
+    float sinInclination = sin(orbit.inclinationNodeHeightSpin.x);
+    center = vec3(center.x, center.y * cosInclination - center.z * sinInclination, center.y * sinInclination + center.z * cosInclination);
+
+    float cosNode = cos(orbit.inclinationNodeHeightSpin.y);
+    float sinNode = sin(orbit.inclinationNodeHeightSpin.y);
+    center = vec3(center.x * cosNode + center.z * sinNode, center.y, center.z * cosNode - center.x * sinNode);
+
+    float spin = (orbit.spinAxisPhase.w + orbit.inclinationNodeHeightSpin.w * time) * 0.5;
+    vec4 rotation = vec4(orbit.spinAxisPhase.xyz * sin(spin), cos(spin));
+
+    vec3 position = aPosition * positionScale + positionOffset;
+    vec3 vertexNormal = compactVertices ? DecodeOctahedral(aNormal.xy) : aNormal;
+
+    fragmentPosition = center + RotateByQuaternion(rotation, position * orbit.radiusPhaseVelocityScale.w);
+    textureCoords = aTextureCoords;
+    normal = RotateByQuaternion(rotation, vertexNormal);
+    gl_Position = projection * view * vec4(fragmentPosition, 1.0);
+}
@@ -0,0 +1,352 @@
+#pragma once
+#include <glm.hpp>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#include "utils/utils.h"
+#include "jobs.h"
+#include "mesh.h"
+
+// CPU occlusion culling, for when the GPU can't be asked. A few low poly occluders are rasterized into a small depth
+// buffer, 4 pixels at a time with SSE, one row of tiles per job. Every tile also keeps the furthest depth it holds,
+// so most bounds are accepted or rejected per tile and only the tiles they partly hide behind are read per pixel.
+// Depth is 1 / w, interpolated linearly over the screen and 0 where nothing was drawn, so nearer is larger.
+
+#define OCCLUSION_TILE_WIDTH  32
+#define OCCLUSION_TILE_HEIGHT 8
+
+//@NOTE: Positions of one level of a model, the indices point into positions only
+struct Occluder
+{
+    glm::vec3 *positions;
+    int positionsCount;
+    u32 *indices;
+    int indicesCount;
+};
+
+struct Occlusion_Triangle
+{
+    //@NOTE: a * x + b * y + c per edge, positive inside
+    float32 edgeA[ 3 ];
+    float32 edgeB[ 3 ];
+    float32 edgeC[ 3 ];
+
+    //@NOTE: 1 / w as a plane over the screen
+    float32 depthA;
+    float32 depthB;
+    float32 depthC;
+
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+};
+
+struct Occlusion_Buffer
+{
+    //@NOTE: width * height, rows from the bottom of the screen like window coordinates
+    float32 *depth;
+    int width;
+    int height;
+
+    //@NOTE: Smallest depth of every tile, the furthest thing in it
+    float32 *tileDepth;
+    int tilesX;
+    int tilesY;
+
+    //@NOTE: Set up by RenderOccluders, grown as needed
+    Occlusion_Triangle *triangles;
+    int trianglesCount;
+    int trianglesCapacity;
+
+    glm::mat4 viewProjection;
+};
+
+// The size is rounded up to whole tiles
+internal Occlusion_Buffer CreateOcclusionBuffer( int width, int height )
+{
+    Occlusion_Buffer result = {};
+    result.tilesX = ( width + OCCLUSION_TILE_WIDTH - 1 ) / OCCLUSION_TILE_WIDTH;
+    result.tilesY = ( height + OCCLUSION_TILE_HEIGHT - 1 ) / OCCLUSION_TILE_HEIGHT;
+    result.width = result.tilesX * OCCLUSION_TILE_WIDTH;
+    result.height = result.tilesY * OCCLUSION_TILE_HEIGHT;
+    result.depth = ( float32 * ) calloc( result.width * result.height, sizeof( float32 ) );
+    result.tileDepth = ( float32 * ) calloc( result.tilesX * result.tilesY, sizeof( float32 ) );
+    return result;
+}
+
+internal void FreeOcclusionBuffer( Occlusion_Buffer *buffer )
+{
+    free( buffer->depth );
+    free( buffer->tileDepth );
+    free( buffer->triangles );
+    *buffer = {};
+}
+
+// Copies one level of every mesh, the coarsest by default. The simplified level of a convex mesh stays inside it,
+// other models should get occluders that don't grow past their silhouette.
+internal Occluder CreateOccluder( Mesh *meshes, int meshesCount, int level = MESH_MAX_LODS )
+{
+    Occluder result = {};
+    for ( int i = 0; i < meshesCount; ++i )
+    {
+        Mesh *mesh = &meshes[ i ];
+        int meshLevel = level < mesh->lodsCount ? level : mesh->lodsCount - 1;
+        result.positionsCount += mesh->verticesCount;
+        result.indicesCount += mesh->lods[ meshLevel ].indexCount;
+    }
+
+    result.positions = ( glm::vec3 * ) malloc( result.positionsCount * sizeof( glm::vec3 ) );
+    result.indices = ( u32 * ) malloc( result.indicesCount * sizeof( u32 ) );
+
+    //@NOTE: Only the vertices the level uses are kept, the others would be transformed for nothing
+    int positionsCount = 0;
+    int indicesCount = 0;
+    for ( int i = 0; i < meshesCount; ++i )
+    {
+        Mesh *mesh = &meshes[ i ];
+        int meshLevel = level < mesh->lodsCount ? level : mesh->lodsCount - 1;
+        Mesh_Lod lod = mesh->lods[ meshLevel ];
+
+        u32 *remap = ( u32 * ) malloc( mesh->verticesCount * sizeof( u32 ) );
+        defer { free( remap ); };
+        memset( remap, 0xff, mesh->verticesCount * sizeof( u32 ) );
+
+        for ( u32 j = 0; j < lod.indexCount; ++j )
+        {
+            u32 index = mesh->indices[ lod.firstIndex + j ];
+            if ( remap[ index ] == 0xffffffff )
+            {
+                remap[ index ] = ( u32 ) positionsCount;
+                result.positions[ positionsCount++ ] = mesh->vertices[ index ].position;
+            }
+            result.indices[ indicesCount++ ] = remap[ index ];
+        }
+    }
+    result.positionsCount = positionsCount;
+    return result;
+}
+
+internal void FreeOccluder( Occluder *occluder )
+{
+    free( occluder->positions );
+    free( occluder->indices );
+    *occluder = {};
+}
+
+//@NOTE: Screen position in buffer pixels and 1 / w of every occluder vertex, false behind the near plane
+internal bool ProjectOcclusionVertex( Occlusion_Buffer *buffer, glm::vec4 clip, glm::vec3 *result )
+{
+    if ( clip.z < -clip.w || clip.w <= 0.0f ) { return false; }
+
+    float32 inverseW = 1.0f / clip.w;
+    result->x = ( clip.x * inverseW * 0.5f + 0.5f ) * buffer->width;
+    result->y = ( clip.y * inverseW * 0.5f + 0.5f ) * buffer->height;
+    result->z = inverseW;
+    return true;
+}
+
+internal void SetupOccluderTriangles( Occlusion_Buffer *buffer, Occluder *occluder, glm::mat4 transform )
+{
+    glm::mat4 modelViewProjection = buffer->viewProjection * transform;
+
+    int trianglesCount = occluder->indicesCount / 3;
+    if ( buffer->trianglesCount + trianglesCount > buffer->trianglesCapacity )
+    {
+        buffer->trianglesCapacity = buffer->trianglesCount + trianglesCount;
+        buffer->triangles = ( Occlusion_Triangle * ) realloc( buffer->triangles, buffer->trianglesCapacity * sizeof( Occlusion_Triangle ) );
+    }
+
+    glm::vec3 *projected = ( glm::vec3 * ) malloc( occluder->positionsCount * sizeof( glm::vec3 ) );
+    bool *inFront = ( bool * ) malloc( occluder->positionsCount * sizeof( bool ) );
+    defer { free( projected ); };
+    defer { free( inFront ); };
+    for ( int i = 0; i < occluder->positionsCount; ++i )
+    {
+        inFront[ i ] = ProjectOcclusionVertex( buffer, modelViewProjection * glm::vec4( occluder->positions[ i ], 1.0f ), &projected[ i ] );
+    }
+
+    for ( int i = 0; i < trianglesCount; ++i )
+    {
+        u32 *indices = occluder->indices + i * 3;
+
+        //@NOTE: Triangles crossing the near plane are dropped rather than clipped, an occluder may only ever hide less
+        if ( !inFront[ indices[ 0 ] ] || !inFront[ indices[ 1 ] ] || !inFront[ indices[ 2 ] ] ) { continue; }
+
+        glm::vec3 v0 = projected[ indices[ 0 ] ];
+        glm::vec3 v1 = projected[ indices[ 1 ] ];
+        glm::vec3 v2 = projected[ indices[ 2 ] ];
+
+        //@NOTE: Counter clockwise is front facing, the back faces are behind the front ones anyway
+        float32 area = ( v1.x - v0.x ) * ( v2.y - v0.y ) - ( v2.x - v0.x ) * ( v1.y - v0.y );
+        if ( area <= 0.0f ) { continue; }
+
+        Occlusion_Triangle triangle;
+
+        //@NOTE: Clamped as floats first, vertices far off screen would overflow the ints
+        triangle.minX = ( int ) glm::max( floorf( glm::min( v0.x, glm::min( v1.x, v2.x ) ) ), 0.0f );
+        triangle.minY = ( int ) glm::max( floorf( glm::min( v0.y, glm::min( v1.y, v2.y ) ) ), 0.0f );
+        triangle.maxX = ( int ) glm::min( ceilf( glm::max( v0.x, glm::max( v1.x, v2.x ) ) ), ( float32 ) ( buffer->width - 1 ) );
+        triangle.maxY = ( int ) glm::min( ceilf( glm::max( v0.y, glm::max( v1.y, v2.y ) ) ), ( float32 ) ( buffer->height - 1 ) );
+        if ( triangle.minX > triangle.maxX || triangle.minY > triangle.maxY ) { continue; }
+
+        glm::vec3 vertices[ 3 ] = { v0, v1, v2 };
+        for ( int j = 0; j < 3; ++j )
+        {
+            glm::vec3 a = vertices[ j ];
+            glm::vec3 b = vertices[ ( j + 1 ) % 3 ];
+            triangle.edgeA[ j ] = a.y - b.y;
+            triangle.edgeB[ j ] = b.x - a.x;
+            triangle.edgeC[ j ] = a.x * b.y - b.x * a.y;
+        }
+
+        triangle.depthA = ( ( v1.z - v0.z ) * ( v2.y - v0.y ) - ( v2.z - v0.z ) * ( v1.y - v0.y ) ) / area;
+        triangle.depthB = ( ( v2.z - v0.z ) * ( v1.x - v0.x ) - ( v1.z - v0.z ) * ( v2.x - v0.x ) ) / area;
+        triangle.depthC = v0.z - triangle.depthA * v0.x - triangle.depthB * v0.y;
+
+        buffer->triangles[ buffer->trianglesCount++ ] = triangle;
+    }
+}
+
+//@NOTE: Rows first to last of the band, both inside the buffer
+internal void RasterizeOcclusionTriangle( Occlusion_Buffer *buffer, Occlusion_Triangle *triangle, int firstRow, int lastRow )
+{
+    __m128 laneOffsets = _mm_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f );
+    __m128 zero = _mm_setzero_ps();
+    __m128 edgeA[ 3 ];
+    for ( int i = 0; i < 3; ++i ) { edgeA[ i ] = _mm_set1_ps( triangle->edgeA[ i ] ); }
+    __m128 depthA = _mm_set1_ps( triangle->depthA );
+
+    int startX = triangle->minX & ~3;
+    for ( int y = firstRow; y <= lastRow; ++y )
+    {
+        float32 pixelY = y + 0.5f;
+        __m128 rowEdge[ 3 ];
+        for ( int i = 0; i < 3; ++i ) { rowEdge[ i ] = _mm_set1_ps( triangle->edgeB[ i ] * pixelY + triangle->edgeC[ i ] ); }
+        __m128 rowDepth = _mm_set1_ps( triangle->depthB * pixelY + triangle->depthC );
+
+        float32 *row = buffer->depth + y * buffer->width;
+        for ( int x = startX; x <= triangle->maxX; x += 4 )
+        {
+            __m128 pixelX = _mm_add_ps( _mm_set1_ps( ( float32 ) x ), laneOffsets );
+            __m128 inside = _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( edgeA[ 0 ], pixelX ), rowEdge[ 0 ] ), zero );
+            inside = _mm_and_ps( inside, _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( edgeA[ 1 ], pixelX ), rowEdge[ 1 ] ), zero ) );
+            inside = _mm_and_ps( inside, _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( edgeA[ 2 ], pixelX ), rowEdge[ 2 ] ), zero ) );
+            if ( !_mm_movemask_ps( inside ) ) { continue; }
+
+            __m128 depth = _mm_add_ps( _mm_mul_ps( depthA, pixelX ), rowDepth );
+            __m128 previous = _mm_loadu_ps( row + x );
+            __m128 nearest = _mm_max_ps( previous, depth );
+            _mm_storeu_ps( row + x, _mm_or_ps( _mm_and_ps( inside, nearest ), _mm_andnot_ps( inside, previous ) ) );
+        }
+    }
+}
+
+internal void RasterizeOcclusionBandJob( void *data, int start, int end )
+{
+    Occlusion_Buffer *buffer = ( Occlusion_Buffer * ) data;
+    for ( int tileY = start; tileY < end; ++tileY )
+    {
+        int firstRow = tileY * OCCLUSION_TILE_HEIGHT;
+        int lastRow = firstRow + OCCLUSION_TILE_HEIGHT - 1;
+        memset( buffer->depth + firstRow * buffer->width, 0, OCCLUSION_TILE_HEIGHT * buffer->width * sizeof( float32 ) );
+
+        for ( int i = 0; i < buffer->trianglesCount; ++i )
+        {
+            Occlusion_Triangle *triangle = &buffer->triangles[ i ];
+            if ( triangle->maxY < firstRow || triangle->minY > lastRow ) { continue; }
+            RasterizeOcclusionTriangle( buffer, triangle, triangle->minY > firstRow ? triangle->minY : firstRow,
+                                        triangle->maxY < lastRow ? triangle->maxY : lastRow );
+        }
+
+        for ( int tileX = 0; tileX < buffer->tilesX; ++tileX )
+        {
+            __m128 furthest = _mm_set1_ps( FLT_MAX );
+            for ( int y = firstRow; y <= lastRow; ++y )
+            {
+                float32 *row = buffer->depth + y * buffer->width + tileX * OCCLUSION_TILE_WIDTH;
+                for ( int x = 0; x < OCCLUSION_TILE_WIDTH; x += 4 ) { furthest = _mm_min_ps( furthest, _mm_loadu_ps( row + x ) ); }
+            }
+            furthest = _mm_min_ps( furthest, _mm_shuffle_ps( furthest, furthest, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+            furthest = _mm_min_ps( furthest, _mm_shuffle_ps( furthest, furthest, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+            buffer->tileDepth[ tileY * buffer->tilesX + tileX ] = _mm_cvtss_f32( furthest );
+        }
+    }
+}
+
+// Clears the buffer and draws the occluders, transforms[ i ] places occluders[ i ]. The view projection is kept for
+// the tests that follow.
+internal void RenderOccluders( Occlusion_Buffer *buffer, Occluder *occluders, glm::mat4 *transforms, int count, glm::mat4 viewProjection,
+                               Job_Queue *queue )
+{
+    buffer->viewProjection = viewProjection;
+    buffer->trianglesCount = 0;
+    for ( int i = 0; i < count; ++i ) { SetupOccluderTriangles( buffer, &occluders[ i ], transforms[ i ] ); }
+
+    ParallelFor( queue, buffer->tilesY, 1, RasterizeOcclusionBandJob, buffer );
+}
+
+// True when the world space box is behind the occluders everywhere it covers. Boxes off screen or reaching behind
+// the near plane are never occluded, those are left to the frustum test.
+internal bool IsBoxOccluded( Occlusion_Buffer *buffer, glm::vec3 boxMin, glm::vec3 boxMax )
+{
+    glm::vec2 screenMin( FLT_MAX );
+    glm::vec2 screenMax( -FLT_MAX );
+    float32 nearest = 0.0f;
+    for ( int i = 0; i < 8; ++i )
+    {
+        glm::vec3 corner( i & 1 ? boxMax.x : boxMin.x, i & 2 ? boxMax.y : boxMin.y, i & 4 ? boxMax.z : boxMin.z );
+        glm::vec3 projected;
+        if ( !ProjectOcclusionVertex( buffer, buffer->viewProjection * glm::vec4( corner, 1.0f ), &projected ) ) { return false; }
+
+        screenMin = glm::min( screenMin, glm::vec2( projected.x, projected.y ) );
+        screenMax = glm::max( screenMax, glm::vec2( projected.x, projected.y ) );
+        nearest = glm::max( nearest, projected.z );
+    }
+
+    int minX = ( int ) glm::max( floorf( screenMin.x ), 0.0f );
+    int minY = ( int ) glm::max( floorf( screenMin.y ), 0.0f );
+    int maxX = ( int ) glm::min( floorf( screenMax.x ), ( float32 ) ( buffer->width - 1 ) );
+    int maxY = ( int ) glm::min( floorf( screenMax.y ), ( float32 ) ( buffer->height - 1 ) );
+    if ( minX > maxX || minY > maxY ) { return false; }
+
+    __m128 nearestDepth = _mm_set1_ps( nearest );
+    __m128 laneOffsets = _mm_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f );
+    __m128 firstX = _mm_set1_ps( ( float32 ) minX );
+    __m128 lastX = _mm_set1_ps( ( float32 ) maxX );
+
+    for ( int tileY = minY / OCCLUSION_TILE_HEIGHT; tileY <= maxY / OCCLUSION_TILE_HEIGHT; ++tileY )
+    {
+        for ( int tileX = minX / OCCLUSION_TILE_WIDTH; tileX <= maxX / OCCLUSION_TILE_WIDTH; ++tileX )
+        {
+            //@NOTE: Everything in the tile is nearer than the box
+            if ( nearest < buffer->tileDepth[ tileY * buffer->tilesX + tileX ] ) { continue; }
+
+            int tileMinX = tileX * OCCLUSION_TILE_WIDTH;
+            int tileMinY = tileY * OCCLUSION_TILE_HEIGHT;
+            int firstRow = tileMinY > minY ? tileMinY : minY;
+            int lastRow = tileMinY + OCCLUSION_TILE_HEIGHT - 1 < maxY ? tileMinY + OCCLUSION_TILE_HEIGHT - 1 : maxY;
+            int startX = ( tileMinX > minX ? tileMinX : minX ) & ~3;
+            int endX = tileMinX + OCCLUSION_TILE_WIDTH - 1 < maxX ? tileMinX + OCCLUSION_TILE_WIDTH - 1 : maxX;
+            for ( int y = firstRow; y <= lastRow; ++y )
+            {
+                float32 *row = buffer->depth + y * buffer->width;
+                for ( int x = startX; x <= endX; x += 4 )
+                {
+                    __m128 pixelX = _mm_add_ps( _mm_set1_ps( ( float32 ) x ), laneOffsets );
+                    __m128 covered = _mm_and_ps( _mm_cmpge_ps( pixelX, firstX ), _mm_cmple_ps( pixelX, lastX ) );
+                    __m128 uncovered = _mm_and_ps( covered, _mm_cmple_ps( _mm_loadu_ps( row + x ), nearestDepth ) );
+                    if ( _mm_movemask_ps( uncovered ) ) { return false; }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+inline bool IsSphereOccluded( Occlusion_Buffer *buffer, glm::vec3 center, float32 radius )
+{
+    return IsBoxOccluded( buffer, center - glm::vec3( radius ), center + glm::vec3( radius ) );
+}
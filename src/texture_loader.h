@@ -0,0 +1,618 @@
+#pragma once
+#include <glad/glad.h>
+#include <stdio.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "utils/utils.h"
+#include "jobs.h"
+#include "platform.h"
+#include "package.h"
+#include "cooked_texture.h"
+#include "stb_image.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+    #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Decodes images on the job queue and uploads them on the GL thread as they come in:
+//   BeginTextureBatch -> QueueTexture2D / QueueCubemapFace (ids are valid right away) -> FinishTextureBatch
+//
+// With pixel buffers enabled an image goes through: decode (worker) -> map a free PBO (GL thread) ->
+// write the rows into the mapping (worker) -> unmap + glTexImage2D from the PBO + fence (GL thread).
+// The fence tells when the PBO can be handed to the next image, so the driver copy runs asynchronously.
+//
+// When a cooked container (<image>.ctex, see tools/texture_cooker.cpp) exists next to the image, its block
+// compressed mips are uploaded straight from the mapped file instead and the image is never decoded.
+
+#define PIXEL_BUFFERS_COUNT 8
+
+struct Pixel_Buffer
+{
+    u32 id;
+    u64 capacity;
+    GLsync fence;
+    bool inUse;
+};
+
+struct Pixel_Buffer_Pool
+{
+    Pixel_Buffer buffers[ PIXEL_BUFFERS_COUNT ];
+    bool initialized;
+};
+
+global_variable Pixel_Buffer_Pool globalPixelBufferPool;
+
+//@NOTE: BC1/BC3 need the S3TC extension, BC4/BC5 (RGTC) are core. -1 until the first batch queries it
+global_variable int globalS3tcSupported = -1;
+
+enum Texture_Decode_Target
+{
+    TEXTURE_DECODE_2D,
+    TEXTURE_DECODE_CUBEMAP_FACE
+};
+
+struct Texture_Batch;
+
+struct Texture_Decode
+{
+    char path[ 256 ];
+    bool flip;
+
+    Texture_Decode_Target target;
+    u32 id;
+    int face;
+
+    u8 *data;
+    int width;
+    int height;
+    int componentsCount;
+
+    bool flipped;
+    Pixel_Buffer *staging;
+    u8 *mapped;
+
+    //@NOTE: Set when the pixel buffer lost its contents, the image is decoded again and uploaded from client memory
+    bool direct;
+
+    bool tryCooked;
+    Asset_File cooked;
+    u8 *flippedBlocks;
+
+    Texture_Batch *batch;
+};
+
+struct Texture_Batch
+{
+    Job_Queue *queue;
+    Pixel_Buffer_Pool *pool;
+    bool s3tcSupported;
+
+    std::mutex mutex;
+    std::condition_variable progress;
+    std::vector< Texture_Decode * > decoded;
+    std::vector< Texture_Decode * > staged;
+
+    //@NOTE: Decoded images waiting for a free pixel buffer, only touched on the GL thread
+    std::vector< Texture_Decode * > waiting;
+
+    int queuedCount;
+    int uploadedCount;
+};
+
+inline GLenum GetTextureFormat( int componentsCount )
+{
+    switch ( componentsCount )
+    {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 4: return GL_RGBA;
+        default: return GL_RGB;
+    }
+}
+
+inline u64 GetDecodedTextureSize( Texture_Decode *decode )
+{
+    return ( u64 ) decode->width * decode->height * decode->componentsCount;
+}
+
+internal void SetTexture2DParameters()
+{
+    //@NOTE: GL_CLAMP_TO_EDGE for transparent not repeating textures, GL_REPEAT otherwise
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+}
+
+//@NOTE: data is a client pointer, or an offset into the bound GL_PIXEL_UNPACK_BUFFER
+internal void UploadTexture2D( u32 id, u8 *data, int width, int height, int componentsCount )
+{
+    GLenum format = GetTextureFormat( componentsCount );
+
+    glBindTexture( GL_TEXTURE_2D, id );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glTexImage2D( GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    glGenerateMipmap( GL_TEXTURE_2D );
+    SetTexture2DParameters();
+}
+
+internal void InitializePixelBufferPool( Pixel_Buffer_Pool *pool )
+{
+    if ( pool->initialized ) { return; }
+
+    for ( int i = 0; i < PIXEL_BUFFERS_COUNT; ++i )
+    {
+        pool->buffers[ i ] = {};
+        glGenBuffers( 1, &pool->buffers[ i ].id );
+    }
+    pool->initialized = true;
+}
+
+inline bool IsFenceSignaled( GLsync fence )
+{
+    if ( !fence ) { return true; }
+    GLenum status = glClientWaitSync( fence, 0, 0 );
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+// Returns a buffer the GPU is done with, preferring one that is already big enough. Returns 0 when every
+// buffer is mapped or still being read by an upload.
+internal Pixel_Buffer *AcquirePixelBuffer( Pixel_Buffer_Pool *pool, u64 size )
+{
+    Pixel_Buffer *result = 0;
+    for ( int i = 0; i < PIXEL_BUFFERS_COUNT; ++i )
+    {
+        Pixel_Buffer *buffer = &pool->buffers[ i ];
+        if ( buffer->inUse || !IsFenceSignaled( buffer->fence ) ) { continue; }
+
+        if ( buffer->fence )
+        {
+            glDeleteSync( buffer->fence );
+            buffer->fence = 0;
+        }
+
+        if ( !result || ( result->capacity < size && buffer->capacity > result->capacity ) )
+        {
+            result = buffer;
+        }
+    }
+
+    if ( !result ) { return 0; }
+
+    result->inUse = true;
+    if ( result->capacity < size )
+    {
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, result->id );
+        glBufferData( GL_PIXEL_UNPACK_BUFFER, ( GLsizeiptr ) size, 0, GL_STREAM_DRAW );
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+        result->capacity = size;
+    }
+    return result;
+}
+
+internal void ReleasePixelBuffer( Pixel_Buffer *buffer )
+{
+    buffer->fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+    buffer->inUse = false;
+}
+
+// Blocks (up to 1ms) until an in flight upload is done reading its pixel buffer. Returns false if there is
+// nothing to wait on because every buffer is still mapped.
+internal bool WaitForPixelBuffer( Pixel_Buffer_Pool *pool )
+{
+    for ( int i = 0; i < PIXEL_BUFFERS_COUNT; ++i )
+    {
+        Pixel_Buffer *buffer = &pool->buffers[ i ];
+        if ( !buffer->inUse && buffer->fence )
+        {
+            glClientWaitSync( buffer->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000 );
+            return true;
+        }
+    }
+    return false;
+}
+
+internal void FlipRows( u8 *pixels, int width, int height, int componentsCount )
+{
+    u64 rowSize = ( u64 ) width * componentsCount;
+    u8 *temp = ( u8 * ) malloc( ( size_t ) rowSize );
+    for ( int row = 0; row < height / 2; ++row )
+    {
+        u8 *top = pixels + row * rowSize;
+        u8 *bottom = pixels + ( height - 1 - row ) * rowSize;
+        memcpy( temp, top, ( size_t ) rowSize );
+        memcpy( top, bottom, ( size_t ) rowSize );
+        memcpy( bottom, temp, ( size_t ) rowSize );
+    }
+    free( temp );
+}
+
+internal bool IsExtensionSupported( char *name )
+{
+    int extensionsCount = 0;
+    glGetIntegerv( GL_NUM_EXTENSIONS, &extensionsCount );
+    for ( int i = 0; i < extensionsCount; ++i )
+    {
+        if ( strcmp( ( char * ) glGetStringi( GL_EXTENSIONS, i ), name ) == 0 ) { return true; }
+    }
+    return false;
+}
+
+inline GLenum GetCookedTextureInternalFormat( u32 format )
+{
+    switch ( format )
+    {
+        case COOKED_TEXTURE_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case COOKED_TEXTURE_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case COOKED_TEXTURE_BC4: return GL_COMPRESSED_RED_RGTC1;
+        default: return GL_COMPRESSED_RG_RGTC2;
+    }
+}
+
+inline bool HasCookedTexture( char *path )
+{
+    char cookedPath[ 256 ];
+    snprintf( cookedPath, sizeof( cookedPath ), "%s.ctex", path );
+
+    File_Stamp stamp;
+    return GetAssetStamp( cookedPath, &stamp );
+}
+
+// Opens the cooked container of the image, flipping the blocks into a separate buffer when needed.
+// Returns false when the image has to be decoded from the source instead.
+internal bool LoadCookedTexture( Texture_Decode *decode, bool s3tcSupported )
+{
+    char cookedPath[ 256 ];
+    snprintf( cookedPath, sizeof( cookedPath ), "%s.ctex", decode->path );
+    if ( !OpenAssetFile( cookedPath, &decode->cooked ) ) { return false; }
+
+    u8 *file = ( u8 * ) decode->cooked.memory;
+    Cooked_Texture_Header *header = ( Cooked_Texture_Header * ) file;
+    Cooked_Texture_Mip *mips = GetCookedTextureMips( file, decode->cooked.size );
+
+    //@NOTE: Without the source there is nothing else to load, the container is used as it is
+    File_Stamp sourceStamp;
+    if ( mips && GetAssetStamp( decode->path, &sourceStamp ) &&
+         ( header->sourceSize != sourceStamp.size || header->sourceWriteTime != sourceStamp.lastWriteTime ) )
+    {
+        printf( "Cooked texture is stale, decoding the source: %s\n", cookedPath );
+        CloseAssetFile( &decode->cooked );
+        return false;
+    }
+
+    bool usable = mips && ( s3tcSupported || header->format == COOKED_TEXTURE_BC4 || header->format == COOKED_TEXTURE_BC5 ) &&
+                  ( !decode->flip || CanFlipCookedTexture( header, mips ) );
+    if ( !usable )
+    {
+        printf( "Cooked texture can't be used, decoding the source: %s\n", cookedPath );
+        CloseAssetFile( &decode->cooked );
+        return false;
+    }
+
+    if ( decode->flip )
+    {
+        decode->flippedBlocks = ( u8 * ) malloc( ( size_t ) decode->cooked.size );
+        for ( u32 i = 0; i < header->mipsCount; ++i )
+        {
+            FlipCookedMip( header->format, mips[ i ].width, mips[ i ].height, file + mips[ i ].offset,
+                           decode->flippedBlocks + mips[ i ].offset );
+        }
+    }
+
+    decode->width = ( int ) header->width;
+    decode->height = ( int ) header->height;
+    decode->componentsCount = ( int ) header->componentsCount;
+    return true;
+}
+
+internal void UploadCookedTexture( Texture_Decode *decode )
+{
+    u8 *file = ( u8 * ) decode->cooked.memory;
+    Cooked_Texture_Header *header = ( Cooked_Texture_Header * ) file;
+    Cooked_Texture_Mip *mips = GetCookedTextureMips( file, decode->cooked.size );
+    u8 *blocks = decode->flippedBlocks ? decode->flippedBlocks : file;
+    GLenum internalFormat = GetCookedTextureInternalFormat( header->format );
+
+    GLenum target = GL_TEXTURE_2D;
+    if ( decode->target == TEXTURE_DECODE_CUBEMAP_FACE )
+    {
+        glBindTexture( GL_TEXTURE_CUBE_MAP, decode->id );
+        target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + decode->face;
+    }
+    else
+    {
+        glBindTexture( GL_TEXTURE_2D, decode->id );
+    }
+
+    for ( u32 i = 0; i < header->mipsCount; ++i )
+    {
+        glCompressedTexImage2D( target, i, internalFormat, mips[ i ].width, mips[ i ].height, 0,
+                                ( GLsizei ) mips[ i ].size, blocks + mips[ i ].offset );
+    }
+
+    if ( decode->target == TEXTURE_DECODE_2D )
+    {
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header->mipsCount - 1 );
+        SetTexture2DParameters();
+    }
+
+    free( decode->flippedBlocks );
+    decode->flippedBlocks = 0;
+    CloseAssetFile( &decode->cooked );
+}
+
+internal void DecodeTextureJob( void *data, int index )
+{
+    Texture_Decode *decode = ( Texture_Decode * ) data;
+    Texture_Batch *batch = decode->batch;
+
+    if ( !decode->tryCooked || !LoadCookedTexture( decode, batch->s3tcSupported ) )
+    {
+        decode->tryCooked = false;
+
+        //@NOTE: The thread local flag, the global one would race between workers decoding different models
+        stbi_set_flip_vertically_on_load_thread( decode->flipped );
+        Asset_File file;
+        if ( OpenAssetFile( decode->path, &file ) )
+        {
+            decode->data = stbi_load_from_memory( file.memory, ( int ) file.size, &decode->width, &decode->height,
+                                                  &decode->componentsCount, 0 );
+            CloseAssetFile( &file );
+        }
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( batch->mutex );
+        batch->decoded.push_back( decode );
+    }
+    batch->progress.notify_one();
+}
+
+internal void StageTextureJob( void *data, int index )
+{
+    Texture_Decode *decode = ( Texture_Decode * ) data;
+    Texture_Batch *batch = decode->batch;
+
+    u64 rowSize = ( u64 ) decode->width * decode->componentsCount;
+    for ( int row = 0; row < decode->height; ++row )
+    {
+        int sourceRow = decode->flip ? decode->height - 1 - row : row;
+        memcpy( decode->mapped + row * rowSize, decode->data + sourceRow * rowSize, ( size_t ) rowSize );
+    }
+    stbi_image_free( decode->data );
+    decode->data = 0;
+
+    {
+        std::lock_guard< std::mutex > lock( batch->mutex );
+        batch->staged.push_back( decode );
+    }
+    batch->progress.notify_one();
+}
+
+internal void UploadDecodedTexture( Texture_Decode *decode, u8 *pixels )
+{
+    switch ( decode->target )
+    {
+        case TEXTURE_DECODE_2D:
+        {
+            UploadTexture2D( decode->id, pixels, decode->width, decode->height, decode->componentsCount );
+        }
+        break;
+
+        case TEXTURE_DECODE_CUBEMAP_FACE:
+        {
+            GLenum format = GetTextureFormat( decode->componentsCount );
+            glBindTexture( GL_TEXTURE_CUBE_MAP, decode->id );
+            glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+            glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + decode->face, 0, format, decode->width, decode->height, 0,
+                          format, GL_UNSIGNED_BYTE, pixels );
+            glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+        }
+        break;
+    }
+}
+
+// glUnmapBuffer fails when the buffer contents were lost while mapped (a display mode change for example), the
+// decoded pixels are already freed then so the image is queued for decoding again
+internal void UploadStagedTexture( Texture_Batch *batch, Texture_Decode *decode )
+{
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, decode->staging->id );
+    bool unmapped = glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER ) == GL_TRUE;
+    if ( unmapped ) { UploadDecodedTexture( decode, 0 ); }
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+    ReleasePixelBuffer( decode->staging );
+    decode->staging = 0;
+    decode->mapped = 0;
+
+    if ( !unmapped )
+    {
+        printf( "Pixel buffer contents lost, decoding again: %s\n", decode->path );
+        decode->direct = true;
+        if ( batch->queue )
+        {
+            AddJob( batch->queue, 0, DecodeTextureJob, decode, 0 );
+        }
+        else
+        {
+            DecodeTextureJob( decode, 0 );
+        }
+        return;
+    }
+
+    ++batch->uploadedCount;
+    delete decode;
+}
+
+// Returns false when no pixel buffer is free yet and the image has to wait
+internal bool StartTextureUpload( Texture_Batch *batch, Texture_Decode *decode )
+{
+    if ( decode->tryCooked )
+    {
+        UploadCookedTexture( decode );
+        ++batch->uploadedCount;
+        delete decode;
+        return true;
+    }
+
+    if ( !decode->data )
+    {
+        printf( "Failed to load texture: %s\n", decode->path );
+        ++batch->uploadedCount;
+        delete decode;
+        return true;
+    }
+
+    if ( !batch->pool || decode->direct )
+    {
+        if ( decode->flip && !decode->flipped )
+        {
+            FlipRows( decode->data, decode->width, decode->height, decode->componentsCount );
+        }
+        UploadDecodedTexture( decode, decode->data );
+        stbi_image_free( decode->data );
+        ++batch->uploadedCount;
+        delete decode;
+        return true;
+    }
+
+    u64 size = GetDecodedTextureSize( decode );
+    Pixel_Buffer *staging = AcquirePixelBuffer( batch->pool, size );
+    if ( !staging ) { return false; }
+
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, staging->id );
+    decode->mapped = ( u8 * ) glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, ( GLsizeiptr ) size,
+                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+    decode->staging = staging;
+
+    if ( !decode->mapped )
+    {
+        printf( "Failed to map pixel buffer, uploading directly: %s\n", decode->path );
+        staging->inUse = false;
+        batch->pool = 0;
+        return StartTextureUpload( batch, decode );
+    }
+
+    if ( batch->queue )
+    {
+        AddJob( batch->queue, 0, StageTextureJob, decode, 0 );
+    }
+    else
+    {
+        StageTextureJob( decode, 0 );
+    }
+    return true;
+}
+
+internal void BeginTextureBatch( Texture_Batch *batch, Job_Queue *queue, bool usePixelBuffers = true )
+{
+    batch->queue = queue;
+    batch->pool = 0;
+
+    if ( globalS3tcSupported < 0 ) { globalS3tcSupported = IsExtensionSupported( "GL_EXT_texture_compression_s3tc" ); }
+    batch->s3tcSupported = globalS3tcSupported != 0;
+
+    if ( usePixelBuffers )
+    {
+        InitializePixelBufferPool( &globalPixelBufferPool );
+        batch->pool = &globalPixelBufferPool;
+    }
+
+    batch->decoded.clear();
+    batch->staged.clear();
+    batch->waiting.clear();
+    batch->queuedCount = 0;
+    batch->uploadedCount = 0;
+}
+
+internal void QueueTextureDecode( Texture_Batch *batch, Texture_Decode *decode )
+{
+    decode->batch = batch;
+    decode->tryCooked = HasCookedTexture( decode->path );
+    ++batch->queuedCount;
+
+    //@NOTE: When staging through a pixel buffer the flip is done while writing the rows into the mapping
+    decode->flipped = decode->flip && !batch->pool;
+
+    if ( batch->queue )
+    {
+        AddJob( batch->queue, 0, DecodeTextureJob, decode, 0 );
+    }
+    else
+    {
+        DecodeTextureJob( decode, 0 );
+    }
+}
+
+// Returns the GL id immediately, the image data is uploaded by PumpTextureBatch/FinishTextureBatch
+internal u32 QueueTexture2D( Texture_Batch *batch, char *path, bool flip )
+{
+    Texture_Decode *decode = new Texture_Decode();
+    strncpy_s( decode->path, path, sizeof( decode->path ) - 1 );
+    decode->flip = flip;
+    decode->target = TEXTURE_DECODE_2D;
+    glGenTextures( 1, &decode->id );
+
+    QueueTextureDecode( batch, decode );
+    return decode->id;
+}
+
+internal void QueueCubemapFace( Texture_Batch *batch, u32 id, int face, char *path )
+{
+    Texture_Decode *decode = new Texture_Decode();
+    strncpy_s( decode->path, path, sizeof( decode->path ) - 1 );
+    decode->target = TEXTURE_DECODE_CUBEMAP_FACE;
+    decode->id = id;
+    decode->face = face;
+
+    QueueTextureDecode( batch, decode );
+}
+
+// Moves every image one step further without blocking, returns false if nothing could progress.
+// Cheap enough to call once per frame to keep streaming textures in while rendering.
+internal bool PumpTextureBatch( Texture_Batch *batch )
+{
+    std::vector< Texture_Decode * > decoded;
+    std::vector< Texture_Decode * > staged;
+    {
+        std::lock_guard< std::mutex > lock( batch->mutex );
+        decoded.swap( batch->decoded );
+        staged.swap( batch->staged );
+    }
+
+    bool progress = !staged.empty();
+    for ( Texture_Decode *decode : staged )
+    {
+        UploadStagedTexture( batch, decode );
+    }
+
+    batch->waiting.insert( batch->waiting.end(), decoded.begin(), decoded.end() );
+    u32 started = 0;
+    while ( started < batch->waiting.size() && StartTextureUpload( batch, batch->waiting[ started ] ) )
+    {
+        ++started;
+    }
+    batch->waiting.erase( batch->waiting.begin(), batch->waiting.begin() + started );
+
+    glBindTexture( GL_TEXTURE_2D, 0 );
+    return progress || started > 0;
+}
+
+internal void FinishTextureBatch( Texture_Batch *batch )
+{
+    while ( batch->uploadedCount < batch->queuedCount )
+    {
+        if ( PumpTextureBatch( batch ) ) { continue; }
+
+        if ( batch->waiting.empty() || !WaitForPixelBuffer( batch->pool ) )
+        {
+            std::unique_lock< std::mutex > lock( batch->mutex );
+            batch->progress.wait( lock, [ batch ] { return !batch->decoded.empty() || !batch->staged.empty(); } );
+        }
+    }
+}
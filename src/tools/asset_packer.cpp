@@ -0,0 +1,198 @@
+// Asset packer: writes every file under the given files/directories into a single package (see package.h).
+// Entries are named by the path as given on the command line, so run it from the directory the engine runs in:
+//
+//   asset_packer engine.pak . ../src/shaders
+//
+// Model caches (.mcache) are packed too. Once one goes stale the engine rewrites it as a loose file and reads
+// that one instead, repack to get it back into the package.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include "../utils/utils.h"
+#include "../platform.h"
+#include "../package.h"
+
+internal bool EndsWith( char *string, char *suffix )
+{
+    size_t length = strlen( string );
+    size_t suffixLength = strlen( suffix );
+    return length >= suffixLength && _stricmp( string + length - suffixLength, suffix ) == 0;
+}
+
+internal void CollectFiles( char *directory, std::vector< std::string > *paths )
+{
+    char pattern[ MAX_PATH ];
+    snprintf( pattern, sizeof( pattern ), "%s/*", directory );
+
+    WIN32_FIND_DATAA findData;
+    HANDLE find = FindFirstFileA( pattern, &findData );
+    if ( find == INVALID_HANDLE_VALUE ) { return; }
+
+    do
+    {
+        if ( strcmp( findData.cFileName, "." ) == 0 || strcmp( findData.cFileName, ".." ) == 0 ) { continue; }
+
+        char path[ MAX_PATH ];
+        snprintf( path, sizeof( path ), "%s/%s", directory, findData.cFileName );
+        if ( findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+        {
+            CollectFiles( path, paths );
+        }
+        else if ( !EndsWith( findData.cFileName, ".pak" ) )
+        {
+            paths->push_back( path );
+        }
+    } while ( FindNextFileA( find, &findData ) );
+
+    FindClose( find );
+}
+
+inline u64 AlignToPage( u64 offset )
+{
+    return ( offset + PACKAGE_PAGE_SIZE - 1 ) & ~( ( u64 ) PACKAGE_PAGE_SIZE - 1 );
+}
+
+int main( int argumentsCount, char **arguments )
+{
+    if ( argumentsCount < 3 )
+    {
+        printf( "Usage: asset_packer <output.pak> <file or directory>...\n" );
+        return 1;
+    }
+
+    std::vector< std::string > paths;
+    for ( int i = 2; i < argumentsCount; ++i )
+    {
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if ( !GetFileAttributesExA( arguments[ i ], GetFileExInfoStandard, &attributes ) )
+        {
+            printf( "No such file or directory: %s\n", arguments[ i ] );
+            return 1;
+        }
+
+        if ( attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+        {
+            CollectFiles( arguments[ i ], &paths );
+        }
+        else
+        {
+            paths.push_back( arguments[ i ] );
+        }
+    }
+
+    std::vector< Package_Entry > entries;
+    std::vector< std::string > sources;
+    for ( std::string &path : paths )
+    {
+        Package_Entry entry = {};
+        if ( path.size() >= PACKAGE_PATH_SIZE )
+        {
+            printf( "Path is too long for the package: %s\n", path.c_str() );
+            return 1;
+        }
+        NormalizePackagePath( ( char * ) path.c_str(), entry.path, PACKAGE_PATH_SIZE );
+        entry.pathHash = HashPackagePath( entry.path );
+
+        File_Stamp stamp;
+        if ( !GetFileStamp( ( char * ) path.c_str(), &stamp ) )
+        {
+            printf( "Failed to read: %s\n", path.c_str() );
+            return 1;
+        }
+        entry.size = stamp.size;
+        entry.sourceWriteTime = stamp.lastWriteTime;
+
+        bool duplicate = false;
+        for ( Package_Entry &other : entries )
+        {
+            if ( other.pathHash == entry.pathHash && strcmp( other.path, entry.path ) == 0 ) { duplicate = true; }
+        }
+        if ( duplicate ) { continue; }
+
+        entries.push_back( entry );
+        sources.push_back( path );
+    }
+
+    Package_Header header = {};
+    header.magic = PACKAGE_MAGIC;
+    header.version = PACKAGE_VERSION;
+    header.entriesCount = ( u32 ) entries.size();
+
+    header.slotsCount = 16;
+    while ( header.slotsCount < header.entriesCount * 2 ) { header.slotsCount *= 2; }
+
+    u32 *slots = ( u32 * ) calloc( header.slotsCount, sizeof( u32 ) );
+    defer { free( slots ); };
+
+    u32 mask = header.slotsCount - 1;
+    for ( u32 i = 0; i < header.entriesCount; ++i )
+    {
+        u32 slot = ( u32 ) entries[ i ].pathHash & mask;
+        while ( slots[ slot ] ) { slot = ( slot + 1 ) & mask; }
+        slots[ slot ] = i + 1;
+    }
+
+    header.entriesOffset = sizeof( Package_Header );
+    header.slotsOffset = header.entriesOffset + header.entriesCount * sizeof( Package_Entry );
+
+    u64 offset = AlignToPage( header.slotsOffset + header.slotsCount * sizeof( u32 ) );
+    for ( Package_Entry &entry : entries )
+    {
+        entry.offset = offset;
+        offset = AlignToPage( offset + entry.size );
+    }
+    header.fileSize = offset;
+
+    FILE *file;
+    fopen_s( &file, arguments[ 1 ], "wb" );
+    if ( !file )
+    {
+        printf( "Failed to open package for writing: %s\n", arguments[ 1 ] );
+        return 1;
+    }
+
+    fwrite( &header, sizeof( header ), 1, file );
+    fwrite( entries.data(), sizeof( Package_Entry ), entries.size(), file );
+    fwrite( slots, sizeof( u32 ), header.slotsCount, file );
+
+    u8 zeros[ PACKAGE_PAGE_SIZE ] = {};
+    u64 written = header.slotsOffset + header.slotsCount * sizeof( u32 );
+    bool failed = false;
+    for ( u32 i = 0; i < header.entriesCount && !failed; ++i )
+    {
+        fwrite( zeros, 1, ( size_t ) ( entries[ i ].offset - written ), file );
+
+        //@NOTE: Empty files can't be mapped, they only get an entry
+        if ( entries[ i ].size )
+        {
+            Mapped_File source;
+            if ( !MapFile( ( char * ) sources[ i ].c_str(), &source ) || source.size != entries[ i ].size )
+            {
+                printf( "Failed to read: %s\n", sources[ i ].c_str() );
+                UnmapFile( &source );
+                failed = true;
+                break;
+            }
+            fwrite( source.memory, 1, ( size_t ) source.size, file );
+            UnmapFile( &source );
+        }
+        written = entries[ i ].offset + entries[ i ].size;
+    }
+    fwrite( zeros, 1, ( size_t ) ( header.fileSize - written ), file );
+
+    failed = failed || ferror( file ) != 0;
+    fclose( file );
+
+    if ( failed )
+    {
+        printf( "Failed to write package: %s\n", arguments[ 1 ] );
+        remove( arguments[ 1 ] );
+        return 1;
+    }
+
+    printf( "%u files, %llu bytes: %s\n", header.entriesCount, ( unsigned long long ) header.fileSize, arguments[ 1 ] );
+    return 0;
+}
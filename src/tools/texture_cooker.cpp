@@ -0,0 +1,497 @@
+// Offline texture cooker: converts every .jpg/.png under the given files/directories into a .ctex container
+// (see cooked_texture.h) holding the full mip chain, block compressed. Sources whose content hash matches the
+// one stored in an existing container are skipped, only the source stamp in its header is updated.
+//
+//   texture_cooker [-force] <file or directory>...     (defaults to the current directory)
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_JPEG
+#define STBI_ONLY_PNG
+#include "../stb_image.h"
+#include "../utils/utils.h"
+#include "../platform.h"
+#include "../jobs.h"
+#include "../cooked_texture.h"
+
+struct Color_565
+{
+    u16 packed;
+    int r, g, b;
+};
+
+inline int Clamp255( float32 value )
+{
+    int result = ( int ) ( value + 0.5f );
+    return result < 0 ? 0 : ( result > 255 ? 255 : result );
+}
+
+internal Color_565 PackColor565( float32 r, float32 g, float32 b )
+{
+    int r5 = ( Clamp255( r ) * 31 + 127 ) / 255;
+    int g6 = ( Clamp255( g ) * 63 + 127 ) / 255;
+    int b5 = ( Clamp255( b ) * 31 + 127 ) / 255;
+
+    Color_565 result;
+    result.packed = ( u16 ) ( ( r5 << 11 ) | ( g6 << 5 ) | b5 );
+    result.r = ( r5 << 3 ) | ( r5 >> 2 );
+    result.g = ( g6 << 2 ) | ( g6 >> 4 );
+    result.b = ( b5 << 3 ) | ( b5 >> 2 );
+    return result;
+}
+
+// pixels: 16 RGBA texels. Endpoints come from the extent of the block along its principal axis,
+// inset a bit to reduce the error of the interpolated colors.
+internal void EncodeBC1Block( u8 *pixels, u8 *block )
+{
+    float32 mean[ 3 ] = {};
+    for ( int i = 0; i < 16; ++i )
+    {
+        for ( int c = 0; c < 3; ++c ) { mean[ c ] += pixels[ i * 4 + c ]; }
+    }
+    for ( int c = 0; c < 3; ++c ) { mean[ c ] /= 16.0f; }
+
+    float32 covariance[ 6 ] = {};
+    for ( int i = 0; i < 16; ++i )
+    {
+        float32 r = pixels[ i * 4 + 0 ] - mean[ 0 ];
+        float32 g = pixels[ i * 4 + 1 ] - mean[ 1 ];
+        float32 b = pixels[ i * 4 + 2 ] - mean[ 2 ];
+        covariance[ 0 ] += r * r;
+        covariance[ 1 ] += r * g;
+        covariance[ 2 ] += r * b;
+        covariance[ 3 ] += g * g;
+        covariance[ 4 ] += g * b;
+        covariance[ 5 ] += b * b;
+    }
+
+    float32 axis[ 3 ] = { 1.0f, 1.0f, 1.0f };
+    for ( int iteration = 0; iteration < 8; ++iteration )
+    {
+        float32 x = covariance[ 0 ] * axis[ 0 ] + covariance[ 1 ] * axis[ 1 ] + covariance[ 2 ] * axis[ 2 ];
+        float32 y = covariance[ 1 ] * axis[ 0 ] + covariance[ 3 ] * axis[ 1 ] + covariance[ 4 ] * axis[ 2 ];
+        float32 z = covariance[ 2 ] * axis[ 0 ] + covariance[ 4 ] * axis[ 1 ] + covariance[ 5 ] * axis[ 2 ];
+        float32 length = sqrtf( x * x + y * y + z * z );
+        if ( length < 1e-6f ) { break; }
+        axis[ 0 ] = x / length;
+        axis[ 1 ] = y / length;
+        axis[ 2 ] = z / length;
+    }
+
+    float32 minProjection = 1e30f;
+    float32 maxProjection = -1e30f;
+    for ( int i = 0; i < 16; ++i )
+    {
+        float32 projection = ( pixels[ i * 4 + 0 ] - mean[ 0 ] ) * axis[ 0 ] +
+                             ( pixels[ i * 4 + 1 ] - mean[ 1 ] ) * axis[ 1 ] +
+                             ( pixels[ i * 4 + 2 ] - mean[ 2 ] ) * axis[ 2 ];
+        if ( projection < minProjection ) { minProjection = projection; }
+        if ( projection > maxProjection ) { maxProjection = projection; }
+    }
+
+    float32 inset = ( maxProjection - minProjection ) / 16.0f;
+    minProjection += inset;
+    maxProjection -= inset;
+
+    Color_565 color0 = PackColor565( mean[ 0 ] + axis[ 0 ] * maxProjection, mean[ 1 ] + axis[ 1 ] * maxProjection,
+                                     mean[ 2 ] + axis[ 2 ] * maxProjection );
+    Color_565 color1 = PackColor565( mean[ 0 ] + axis[ 0 ] * minProjection, mean[ 1 ] + axis[ 1 ] * minProjection,
+                                     mean[ 2 ] + axis[ 2 ] * minProjection );
+
+    //@NOTE: color0 > color1 selects the 4 color mode
+    if ( color0.packed < color1.packed )
+    {
+        Color_565 temp = color0;
+        color0 = color1;
+        color1 = temp;
+    }
+
+    u32 indices = 0;
+    if ( color0.packed != color1.packed )
+    {
+        int palette[ 4 ][ 3 ] = {
+            { color0.r, color0.g, color0.b },
+            { color1.r, color1.g, color1.b },
+            { ( 2 * color0.r + color1.r ) / 3, ( 2 * color0.g + color1.g ) / 3, ( 2 * color0.b + color1.b ) / 3 },
+            { ( color0.r + 2 * color1.r ) / 3, ( color0.g + 2 * color1.g ) / 3, ( color0.b + 2 * color1.b ) / 3 },
+        };
+
+        for ( int i = 0; i < 16; ++i )
+        {
+            int bestIndex = 0;
+            int bestError = 0x7fffffff;
+            for ( int p = 0; p < 4; ++p )
+            {
+                int dr = pixels[ i * 4 + 0 ] - palette[ p ][ 0 ];
+                int dg = pixels[ i * 4 + 1 ] - palette[ p ][ 1 ];
+                int db = pixels[ i * 4 + 2 ] - palette[ p ][ 2 ];
+                int error = dr * dr + dg * dg + db * db;
+                if ( error < bestError )
+                {
+                    bestError = error;
+                    bestIndex = p;
+                }
+            }
+            indices |= ( u32 ) bestIndex << ( 2 * i );
+        }
+    }
+
+    block[ 0 ] = ( u8 ) ( color0.packed & 0xff );
+    block[ 1 ] = ( u8 ) ( color0.packed >> 8 );
+    block[ 2 ] = ( u8 ) ( color1.packed & 0xff );
+    block[ 3 ] = ( u8 ) ( color1.packed >> 8 );
+    for ( int i = 0; i < 4; ++i ) { block[ 4 + i ] = ( u8 ) ( indices >> ( 8 * i ) ); }
+}
+
+// values: 16 texels of one channel, stride apart
+internal void EncodeBC4Block( u8 *values, int stride, u8 *block )
+{
+    int minValue = 255;
+    int maxValue = 0;
+    for ( int i = 0; i < 16; ++i )
+    {
+        int value = values[ i * stride ];
+        if ( value < minValue ) { minValue = value; }
+        if ( value > maxValue ) { maxValue = value; }
+    }
+
+    //@NOTE: a0 > a1 selects the 8 value mode: a0, a1, then 6 steps from a0 to a1 (indices 2..7)
+    block[ 0 ] = ( u8 ) maxValue;
+    block[ 1 ] = ( u8 ) minValue;
+
+    u64 indices = 0;
+    if ( maxValue != minValue )
+    {
+        int range = maxValue - minValue;
+        for ( int i = 0; i < 16; ++i )
+        {
+            int step = ( ( maxValue - values[ i * stride ] ) * 7 + range / 2 ) / range;
+            int index = step == 0 ? 0 : ( step == 7 ? 1 : step + 1 );
+            indices |= ( u64 ) index << ( 3 * i );
+        }
+    }
+
+    for ( int i = 0; i < 6; ++i ) { block[ 2 + i ] = ( u8 ) ( indices >> ( 8 * i ) ); }
+}
+
+// Encodes one RGBA8 level, edge texels are repeated to fill partial blocks
+internal void CompressLevel( u8 *pixels, u32 width, u32 height, u32 format, u8 *output )
+{
+    int blockSize = GetCookedBlockSize( format );
+    u32 blocksX = ( width + 3 ) / 4;
+    u32 blocksY = ( height + 3 ) / 4;
+
+    for ( u32 by = 0; by < blocksY; ++by )
+    {
+        for ( u32 bx = 0; bx < blocksX; ++bx )
+        {
+            u8 texels[ 16 * 4 ];
+            for ( u32 y = 0; y < 4; ++y )
+            {
+                for ( u32 x = 0; x < 4; ++x )
+                {
+                    u32 sourceX = bx * 4 + x < width ? bx * 4 + x : width - 1;
+                    u32 sourceY = by * 4 + y < height ? by * 4 + y : height - 1;
+                    memcpy( &texels[ ( y * 4 + x ) * 4 ], &pixels[ ( ( u64 ) sourceY * width + sourceX ) * 4 ], 4 );
+                }
+            }
+
+            u8 *block = output + ( ( u64 ) by * blocksX + bx ) * blockSize;
+            switch ( format )
+            {
+                case COOKED_TEXTURE_BC1: EncodeBC1Block( texels, block ); break;
+                case COOKED_TEXTURE_BC3:
+                    EncodeBC4Block( texels + 3, 4, block );
+                    EncodeBC1Block( texels, block + 8 );
+                    break;
+                case COOKED_TEXTURE_BC4: EncodeBC4Block( texels, 4, block ); break;
+                case COOKED_TEXTURE_BC5:
+                    //@NOTE: Only two component images get BC5, decoded to RGBA they are grey, grey, grey, alpha
+                    EncodeBC4Block( texels, 4, block );
+                    EncodeBC4Block( texels + 3, 4, block + 8 );
+                    break;
+            }
+        }
+    }
+}
+
+// 2x2 box filter, odd sizes fold the last row/column into the previous texel
+internal u8 *Downsample( u8 *pixels, u32 width, u32 height, u32 *outWidth, u32 *outHeight )
+{
+    u32 nextWidth = width > 1 ? width / 2 : 1;
+    u32 nextHeight = height > 1 ? height / 2 : 1;
+    u8 *result = ( u8 * ) malloc( ( size_t ) nextWidth * nextHeight * 4 );
+
+    for ( u32 y = 0; y < nextHeight; ++y )
+    {
+        u32 y0 = y * 2 < height ? y * 2 : height - 1;
+        u32 y1 = y * 2 + 1 < height ? y * 2 + 1 : y0;
+        for ( u32 x = 0; x < nextWidth; ++x )
+        {
+            u32 x0 = x * 2 < width ? x * 2 : width - 1;
+            u32 x1 = x * 2 + 1 < width ? x * 2 + 1 : x0;
+            for ( int c = 0; c < 4; ++c )
+            {
+                u32 sum = pixels[ ( ( u64 ) y0 * width + x0 ) * 4 + c ] + pixels[ ( ( u64 ) y0 * width + x1 ) * 4 + c ] +
+                          pixels[ ( ( u64 ) y1 * width + x0 ) * 4 + c ] + pixels[ ( ( u64 ) y1 * width + x1 ) * 4 + c ];
+                result[ ( ( u64 ) y * nextWidth + x ) * 4 + c ] = ( u8 ) ( ( sum + 2 ) / 4 );
+            }
+        }
+    }
+
+    *outWidth = nextWidth;
+    *outHeight = nextHeight;
+    return result;
+}
+
+internal u32 ChooseCookedFormat( int componentsCount )
+{
+    switch ( componentsCount )
+    {
+        case 1: return COOKED_TEXTURE_BC4;
+        case 2: return COOKED_TEXTURE_BC5;
+        case 4: return COOKED_TEXTURE_BC3;
+        default: return COOKED_TEXTURE_BC1;
+    }
+}
+
+// True when the container was cooked from the same contents. A source that was only touched gets its new stamp
+// written into the header, so the loader keeps using the container without cooking it again.
+internal bool IsCookedTextureCurrent( char *cookedPath, u64 sourceHash, File_Stamp stamp )
+{
+    Mapped_File cooked;
+    if ( !MapFile( cookedPath, &cooked ) ) { return false; }
+
+    Cooked_Texture_Header header = {};
+    bool result = GetCookedTextureMips( ( u8 * ) cooked.memory, cooked.size ) &&
+                  ( ( Cooked_Texture_Header * ) cooked.memory )->sourceHash == sourceHash;
+    if ( result ) { header = *( Cooked_Texture_Header * ) cooked.memory; }
+    UnmapFile( &cooked );
+
+    if ( result && ( header.sourceSize != stamp.size || header.sourceWriteTime != stamp.lastWriteTime ) )
+    {
+        header.sourceSize = stamp.size;
+        header.sourceWriteTime = stamp.lastWriteTime;
+
+        FILE *file;
+        fopen_s( &file, cookedPath, "r+b" );
+        result = file && fwrite( &header, sizeof( header ), 1, file ) == 1;
+        if ( file ) { fclose( file ); }
+    }
+    return result;
+}
+
+struct Cook_Job
+{
+    std::vector< std::string > *paths;
+    bool force;
+    std::atomic< int > cookedCount;
+    std::atomic< int > failedCount;
+};
+
+internal void CookTextureJob( void *data, int index )
+{
+    Cook_Job *job = ( Cook_Job * ) data;
+    char *path = ( char * ) ( *job->paths )[ index ].c_str();
+
+    char cookedPath[ 512 ];
+    snprintf( cookedPath, sizeof( cookedPath ), "%s.ctex", path );
+
+    Mapped_File source;
+    if ( !MapFile( path, &source ) )
+    {
+        printf( "Failed to open %s\n", path );
+        ++job->failedCount;
+        return;
+    }
+    defer { UnmapFile( &source ); };
+
+    File_Stamp stamp;
+    if ( !GetFileStamp( path, &stamp ) )
+    {
+        printf( "Failed to read the stamp of %s\n", path );
+        ++job->failedCount;
+        return;
+    }
+
+    u64 sourceHash = HashBytes( ( u8 * ) source.memory, source.size );
+    if ( !job->force && IsCookedTextureCurrent( cookedPath, sourceHash, stamp ) ) { return; }
+
+    int width, height, componentsCount;
+    if ( !stbi_info_from_memory( ( u8 * ) source.memory, ( int ) source.size, &width, &height, &componentsCount ) )
+    {
+        printf( "Failed to read %s\n", path );
+        ++job->failedCount;
+        return;
+    }
+
+    u8 *pixels = stbi_load_from_memory( ( u8 * ) source.memory, ( int ) source.size, &width, &height, &componentsCount, 4 );
+    if ( !pixels )
+    {
+        printf( "Failed to decode %s: %s\n", path, stbi_failure_reason() );
+        ++job->failedCount;
+        return;
+    }
+
+    Cooked_Texture_Header header = {};
+    header.magic = COOKED_TEXTURE_MAGIC;
+    header.version = COOKED_TEXTURE_VERSION;
+    header.sourceHash = sourceHash;
+    header.sourceSize = stamp.size;
+    header.sourceWriteTime = stamp.lastWriteTime;
+    header.format = ChooseCookedFormat( componentsCount );
+    header.componentsCount = ( u32 ) componentsCount;
+    header.width = ( u32 ) width;
+    header.height = ( u32 ) height;
+
+    Cooked_Texture_Mip mips[ COOKED_TEXTURE_MAX_MIPS ] = {};
+    std::vector< u8 > blocks;
+
+    u32 levelWidth = header.width;
+    u32 levelHeight = header.height;
+    u8 *level = pixels;
+    for ( ;; )
+    {
+        Cooked_Texture_Mip *mip = &mips[ header.mipsCount++ ];
+        mip->width = levelWidth;
+        mip->height = levelHeight;
+        mip->size = GetCookedMipSize( header.format, levelWidth, levelHeight );
+        mip->offset = blocks.size();
+
+        blocks.resize( ( size_t ) ( mip->offset + mip->size ) );
+        CompressLevel( level, levelWidth, levelHeight, header.format, blocks.data() + mip->offset );
+
+        if ( ( levelWidth == 1 && levelHeight == 1 ) || header.mipsCount == COOKED_TEXTURE_MAX_MIPS ) { break; }
+
+        u8 *next = Downsample( level, levelWidth, levelHeight, &levelWidth, &levelHeight );
+        if ( level != pixels ) { free( level ); }
+        level = next;
+    }
+    if ( level != pixels ) { free( level ); }
+    stbi_image_free( pixels );
+
+    u64 dataOffset = sizeof( Cooked_Texture_Header ) + header.mipsCount * sizeof( Cooked_Texture_Mip );
+    for ( u32 i = 0; i < header.mipsCount; ++i ) { mips[ i ].offset += dataOffset; }
+
+    FILE *file;
+    fopen_s( &file, cookedPath, "wb" );
+    if ( !file )
+    {
+        printf( "Failed to open %s for writing\n", cookedPath );
+        ++job->failedCount;
+        return;
+    }
+
+    fwrite( &header, sizeof( header ), 1, file );
+    fwrite( mips, sizeof( Cooked_Texture_Mip ), header.mipsCount, file );
+    fwrite( blocks.data(), 1, blocks.size(), file );
+    bool failed = ferror( file ) != 0;
+    fclose( file );
+
+    if ( failed )
+    {
+        printf( "Failed to write %s\n", cookedPath );
+        remove( cookedPath );
+        ++job->failedCount;
+        return;
+    }
+
+    char *formatNames[] = { "BC1", "BC3", "BC4", "BC5" };
+    printf( "Cooked %s (%dx%d, %u mips, %s)\n", path, width, height, header.mipsCount, formatNames[ header.format ] );
+    ++job->cookedCount;
+}
+
+internal bool IsTextureSource( char *name )
+{
+    char *extension = strrchr( name, '.' );
+    return extension && ( _stricmp( extension, ".jpg" ) == 0 || _stricmp( extension, ".jpeg" ) == 0 ||
+                          _stricmp( extension, ".png" ) == 0 );
+}
+
+internal void CollectTextures( char *directory, std::vector< std::string > *paths )
+{
+    char pattern[ MAX_PATH ];
+    snprintf( pattern, sizeof( pattern ), "%s/*", directory );
+
+    WIN32_FIND_DATAA findData;
+    HANDLE find = FindFirstFileA( pattern, &findData );
+    if ( find == INVALID_HANDLE_VALUE ) { return; }
+
+    do
+    {
+        if ( strcmp( findData.cFileName, "." ) == 0 || strcmp( findData.cFileName, ".." ) == 0 ) { continue; }
+
+        char path[ MAX_PATH ];
+        snprintf( path, sizeof( path ), "%s/%s", directory, findData.cFileName );
+        if ( findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+        {
+            CollectTextures( path, paths );
+        }
+        else if ( IsTextureSource( findData.cFileName ) )
+        {
+            paths->push_back( path );
+        }
+    } while ( FindNextFileA( find, &findData ) );
+
+    FindClose( find );
+}
+
+int main( int argumentsCount, char **arguments )
+{
+    Cook_Job job;
+    std::vector< std::string > paths;
+    job.paths = &paths;
+    job.force = false;
+    job.cookedCount = 0;
+    job.failedCount = 0;
+
+    for ( int i = 1; i < argumentsCount; ++i )
+    {
+        if ( strcmp( arguments[ i ], "-force" ) == 0 )
+        {
+            job.force = true;
+            continue;
+        }
+
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if ( !GetFileAttributesExA( arguments[ i ], GetFileExInfoStandard, &attributes ) )
+        {
+            printf( "No such file or directory: %s\n", arguments[ i ] );
+            continue;
+        }
+
+        if ( attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+        {
+            CollectTextures( arguments[ i ], &paths );
+        }
+        else
+        {
+            paths.push_back( arguments[ i ] );
+        }
+    }
+
+    if ( argumentsCount == 1 || ( argumentsCount == 2 && job.force ) )
+    {
+        CollectTextures( ".", &paths );
+    }
+
+    Job_Queue *queue = CreateJobQueue();
+    Job_Group group = {};
+    for ( int i = 0; i < ( int ) paths.size(); ++i )
+    {
+        AddJob( queue, &group, CookTextureJob, &job, i );
+    }
+    WaitForJobs( queue, &group );
+    DestroyJobQueue( queue );
+
+    int cookedCount = job.cookedCount;
+    int failedCount = job.failedCount;
+    printf( "%d textures: %d cooked, %d up to date, %d failed\n", ( int ) paths.size(), cookedCount,
+            ( int ) paths.size() - cookedCount - failedCount, failedCount );
+    return failedCount ? 1 : 0;
+}